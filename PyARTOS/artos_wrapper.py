@@ -182,11 +182,36 @@ class _LibARTOS(object):
             self._errcheck_num_fe
         )
         
+        # prepare_detector function
+        self._register_func('prepare_detector',
+            (c_int, c_uint, c_uint, c_uint),
+            ((1, 'detector'), (1, 'img_width'), (1, 'img_height'))
+        )
+        
+        # set_fftw_wisdom_file function
+        self._register_func('set_fftw_wisdom_file',
+            (c_void_p, c_char_p),
+            ((1, 'wisdom_file'),)
+        )
+        
+        # set_filter_spectrum_cache_dir function
+        self._register_func('set_filter_spectrum_cache_dir',
+            (c_void_p, c_char_p),
+            ((1, 'directory'),)
+        )
+        
         # detect_file_jpeg function
         self._register_func('detect_file_jpeg',
             (c_int, c_uint, c_char_p, FlatDetection_p, c_uint_p),
             ((1, 'detector'), (1, 'imagefile'), (1, 'detection_buf'), (1, 'detection_buf_size'))
         )
+        
+        # detect_file_jpeg_ex function
+        self._register_func('detect_file_jpeg_ex',
+            (c_int, c_uint, c_char_p, FlatDetection_p, c_uint_p, FlatBoundingBox_p, c_uint, c_uint, c_uint, c_uint, c_uint),
+            ((1, 'detector'), (1, 'imagefile'), (1, 'detection_buf'), (1, 'detection_buf_size'), (1, 'rois', None), (1, 'num_rois', 0),
+             (1, 'min_width', 0), (1, 'min_height', 0), (1, 'max_width', 0), (1, 'max_height', 0))
+        )
 
         # detect_file_featuredump function
         self._register_func('detect_file_featuredump',
@@ -201,6 +226,29 @@ class _LibARTOS(object):
              (1, 'detection_buf'), (1, 'detection_buf_size'))
         )
         
+        # detect_raw_ex function
+        self._register_func('detect_raw_ex',
+            (c_int, c_uint, c_ubyte_p, c_uint, c_uint, c_bool, FlatDetection_p, c_uint_p, FlatBoundingBox_p, c_uint, c_uint, c_uint, c_uint, c_uint),
+            ((1, 'detector'), (1, 'img_data'), (1, 'img_width'), (1, 'img_height'), (1, 'grayscale'),
+             (1, 'detection_buf'), (1, 'detection_buf_size'), (1, 'rois', None), (1, 'num_rois', 0),
+             (1, 'min_width', 0), (1, 'min_height', 0), (1, 'max_width', 0), (1, 'max_height', 0))
+        )
+        
+        # detect_raw_strided function
+        self._register_func('detect_raw_strided',
+            (c_int, c_uint, c_ubyte_p, c_uint, c_uint, c_bool, c_uint, FlatDetection_p, c_uint_p, FlatBoundingBox_p, c_uint, c_uint, c_uint, c_uint, c_uint),
+            ((1, 'detector'), (1, 'img_data'), (1, 'img_width'), (1, 'img_height'), (1, 'grayscale'), (1, 'img_stride'),
+             (1, 'detection_buf'), (1, 'detection_buf_size'), (1, 'rois', None), (1, 'num_rois', 0),
+             (1, 'min_width', 0), (1, 'min_height', 0), (1, 'max_width', 0), (1, 'max_height', 0))
+        )
+        
+        # detect_files_jpeg function
+        self._register_func('detect_files_jpeg',
+            (c_int, c_uint, POINTER(c_char_p), c_uint, FlatDetection_p, c_uint_p, POINTER(c_int), c_uint),
+            ((1, 'detector'), (1, 'imagefiles'), (1, 'num_imagefiles'), (1, 'detection_buf'), (1, 'detection_buf_sizes'),
+             (1, 'results', None), (1, 'num_threads', 0))
+        )
+        
         # learn_imagenet function
         self._register_func('learn_imagenet',
             (c_int, c_char_p, c_char_p, c_char_p, c_char_p, c_bool, c_uint, c_uint, c_uint, c_uint, c_uint, overall_progress_cb_t, c_bool),
@@ -250,6 +298,13 @@ class _LibARTOS(object):
              (1, 'bboxes', None), (1, 'num_bboxes', 1))
         )
         
+        # learner_add_raw_strided function
+        self._register_func('learner_add_raw_strided',
+            (c_int, c_uint, c_ubyte_p, c_uint, c_uint, c_bool, c_uint, FlatBoundingBox_p, c_uint),
+            ((1, 'learner'), (1, 'img_data'), (1, 'img_width'), (1, 'img_height'), (1, 'grayscale'), (1, 'img_stride'),
+             (1, 'bboxes', None), (1, 'num_bboxes', 1))
+        )
+        
         # learner_run function
         self._register_func('learner_run',
             (c_int, c_uint, c_uint, c_uint, progress_cb_t),
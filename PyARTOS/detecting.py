@@ -186,6 +186,33 @@ class Detection(BoundingBox):
 
 
 
+def setFFTWWisdomFile(wisdomFile):
+    """Changes the file which FFTW wisdom is read from and written to by all detectors.
+    
+    wisdomFile - Path to the wisdom file. If None or empty, wisdom will neither be read nor written.
+                 Defaults to "wisdom.fftw" in the current working directory.
+    """
+    
+    if (libartos is None):
+        raise RuntimeError('Can not find libartos')
+    libartos.set_fftw_wisdom_file(utils.str2bytes(wisdomFile) if wisdomFile else None)
+
+
+def setFilterSpectrumCacheDir(directory):
+    """Changes the directory where the Fourier transforms of model filters are stored.
+    
+    Transformed filters stored there are mapped into memory by other detectors and processes instead of
+    being computed again. Within a process, they are shared by all detectors even if no directory is set.
+    
+    directory - Path to an existing directory. If None or empty, transformed filters will not be stored on disk.
+    """
+    
+    if (libartos is None):
+        raise RuntimeError('Can not find libartos')
+    libartos.set_filter_spectrum_cache_dir(utils.str2bytes(directory) if directory else None)
+
+
+
 class Detector(object):
 
     def __init__(self, overlap = 0.5, interval = 10, debug = False):
@@ -257,13 +284,30 @@ class Detector(object):
         
         return libartos.num_feature_extractors_in_detector(self.handle)
 
+    
+    def prepare(self, img_size):
+        """Prepares the detector for images of a given size, so that the first detection on such images will not be slowed down.
+        
+        This may be called for each image size expected by an application after all models have been added.
+        img_size - A `(width, height)` tuple specifying the size of the images.
+        
+        If an error occurs, a LibARTOSException is thrown.
+        """
+        
+        libartos.prepare_detector(self.handle, img_size[0], img_size[1])
 
-    def detect(self, img, limit = 3):
+
+    def detect(self, img, limit = 3, regions = None, minSize = (0, 0), maxSize = (0, 0)):
         """Detects objects in a given image which match one of the models added before using addModel() or addModels().
         
         img - Either a PIL.Image.Image object or a path to a JPEG file. In the latter case, the image will be read
               directly by the library.
         limit - Maximum number of detections returned (affects memory allocated for library call)
+        regions - Optionally, a sequence with BoundingBox instances or (left, top, right, bottom) tuples specifying
+                  regions of interest. Only objects whose centre lies inside one of these regions will be detected.
+        minSize - A `(width, height)` tuple specifying the minimum size of detected objects in pixels.
+        maxSize - A `(width, height)` tuple specifying the maximum size of detected objects in pixels (0 means no limit).
+                  Restricting the range of object sizes speeds up detection, since fewer scales have to be searched.
         Returns: A list of objects detected in img, each described by an instance of the Detection class.
         
         If an error occurs, a LibARTOSException is thrown.
@@ -278,20 +322,71 @@ class Detector(object):
         buf_size = ctypes.c_uint(limit)
         buf = (artos_wrapper.FlatDetection * buf_size.value)()
         
+        # Convert regions of interest to FlatBoundingBox array
+        if isinstance(regions, BoundingBox):
+            regions = (regions,)
+        if (regions is not None) and (len(regions) > 0):
+            rois = (artos_wrapper.FlatBoundingBox * len(regions))()
+            for i, box in enumerate((BoundingBox(r) for r in regions)):
+                rois[i] = artos_wrapper.FlatBoundingBox(left = box.left, top = box.top, width = box.width, height = box.height)
+            numRois = len(rois)
+        else:
+            rois = None
+            numRois = 0
+        
         # Run detector
         if isinstance(img, Image.Image):
             # Convert image to plain RGB or grayscale
             imgdata, grayscale = utils.img2buffer(img)
             # Run detector
-            libartos.detect_raw(self.handle, ctypes.cast(imgdata, artos_wrapper.c_ubyte_p), img.size[0], img.size[1], grayscale, buf, buf_size)
+            libartos.detect_raw_ex(self.handle, ctypes.cast(imgdata, artos_wrapper.c_ubyte_p), img.size[0], img.size[1], grayscale, buf, buf_size,
+                                   rois, numRois, minSize[0], minSize[1], maxSize[0], maxSize[1])
         else:
             # Treat img as filename
-            libartos.detect_file_jpeg(self.handle, utils.str2bytes(img), buf, buf_size)
+            libartos.detect_file_jpeg_ex(self.handle, utils.str2bytes(img), buf, buf_size,
+                                         rois, numRois, minSize[0], minSize[1], maxSize[0], maxSize[1])
        
         # Convert detection results (buf_size is set to the actual number of detection results by the library)
         return [Detection.fromFlatDetection(buf[i]) for i in range(buf_size.value)]
     
 
+    def detectBatch(self, imageFiles, limit = 3, numThreads = 0):
+        """Detects objects in a batch of JPEG files which match one of the models added before using addModel() or addModels().
+        
+        The images are processed in parallel by the library, which is much faster than calling detect() for each image
+        when processing large amounts of images.
+        
+        imageFiles - List with the paths of the JPEG files.
+        limit - Maximum number of detections returned per image (affects memory allocated for library call).
+        numThreads - Number of images processed in parallel. If set to 0, the number of hardware threads will be used.
+        Returns: A list with one entry for each image, which is either a list of objects detected in the image, each
+                 described by an instance of the Detection class, or a LibARTOSException if detection failed on that image.
+        
+        If no detection could be performed at all, a LibARTOSException is thrown.
+        """
+        
+        if utils.is_str(imageFiles) or not all(utils.is_str(f) for f in imageFiles):
+            raise TypeError('{0}.detectBatch expects argument imageFiles to be a list of strings'.format(self.__class__.__name__))
+        if (limit < 1):
+            limit = 1
+        if len(imageFiles) == 0:
+            return []
+        
+        # Allocate buffer memory, where the library will store the detection results
+        filenames = (ctypes.c_char_p * len(imageFiles))(*(utils.str2bytes(f) for f in imageFiles))
+        buf_sizes = (ctypes.c_uint * len(imageFiles))(*([limit] * len(imageFiles)))
+        buf = (artos_wrapper.FlatDetection * (limit * len(imageFiles)))()
+        results = (ctypes.c_int * len(imageFiles))()
+        
+        # Run detector
+        libartos.detect_files_jpeg(self.handle, filenames, len(imageFiles), buf, buf_sizes, results, numThreads)
+        
+        # Convert detection results (buf_sizes is set to the actual number of detection results for each image by the library)
+        return [[Detection.fromFlatDetection(buf[i * limit + j]) for j in range(buf_sizes[i])] if results[i] == 0
+                else artos_wrapper.LibARTOSException(results[i])
+                for i in range(len(imageFiles))]
+    
+
     def detectOnFeatureDump(self, feature_dump_file, img_size, limit = 3):
         """Detects objects in a pre-computed feature pyramid which match one of the models added before using addModel() or addModels().
         
@@ -3,6 +3,16 @@
 #include <iomanip>
 #include <fstream>
 #include <limits>
+#include <cmath>
+#include <iterator>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <cassert>
+#include <omp.h>
+#include <Eigen/Eigenvalues>
 
 #include "DPMDetection.h"
 #include "sysutils.h"
@@ -12,6 +22,13 @@
 using namespace ARTOS;
 using namespace std;
 
+// Checks if the centre of a detection lies inside of a region of interest
+static bool isCentredIn(const Rectangle & detection, const Rectangle & region)
+{
+    const int cx = detection.left() + detection.width() / 2, cy = detection.top() + detection.height() / 2;
+    return (cx >= region.left() && cx <= region.right() && cy >= region.top() && cy <= region.bottom());
+}
+
 DPMDetection::DPMDetection ( bool verbose, double overlap, int interval )
 {
     init ( verbose, overlap, interval );
@@ -39,25 +56,33 @@ void DPMDetection::init ( bool verbose, double overlap, int interval )
 {
     this->overlap = overlap;
     this->interval = interval;
+    this->pyramidApproximation = FeaturePyramid::Approximation::NONE;
+    this->pyramidExactLevels = 1;
+    this->crossClassNMS = false;
     this->verbose = verbose;
     this->nextModelIndex = 0;
+    this->cascadeRecall = 0.99;
+}
+
+
+void DPMDetection::setPyramidApproximation(FeaturePyramid::Approximation approximation, int exactLevels)
+{
+    this->pyramidApproximation = approximation;
+    this->pyramidExactLevels = max(exactLevels, 1);
 }
 
 
 int DPMDetection::addModel ( const std::string & classname, const std::string & modelfile, double threshold, const std::string & synsetId )
 {
-    // Try to open the mixture
-    ifstream in(modelfile.c_str(), ios::binary);
-    
-    if (!in.is_open()) {
-        if (this->verbose)
-            cerr << "\nInvalid model file " << modelfile << endl;
-        return ARTOS_DETECT_RES_INVALID_MODEL_FILE;
-    }
-    
+    // Try to read the mixture (binary model files are mapped into memory and used in place)
     Mixture * mixture = new Mixture();
     try {
-        in >> (*mixture);
+        if (!mixture->readFromFile(modelfile)) {
+            if (this->verbose)
+                cerr << "\nInvalid model file " << modelfile << endl;
+            delete mixture;
+            return ARTOS_DETECT_RES_INVALID_MODEL_FILE;
+        }
     } catch (const UnknownFeatureExtractorException & e) {
         if (this->verbose)
             cerr << "Invalid model file: " << modelfile << " (" << e.what() << ")" << endl;
@@ -109,6 +134,11 @@ int DPMDetection::addModelPointer ( const std::string & classname, Mixture * mix
     thresholds[classname] = threshold;
     synsetIds[classname] = synsetId;
     
+    // The cascade has been learned for the previous model
+    cascadeFilters.erase(classname);
+    cascadeSamples.erase(classname);
+    cascadeThresholds.erase(classname);
+    
     int feIndex = -1;
     for (int i = 0; i < featureExtractors.size(); i++)
         if (*(featureExtractors[i]) == *(mixture->featureExtractor()))
@@ -185,13 +215,104 @@ DPMDetection::~DPMDetection()
     mixtures.clear();
 }
 
-int DPMDetection::detect ( const JPEGImage & image, vector<Detection> & detections )
+int DPMDetection::detect ( const ImageView & image, vector<Detection> & detections ) const
+{
+    DetectionWorkspace workspace;
+    return this->detect(image, detections, workspace);
+}
+
+int DPMDetection::detect ( const ImageView & image, vector<Detection> & detections, DetectionWorkspace & workspace ) const
+{
+    return this->detectImage(image, detections, workspace, DetectionOptions());
+}
+
+int DPMDetection::detect ( const ImageView & image, vector<Detection> & detections, DetectionWorkspace & workspace,
+                           const DetectionOptions & options ) const
+{
+    if (options.regions.empty())
+        return this->detectImage(image, detections, workspace, options);
+    
+    if ( mixtures.size() == 0 )
+        return ARTOS_DETECT_RES_NO_MODELS;
+    if (image.empty())
+        return ARTOS_DETECT_RES_INVALID_IMAGE;
+    
+    // The context around each region must cover objects centred at its border and the
+    // cells along the border of the crop, whose features lack part of their neighbourhood
+    Size cellSize;
+    for (unsigned int feIndex = 0; feIndex < this->featureExtractors.size(); feIndex++)
+        cellSize = max(cellSize, this->featureExtractors[feIndex]->cellSize());
+    
+    vector<Detection> regionDetections, allDetections;
+    for (vector<Rectangle>::const_iterator region = options.regions.begin(); region != options.regions.end(); region++)
+    {
+        const Size context = Size(
+            (options.maxObjectSize.width > 0) ? options.maxObjectSize.width : region->width(),
+            (options.maxObjectSize.height > 0) ? options.maxObjectSize.height : region->height()
+        ) / 2 + cellSize;
+        const int left = max(region->left() - context.width, 0), top = max(region->top() - context.height, 0);
+        const int right = min(region->right() + context.width, image.width() - 1), bottom = min(region->bottom() + context.height, image.height() - 1);
+        if (region->empty() || region->right() < 0 || region->bottom() < 0 || region->left() >= image.width() || region->top() >= image.height())
+            continue;
+        
+        regionDetections.clear();
+        int errcode = this->detectImage(image.crop(left, top, right - left + 1, bottom - top + 1), regionDetections, workspace, options);
+        if (errcode == ARTOS_DETECT_RES_INVALID_IMAGE)
+            continue;
+        else if (errcode != ARTOS_RES_OK)
+            return errcode;
+        
+        // Keep the detections centred inside of the region and map them back to the coordinates of the image
+        for (vector<Detection>::iterator d = regionDetections.begin(); d != regionDetections.end(); d++)
+        {
+            d->setX(d->left() + left);
+            d->setY(d->top() + top);
+            if (isCentredIn(*d, *region))
+                allDetections.push_back(move(*d));
+        }
+    }
+    
+    // Overlapping regions may have detected the same objects
+    if (options.regions.size() > 1)
+    {
+        vector<Detection> mergedDetections;
+        mergedDetections.reserve(allDetections.size());
+        stable_sort(allDetections.begin(), allDetections.end(),
+                    [](const Detection & a, const Detection & b) { return a.classname < b.classname; });
+        vector<Detection>::iterator first = allDetections.begin();
+        while (first != allDetections.end())
+        {
+            vector<Detection>::iterator last = find_if(first, allDetections.end(),
+                                                       [first](const Detection & d) { return d.classname != first->classname; });
+            vector<Detection> classDetections(make_move_iterator(first), make_move_iterator(last));
+            nonMaximumSuppression(classDetections, this->overlap);
+            mergedDetections.insert(mergedDetections.end(), make_move_iterator(classDetections.begin()), make_move_iterator(classDetections.end()));
+            first = last;
+        }
+        allDetections.swap(mergedDetections);
+        if (this->crossClassNMS)
+            nonMaximumSuppression(allDetections, this->overlap);
+    }
+    
+#ifndef NDEBUG
+    for (vector<Detection>::const_iterator d = allDetections.begin(); d != allDetections.end(); d++)
+        assert(!d->classname.empty() && any_of(options.regions.begin(), options.regions.end(),
+                                               [&d](const Rectangle & region) { return isCentredIn(*d, region); }));
+#endif
+    
+    detections.reserve(detections.size() + allDetections.size());
+    detections.insert(detections.end(), make_move_iterator(allDetections.begin()), make_move_iterator(allDetections.end()));
+    return ARTOS_RES_OK;
+}
+
+int DPMDetection::detectImage ( const ImageView & image, vector<Detection> & detections, DetectionWorkspace & workspace,
+                                const DetectionOptions & options ) const
 {
     if ( mixtures.size() == 0 )
         return ARTOS_DETECT_RES_NO_MODELS;
 
-    int errcode;
-    unsigned int minLevelSize = min(5, this->minModelSize().min());
+    int errcode = ARTOS_RES_OK;
+    const size_t firstDetection = detections.size();
     
     // Separate detection for every unique feature extractor
     for (unsigned int feIndex = 0; feIndex < this->featureExtractors.size(); feIndex++)
@@ -201,10 +322,17 @@ int DPMDetection::detect ( const JPEGImage & image, vector<Detection> & detectio
         if (this->verbose)
             start();
 
-        FeaturePyramid pyramid(image, this->featureExtractors[feIndex], this->interval, minLevelSize);
+        double minScale, maxScale;
+        this->pyramidScaleRange(feIndex, options, minScale, maxScale);
+        FeaturePyramid pyramid;
+        this->computePyramid(image, feIndex, pyramid, minScale, maxScale);
 
         if (pyramid.empty())
         {
+            // No level is within the range of scales of the objects
+            if (pyramid.interval() > 0)
+                continue;
+            
             if (this->verbose)
                 cerr << "\nCould not create feature pyramid! Image may be invalid." << endl;
             return ARTOS_DETECT_RES_INVALID_IMAGE;
@@ -213,19 +341,38 @@ int DPMDetection::detect ( const JPEGImage & image, vector<Detection> & detectio
         if (this->verbose)
         {
             cerr << "Computed " << pyramid.featureExtractor()->type() << " features in " << stop() << " ms for an image of size " <<
-                    image.width() << " x " << image.height() << endl;
+                    image.width() << " x " << image.height() << " (" << pyramid.levels().size() << " levels)" << endl;
         }
 
-        errcode = this->detect( image.width(), image.height(), pyramid, detections, feIndex);
+        errcode = this->detectPyramid( image.width(), image.height(), pyramid, detections, workspace, feIndex, options);
         if (errcode != ARTOS_RES_OK)
             return errcode;
     
     }
 
+    // Non maxima suppression across classes (including the detections of all feature extractors)
+    this->suppressAcrossClasses(detections, firstDetection);
+    return errcode;
+}
+
+int DPMDetection::detect(int width, int height, const FeaturePyramid & pyramid, vector<Detection> & detections, unsigned int featureExtractorIndex) const
+{
+    DetectionWorkspace workspace;
+    return this->detect(width, height, pyramid, detections, workspace, featureExtractorIndex);
+}
+
+int DPMDetection::detect(int width, int height, const FeaturePyramid & pyramid, vector<Detection> & detections,
+                         DetectionWorkspace & workspace, unsigned int featureExtractorIndex) const
+{
+    const size_t firstDetection = detections.size();
+    int errcode = this->detectPyramid(width, height, pyramid, detections, workspace, featureExtractorIndex, DetectionOptions());
+    if (errcode == ARTOS_RES_OK)
+        this->suppressAcrossClasses(detections, firstDetection);
     return errcode;
 }
 
-int DPMDetection::detect(int width, int height, const FeaturePyramid & pyramid, vector<Detection> & detections, unsigned int featureExtractorIndex)
+int DPMDetection::detectPyramid(int width, int height, const FeaturePyramid & pyramid, vector<Detection> & detections,
+                                DetectionWorkspace & workspace, unsigned int featureExtractorIndex, const DetectionOptions & options) const
 {
     int errcode = this->initPatchwork(pyramid.levels()[0].rows(), pyramid.levels()[0].cols(), pyramid.levels()[0].channels());
     if (errcode != ARTOS_RES_OK)
@@ -234,22 +381,25 @@ int DPMDetection::detect(int width, int height, const FeaturePyramid & pyramid,
     if ( this->verbose )
         start();
     
-    for ( map<std::string, Mixture *>::iterator m = this->mixtures.begin(); m != this->mixtures.end(); m++ )
-        if (this->featureExtractorIndices[m->first] == featureExtractorIndex)
+    // Compute the scores of all models at once
+    this->convolveMixtures(pyramid, featureExtractorIndex, workspace);
+    
+    for ( map<std::string, Mixture *>::const_iterator m = this->mixtures.begin(); m != this->mixtures.end(); m++ )
+        if (this->featureExtractorIndices.at(m->first) == featureExtractorIndex)
         {
-            Mixture * mixture = m->second;
+            const Mixture * mixture = m->second;
             const std::string & classname = m->first;
-            double threshold = thresholds[classname];
-            const std::string & synsetId = synsetIds[classname];
-            unsigned int modelIndex = modelIndices[classname];
+            double threshold = thresholds.at(classname);
+            const std::string & synsetId = synsetIds.at(classname);
+            unsigned int modelIndex = modelIndices.at(classname);
 
-            // Compute the scores
+            // Retrieve the scores
             if (this->verbose)
                 cerr << "Running detector for " << classname << endl;
-            vector<ScalarMatrix> scores;
-            vector<Mixture::Indices> argmaxes;
-            vector<Detection> single_detections;
-            mixture->convolve(pyramid, scores, argmaxes);
+            const vector<ScalarMatrix> & scores = workspace.scores[classname];
+            const vector<Mixture::Indices> & argmaxes = workspace.argmaxes[classname];
+            vector<Detection> & single_detections = workspace.candidates;
+            single_detections.clear();
             
             // Cache the size of the models
             vector<Size> sizes(mixture->models().size());
@@ -287,6 +437,12 @@ int DPMDetection::detect(int width, int height, const FeaturePyramid & pyramid,
                                         sizes[argmaxes[i](y, x)].height / scale + 0.5
                                 ));
                                 Rectangle bndbox(pos.width, pos.height, size.width, size.height);
+                                
+                                // Skip objects outside of the range of sizes
+                                if ((size.width < options.minObjectSize.width) || (size.height < options.minObjectSize.height)
+                                        || (options.maxObjectSize.width > 0 && size.width > options.maxObjectSize.width)
+                                        || (options.maxObjectSize.height > 0 && size.height > options.maxObjectSize.height))
+                                    continue;
                       
                                 // Truncate the object
                                 bndbox.setX(max(bndbox.x(), 0));
@@ -307,17 +463,13 @@ int DPMDetection::detect(int width, int height, const FeaturePyramid & pyramid,
                 cerr << "Number of detections before non-maximum suppression: " << single_detections.size() << endl;
 
             // Non maxima suppression
-            sort(single_detections.begin(), single_detections.end());
-            
-            for (int i = 1; i < single_detections.size(); ++i)
-                single_detections.resize(remove_if(single_detections.begin() + i, single_detections.end(),
-                        Intersector(single_detections[i - 1], this->overlap, true)) -
-                        single_detections.begin());
+            nonMaximumSuppression(single_detections, this->overlap);
 
             if (this->verbose)
                 cerr << "Number of detections after non-maximum suppression: " << single_detections.size() << endl;
 
-            detections.insert ( detections.begin(), single_detections.begin(), single_detections.end() );
+            detections.reserve(detections.size() + single_detections.size());
+            detections.insert ( detections.end(), single_detections.begin(), single_detections.end() );
         }
     
     if (this->verbose)
@@ -326,12 +478,30 @@ int DPMDetection::detect(int width, int height, const FeaturePyramid & pyramid,
     return ARTOS_RES_OK;
 }
 
-int DPMDetection::detectMax ( const JPEGImage & image, Detection & detection )
+void DPMDetection::suppressAcrossClasses ( vector<Detection> & detections, size_t first ) const
+{
+    if (!this->crossClassNMS || detections.size() <= first + 1)
+        return;
+    
+    vector<Detection> newDetections(make_move_iterator(detections.begin() + first), make_move_iterator(detections.end()));
+    detections.erase(detections.begin() + first, detections.end());
+    nonMaximumSuppression(newDetections, this->overlap);
+    detections.insert(detections.end(), make_move_iterator(newDetections.begin()), make_move_iterator(newDetections.end()));
+    
+    if (this->verbose)
+        cerr << "Number of detections after non-maximum suppression across classes: " << newDetections.size() << endl;
+}
+
+int DPMDetection::detectMax ( const ImageView & image, Detection & detection ) const
+{
+    DetectionWorkspace workspace;
+    return this->detectMax(image, detection, workspace);
+}
+
+int DPMDetection::detectMax ( const ImageView & image, Detection & detection, DetectionWorkspace & workspace ) const
 {
     if ( mixtures.size() == 0 )
         return ARTOS_DETECT_RES_NO_MODELS;
-    
-    unsigned int minLevelSize = min(5, this->minModelSize().min());
 
     // Separate detection for every unique feature extractor
     for (unsigned int feIndex = 0; feIndex < this->featureExtractors.size(); feIndex++)
@@ -341,7 +511,8 @@ int DPMDetection::detectMax ( const JPEGImage & image, Detection & detection )
         if (this->verbose)
             start();
         
-        FeaturePyramid pyramid(image, this->featureExtractors[feIndex], this->interval, minLevelSize);
+        FeaturePyramid pyramid;
+        this->computePyramid(image, feIndex, pyramid);
 
         if (pyramid.empty())
         {
@@ -362,22 +533,24 @@ int DPMDetection::detectMax ( const JPEGImage & image, Detection & detection )
         if ( this->verbose )
             start();
 
+        // Compute the scores of all models at once
+        this->convolveMixtures(pyramid, feIndex, workspace);
+
         FeatureScalar score, maxScore = -1 * numeric_limits<FeatureScalar>::infinity();
         int y, x;
-        for ( map<std::string, Mixture *>::iterator m = this->mixtures.begin(); m != this->mixtures.end(); m++ )
-            if (this->featureExtractorIndices[m->first] == feIndex)
+        for ( map<std::string, Mixture *>::const_iterator m = this->mixtures.begin(); m != this->mixtures.end(); m++ )
+            if (this->featureExtractorIndices.at(m->first) == feIndex)
             {
-                Mixture * mixture = m->second;
+                const Mixture * mixture = m->second;
                 const std::string & classname = m->first;
-                const std::string & synsetId = synsetIds[classname];
-                unsigned int modelIndex = modelIndices[classname];
+                const std::string & synsetId = synsetIds.at(classname);
+                unsigned int modelIndex = modelIndices.at(classname);
 
-                // Compute the scores
+                // Retrieve the scores
                 if (this->verbose)
                     cerr << "Running detector for " << classname << endl;
-                vector<ScalarMatrix> scores;
-                vector<Mixture::Indices> argmaxes;
-                mixture->convolve(pyramid, scores, argmaxes);
+                const vector<ScalarMatrix> & scores = workspace.scores[classname];
+                const vector<Mixture::Indices> & argmaxes = workspace.argmaxes[classname];
                 
                 // Cache the size of the models
                 vector<Size> sizes(mixture->models().size());
@@ -423,22 +596,689 @@ int DPMDetection::detectMax ( const JPEGImage & image, Detection & detection )
     return ARTOS_RES_OK;
 }
 
-int DPMDetection::initPatchwork(unsigned int rows, unsigned int cols, unsigned int numFeatures)
+int DPMDetection::detectBatch ( const vector<JPEGImage> & images, vector< vector<Detection> > & detections,
+                                vector<int> * results, unsigned int numThreads ) const
+{
+    return this->runBatch(images.size(), [&images](size_t index, JPEGImage &) -> const JPEGImage & { return images[index]; },
+                          detections, results, numThreads);
+}
+
+int DPMDetection::detectBatch ( size_t numImages, const ImageLoader & loader, vector< vector<Detection> > & detections,
+                                vector<int> * results, unsigned int numThreads ) const
+{
+    return this->runBatch(numImages, [&loader](size_t index, JPEGImage & buffer) -> const JPEGImage & { buffer = loader(index); return buffer; },
+                          detections, results, numThreads);
+}
+
+int DPMDetection::runBatch ( size_t numImages, const function<const JPEGImage & (size_t, JPEGImage &)> & getImage,
+                             vector< vector<Detection> > & detections, vector<int> * results, unsigned int numThreads ) const
 {
-    // Initialize the Patchwork class (only when necessary)
+    detections.clear();
+    if (results != NULL)
+        results->clear();
+    if ( mixtures.size() == 0 )
+        return ARTOS_DETECT_RES_NO_MODELS;
+    
+    detections.resize(numImages);
+    vector<int> imageResults(numImages, ARTOS_RES_OK);
+    
+    if (numThreads == 0)
+        numThreads = max(thread::hardware_concurrency(), 1u);
+    if (numThreads > numImages)
+        numThreads = static_cast<unsigned int>(numImages);
+    
+    // Each worker fetches the next unprocessed image, so that the workers are at different
+    // stages of the detection at any time and images of different complexity are balanced
+    atomic<size_t> nextImage(0);
+    auto worker = [&](bool ownThread)
+    {
+        // The images are processed in parallel already, so parallelizing the stages
+        // of the detection on a single image would just oversubscribe the cores
+        if (ownThread)
+            omp_set_num_threads(1);
+        
+        JPEGImage buffer;
+        DetectionWorkspace workspace;
+        for (size_t i = nextImage++; i < numImages; i = nextImage++)
+        {
+            try
+            {
+                const JPEGImage & image = getImage(i, buffer);
+                imageResults[i] = (image.empty()) ? ARTOS_DETECT_RES_INVALID_IMG_DATA : this->detect(image, detections[i], workspace);
+            }
+            catch (const exception &)
+            {
+                imageResults[i] = ARTOS_RES_INTERNAL_ERROR;
+            }
+            if (imageResults[i] != ARTOS_RES_OK)
+                detections[i].clear();
+        }
+    };
+    
+    if (numThreads <= 1)
+        worker(false);
+    else
+    {
+        vector<thread> workers;
+        workers.reserve(numThreads);
+        for (unsigned int t = 0; t < numThreads; t++)
+            workers.push_back(thread(worker, true));
+        for (vector<thread>::iterator t = workers.begin(); t != workers.end(); t++)
+            t->join();
+    }
+    
+    int numFailed = static_cast<int>(count_if(imageResults.begin(), imageResults.end(), [](int result) { return result != ARTOS_RES_OK; }));
+    if (results != NULL)
+        results->swap(imageResults);
+    return numFailed;
+}
+
+void DPMDetection::convolveMixtures(const FeaturePyramid & pyramid, unsigned int featureExtractorIndex,
+                                    DetectionWorkspace & workspace, bool useCascade) const
+{
+    // Maximum number of filters convolved with the patchwork at once, which limits
+    // the memory required for the frequency-domain products of the filters and the planes
+    static const size_t maxBatchFilters = 128;
+    
+    map< std::string, vector<ScalarMatrix> > & scores = workspace.scores;
+    map< std::string, vector<Mixture::Indices> > & argmaxes = workspace.argmaxes;
+    
+    // Select the mixtures using the given feature extractor.
+    // The results of previous detections are kept for reuse, but must not be mistaken for valid ones.
+    vector< pair<std::string, const Mixture*> > batchMixtures;
+    for (map<std::string, Mixture *>::const_iterator m = this->mixtures.begin(); m != this->mixtures.end(); m++)
+        if (this->featureExtractorIndices.at(m->first) == featureExtractorIndex)
+        {
+            if (m->second->empty() || pyramid.empty())
+            {
+                scores[m->first].clear();
+                argmaxes[m->first].clear();
+                continue;
+            }
+            batchMixtures.push_back(make_pair(m->first, m->second));
+        }
+    if (batchMixtures.empty())
+        return;
+    
+    // Determine the pyramid levels where the approximate score of any component of a mixture passes the
+    // first stage of the cascade and skip mixtures which have been rejected at all locations
+    map< std::string, vector<bool> > cascadeLevels;
+    if (useCascade && this->hasCascade())
+    {
+        this->computeCascadeScores(pyramid, featureExtractorIndex, workspace);
+        size_t numRejected = 0;
+        for (vector< pair<std::string, const Mixture*> >::iterator m = batchMixtures.begin(); m != batchMixtures.end();)
+        {
+            map< std::string, vector< vector<ScalarMatrix> > >::const_iterator cascade = workspace.cascadeScores.find(m->first);
+            if (cascade == workspace.cascadeScores.end())
+            {
+                ++m;
+                continue;
+            }
+            
+            const vector<FeatureScalar> & componentThresholds = this->cascadeThresholds.at(m->first);
+            vector<bool> & levels = cascadeLevels[m->first];
+            levels.assign(pyramid.levels().size(), false);
+            bool accepted = false;
+            for (size_t c = 0; c < cascade->second.size(); ++c)
+                for (size_t l = 0; l < levels.size(); ++l)
+                    if (!levels[l] && cascade->second[c][l].size() > 0 && cascade->second[c][l].maxCoeff() >= componentThresholds[c])
+                        levels[l] = accepted = true;
+            
+            if (accepted)
+                ++m;
+            else
+            {
+                scores[m->first].clear();
+                argmaxes[m->first].clear();
+                m = batchMixtures.erase(m);
+                ++numRejected;
+            }
+        }
+        if (this->verbose)
+            cerr << "Cascade rejected " << numRejected << " of " << (numRejected + batchMixtures.size()) << " models" << endl;
+        if (batchMixtures.empty())
+            return;
+    }
+    
+    // Determine the padding required by the largest mixture
+    Size maxSize(0, 0);
+    int numFilters = 0, numFilterCells = 0;
+    for (vector< pair<std::string, const Mixture*> >::const_iterator m = batchMixtures.begin(); m != batchMixtures.end(); m++)
+    {
+        maxSize = max(maxSize, m->second->maxSize());
+        numFilters += m->second->numFilters();
+        numFilterCells += m->second->numFilterCells();
+    }
+    
+    // Root-only mixtures are convolved separately, since their scores can be computed directly
+    stable_partition(batchMixtures.begin(), batchMixtures.end(),
+                     [](const pair<std::string, const Mixture*> & m) { return m.second->rootOnly(); });
+    
+    // Create a single patchwork for all mixtures, leaving out the smallest levels,
+    // which are convolved faster in the spatial domain
+    const Size padding = maxSize / 2 + 1;
+    const int numFFTLevels = Patchwork::NumFFTLevels(pyramid, padding, numFilters, numFilterCells);
+    workspace.patchwork.assign(pyramid, padding, numFFTLevels);
+    const Patchwork & patchwork = workspace.patchwork;
+    
+    // Invalidates the scores of mixtures which could not be convolved
+    auto discardScores = [&](size_t first, size_t last)
+    {
+        for (size_t i = first; i < last; ++i)
+        {
+            scores[batchMixtures[i].first].clear();
+            argmaxes[batchMixtures[i].first].clear();
+        }
+    };
+    
+    if (numFFTLevels > 0 && patchwork.empty())
+    {
+        discardScores(0, batchMixtures.size());
+        return;
+    }
+    
+    // Convolve the patchwork with the filters of as many mixtures at once as possible
+    for (size_t first = 0, last; first < batchMixtures.size(); first = last)
+    {
+        vector<const Patchwork::Filter *> filters;
+        vector<size_t> offsets;
+        size_t numBatchFilters = 0;
+        const bool rootOnly = batchMixtures[first].second->rootOnly();
+        for (last = first; last < batchMixtures.size() && (last == first || numBatchFilters < maxBatchFilters)
+                           && batchMixtures[last].second->rootOnly() == rootOnly; ++last)
+        {
+            offsets.push_back(numBatchFilters);
+            numBatchFilters += batchMixtures[last].second->numFilters();
+            if (!patchwork.empty())
+            {
+                const vector<Patchwork::Filter> & mixtureFilters = batchMixtures[last].second->transformedFilters(patchwork.planeSize());
+                for (vector<Patchwork::Filter>::const_iterator f = mixtureFilters.begin(); f != mixtureFilters.end(); f++)
+                    filters.push_back(&(*f));
+            }
+        }
+        offsets.push_back(numBatchFilters);
+        
+        if (rootOnly)
+        {
+            // Compute the maximum over the components of each mixture while transforming the convolutions back,
+            // reusing the score matrices of the previous detection
+            vector< vector<ScalarMatrix> > maxScores(last - first);
+            vector< vector<Mixture::Indices> > maxArgmaxes(last - first);
+            for (size_t i = first; i < last; ++i)
+            {
+                maxScores[i - first].swap(scores[batchMixtures[i].first]);
+                maxArgmaxes[i - first].swap(argmaxes[batchMixtures[i].first]);
+            }
+            
+            if (!patchwork.empty())
+            {
+                vector<int> groupSizes;
+                vector<FeatureScalar> biases;
+                for (size_t i = first; i < last; ++i)
+                {
+                    const vector<FeatureScalar> mixtureBiases = batchMixtures[i].second->biases();
+                    groupSizes.push_back(static_cast<int>(mixtureBiases.size()));
+                    biases.insert(biases.end(), mixtureBiases.begin(), mixtureBiases.end());
+                }
+                
+                patchwork.convolveMax(filters, groupSizes, biases, maxScores, maxArgmaxes, &workspace.products);
+                if (maxScores.empty())
+                {
+                    discardScores(first, last);
+                    continue;
+                }
+            }
+            
+            for (size_t i = first; i < last; ++i)
+            {
+                scores[batchMixtures[i].first].swap(maxScores[i - first]);
+                argmaxes[batchMixtures[i].first].swap(maxArgmaxes[i - first]);
+                batchMixtures[i].second->maximizeDirect(pyramid, numFFTLevels,
+                                                        scores[batchMixtures[i].first], argmaxes[batchMixtures[i].first]);
+            }
+            continue;
+        }
+        
+        vector< vector<ScalarMatrix> > & convolutions = workspace.convolutions;
+        convolutions.resize(numBatchFilters);
+        if (!patchwork.empty())
+        {
+            patchwork.convolve(filters, convolutions, &workspace.products);
+            if (convolutions.empty())
+            {
+                discardScores(first, last);
+                continue;
+            }
+        }
+        
+        // Compute the scores of each mixture from the convolutions of its filters
+        for (size_t i = first; i < last; ++i)
+        {
+            vector< vector<ScalarMatrix> > mixtureConvolutions(offsets[i - first + 1] - offsets[i - first]);
+            for (size_t j = 0; j < mixtureConvolutions.size(); ++j)
+                mixtureConvolutions[j].swap(convolutions[offsets[i - first] + j]);
+            batchMixtures[i].second->convolveDirect(pyramid, numFFTLevels, mixtureConvolutions);
+            
+            // Parts of levels rejected by the cascade are left out, so that their distance transforms
+            // are skipped and the scores of the root one octave above are set to negative infinity
+            map< std::string, vector<bool> >::const_iterator levels = cascadeLevels.find(batchMixtures[i].first);
+            if (levels != cascadeLevels.end())
+            {
+                const vector<Model> & models = batchMixtures[i].second->models();
+                for (size_t c = 0, f = 0; c < models.size(); f += models[c].nbParts() + 1, ++c)
+                    for (size_t l = pyramid.interval(); l < levels->second.size(); ++l)
+                        if (!levels->second[l])
+                            for (int p = 1; p <= models[c].nbParts(); ++p)
+                                mixtureConvolutions[f + p][l - pyramid.interval()].resize(0, 0);
+            }
+            
+            batchMixtures[i].second->convolve(pyramid, mixtureConvolutions, scores[batchMixtures[i].first], argmaxes[batchMixtures[i].first]);
+        }
+    }
+    
+    // Reject the locations where the approximate score of the best component does not pass the cascade
+    size_t numLocations = 0, numAccepted = 0;
+    for (map< std::string, vector<bool> >::const_iterator levels = cascadeLevels.begin(); levels != cascadeLevels.end(); levels++)
+    {
+        vector<ScalarMatrix> & mixtureScores = scores[levels->first];
+        const vector<Mixture::Indices> & mixtureArgmaxes = argmaxes[levels->first];
+        const vector< vector<ScalarMatrix> > & cascade = workspace.cascadeScores[levels->first];
+        const vector<FeatureScalar> & componentThresholds = this->cascadeThresholds.at(levels->first);
+        for (size_t l = 0; l < mixtureScores.size(); ++l)
+        {
+            numLocations += mixtureScores[l].size();
+            for (int y = 0; y < mixtureScores[l].rows(); ++y)
+                for (int x = 0; x < mixtureScores[l].cols(); ++x)
+                {
+                    const int c = mixtureArgmaxes[l](y, x);
+                    if (cascade[c][l](y, x) < componentThresholds[c])
+                        mixtureScores[l](y, x) = -numeric_limits<FeatureScalar>::infinity();
+                    else
+                        ++numAccepted;
+                }
+        }
+    }
+    if (this->verbose && !cascadeLevels.empty())
+        cerr << "Cascade accepted " << numAccepted << " of " << numLocations << " locations of the remaining models" << endl;
+}
+
+
+void DPMDetection::computeCascadeScores(const FeaturePyramid & pyramid, unsigned int featureExtractorIndex,
+                                        DetectionWorkspace & workspace) const
+{
+    map< std::string, vector< vector<ScalarMatrix> > > & cascadeScores = workspace.cascadeScores;
+    
+    // Select the mixtures which are part of the cascade, keeping the buffers of the others for reuse
+    vector< pair<const Mixture*, const vector<FeatureMatrix>*> > cascadeMixtures;
+    vector< vector< vector<ScalarMatrix> >* > mixtureScores;
+    for (map<std::string, Mixture *>::const_iterator m = this->mixtures.begin(); m != this->mixtures.end(); m++)
+        if (this->featureExtractorIndices.at(m->first) == featureExtractorIndex)
+        {
+            map< std::string, vector<FeatureMatrix> >::const_iterator filters = this->cascadeFilters.find(m->first);
+            if (filters == this->cascadeFilters.end() || pyramid.empty())
+                cascadeScores.erase(m->first);
+            else
+            {
+                cascadeMixtures.push_back(make_pair(m->second, &(filters->second)));
+                mixtureScores.push_back(&cascadeScores[m->first]);
+                mixtureScores.back()->resize(filters->second.size());
+                for (size_t c = 0; c < filters->second.size(); ++c)
+                    (*mixtureScores.back())[c].resize(pyramid.levels().size());
+            }
+        }
+    if (cascadeMixtures.empty())
+        return;
+    
+    // Project the features onto the principal components once for all mixtures
+    const ScalarMatrix & projection = this->cascadeProjections[featureExtractorIndex];
+    const int nbLevels = pyramid.levels().size();
+    vector<FeatureMatrix> & projected = workspace.projectedLevels;
+    projected.resize(nbLevels);
+    int i;
+#pragma omp parallel for private(i)
+    for (i = 0; i < nbLevels; ++i)
+    {
+        const FeatureMatrix & level = pyramid.levels()[i];
+        projected[i].resize(level.rows(), level.cols(), projection.cols());
+        projected[i].asCellMatrix().noalias() = level.asCellMatrix() * projection;
+    }
+    
+    // Convolve the projected levels with the projected root filters of all components
+    vector< pair<size_t, size_t> > components;
+    for (size_t m = 0; m < cascadeMixtures.size(); ++m)
+        for (size_t c = 0; c < cascadeMixtures[m].second->size(); ++c)
+            components.push_back(make_pair(m, c));
+    
+    const int nbTasks = components.size() * nbLevels;
+#pragma omp parallel for private(i) schedule(dynamic)
+    for (i = 0; i < nbTasks; ++i)
+    {
+        const size_t m = components[i / nbLevels].first;
+        const size_t c = components[i / nbLevels].second;
+        const int l = i % nbLevels;
+        ScalarMatrix & result = (*mixtureScores[m])[c][l];
+        Patchwork::ConvolveDirect(projected[l], (*cascadeMixtures[m].second)[c], result);
+        result.array() += cascadeMixtures[m].first->models()[c].bias();
+    }
+}
+
+
+int DPMDetection::learnCascade ( const vector<JPEGImage> & images, unsigned int projectionDims )
+{
+    return this->learnCascade(images.size(), [&images](size_t index) { return images[index]; }, projectionDims);
+}
+
+
+int DPMDetection::learnCascade ( size_t numImages, const ImageLoader & loader, unsigned int projectionDims )
+{
+    this->clearCascade();
+    if (this->mixtures.empty())
+        return ARTOS_DETECT_RES_NO_MODELS;
+    if (numImages == 0)
+        return ARTOS_DETECT_RES_NO_IMAGES;
+    
+    // Determine the principal components of the cells of all filters using the same feature extractor
+    this->cascadeProjections.resize(this->featureExtractors.size());
+    for (unsigned int feIndex = 0; feIndex < this->featureExtractors.size(); feIndex++)
+    {
+        const int numFeatures = this->featureExtractors[feIndex]->numFeatures();
+        ScalarMatrix moments = ScalarMatrix::Zero(numFeatures, numFeatures);
+        for (map<std::string, Mixture *>::const_iterator m = this->mixtures.begin(); m != this->mixtures.end(); m++)
+            if (this->featureExtractorIndices.at(m->first) == feIndex)
+                for (vector<Model>::const_iterator model = m->second->models().begin(); model != m->second->models().end(); model++)
+                    for (int p = 0; p <= model->nbParts(); ++p)
+                        moments.noalias() += model->filters(p).asCellMatrix().transpose() * model->filters(p).asCellMatrix();
+        
+        // The eigenvalues are sorted in increasing order
+        Eigen::SelfAdjointEigenSolver<ScalarMatrix> eigenSolver(moments);
+        const int numComponents = min(max(static_cast<int>(projectionDims), 1), numFeatures);
+        this->cascadeProjections[feIndex] = eigenSolver.eigenvectors().rightCols(numComponents);
+    }
+    
+    // Project the root filters of all components
+    for (map<std::string, Mixture *>::const_iterator m = this->mixtures.begin(); m != this->mixtures.end(); m++)
+        if (!m->second->empty())
+        {
+            const ScalarMatrix & projection = this->cascadeProjections[this->featureExtractorIndices.at(m->first)];
+            vector<FeatureMatrix> & filters = this->cascadeFilters[m->first];
+            for (vector<Model>::const_iterator model = m->second->models().begin(); model != m->second->models().end(); model++)
+            {
+                const FeatureMatrix & root = model->filters(0);
+                filters.push_back(FeatureMatrix(root.rows(), root.cols(), projection.cols()));
+                filters.back().asCellMatrix().noalias() = root.asCellMatrix() * projection;
+            }
+            this->cascadeSamples[m->first].resize(filters.size());
+        }
+    
+    // Record the approximate scores of all locations exceeding the detection threshold on the images
+    DetectionWorkspace workspace;
+    size_t numValidImages = 0;
+    for (size_t i = 0; i < numImages; i++)
+    {
+        JPEGImage image = loader(i);
+        if (image.empty())
+            continue;
+        
+        for (unsigned int feIndex = 0; feIndex < this->featureExtractors.size(); feIndex++)
+        {
+            FeaturePyramid pyramid;
+            this->computePyramid(image, feIndex, pyramid);
+            if (pyramid.empty()
+                    || this->initPatchwork(pyramid.levels()[0].rows(), pyramid.levels()[0].cols(), pyramid.levels()[0].channels()) != ARTOS_RES_OK)
+                continue;
+            
+            this->convolveMixtures(pyramid, feIndex, workspace, false);
+            this->computeCascadeScores(pyramid, feIndex, workspace);
+            for (map< std::string, vector< vector<ScalarMatrix> > >::const_iterator cascade = workspace.cascadeScores.begin();
+                    cascade != workspace.cascadeScores.end(); cascade++)
+                if (this->featureExtractorIndices.at(cascade->first) == feIndex)
+                {
+                    const vector<ScalarMatrix> & scores = workspace.scores[cascade->first];
+                    const vector<Mixture::Indices> & argmaxes = workspace.argmaxes[cascade->first];
+                    const FeatureScalar threshold = this->thresholds.at(cascade->first);
+                    vector< vector<FeatureScalar> > & samples = this->cascadeSamples[cascade->first];
+                    for (size_t l = 0; l < scores.size(); ++l)
+                        for (int y = 0; y < scores[l].rows(); ++y)
+                            for (int x = 0; x < scores[l].cols(); ++x)
+                                if (scores[l](y, x) > threshold)
+                                {
+                                    const int c = argmaxes[l](y, x);
+                                    samples[c].push_back(cascade->second[c][l](y, x));
+                                }
+                }
+        }
+        numValidImages++;
+    }
+    
+    if (numValidImages == 0)
+    {
+        this->clearCascade();
+        return ARTOS_DETECT_RES_NO_IMAGES;
+    }
+    
+    for (map< std::string, vector< vector<FeatureScalar> > >::iterator samples = this->cascadeSamples.begin(); samples != this->cascadeSamples.end(); samples++)
+        for (vector< vector<FeatureScalar> >::iterator componentSamples = samples->second.begin(); componentSamples != samples->second.end(); componentSamples++)
+            sort(componentSamples->begin(), componentSamples->end());
+    this->updateCascadeThresholds();
+    
+    if (this->verbose)
+        for (map< std::string, vector<FeatureScalar> >::const_iterator t = this->cascadeThresholds.begin(); t != this->cascadeThresholds.end(); t++)
+        {
+            cerr << "Cascade thresholds for " << t->first << ":";
+            for (size_t c = 0; c < t->second.size(); ++c)
+                cerr << " " << t->second[c] << " (" << this->cascadeSamples[t->first][c].size() << " samples)";
+            cerr << endl;
+        }
+    
+    return ARTOS_RES_OK;
+}
+
+
+void DPMDetection::clearCascade()
+{
+    this->cascadeProjections.clear();
+    this->cascadeFilters.clear();
+    this->cascadeSamples.clear();
+    this->cascadeThresholds.clear();
+}
+
+
+void DPMDetection::setCascadeRecall(double recall)
+{
+    this->cascadeRecall = min(max(recall, 0.0), 1.0);
+    this->updateCascadeThresholds();
+}
+
+
+void DPMDetection::updateCascadeThresholds()
+{
+    for (map< std::string, vector< vector<FeatureScalar> > >::const_iterator samples = this->cascadeSamples.begin(); samples != this->cascadeSamples.end(); samples++)
+    {
+        vector<FeatureScalar> & thresholds = this->cascadeThresholds[samples->first];
+        thresholds.resize(samples->second.size());
+        for (size_t c = 0; c < samples->second.size(); ++c)
+        {
+            const vector<FeatureScalar> & componentSamples = samples->second[c];
+            if (componentSamples.empty())
+                thresholds[c] = -numeric_limits<FeatureScalar>::infinity();
+            else
+            {
+                // Retain the given fraction of the recorded locations with the highest approximate scores
+                const size_t numRejected = static_cast<size_t>((1.0 - this->cascadeRecall) * componentSamples.size());
+                thresholds[c] = componentSamples[min(numRejected, componentSamples.size() - 1)];
+            }
+        }
+    }
+}
+
+
+void DPMDetection::computePyramid(const ImageView & image, unsigned int featureExtractorIndex, FeaturePyramid & pyramid,
+                                  double minScale, double maxScale) const
+{
+    const shared_ptr<FeatureExtractor> & featureExtractor = this->featureExtractors[featureExtractorIndex];
+    unsigned int minLevelSize = min(5, this->minModelSize().min());
+    
+    // Feature extractors may be shared among several detectors, so a global lock is used
+    static mutex featureExtractionMutex;
+    unique_lock<mutex> lock(featureExtractionMutex, defer_lock);
+    if (!featureExtractor->supportsMultiThread())
+        lock.lock();
+    
+    pyramid = FeaturePyramid(image, featureExtractor, this->interval, minLevelSize,
+                             this->pyramidApproximation, this->pyramidExactLevels, minScale, maxScale);
+}
+
+
+void DPMDetection::pyramidScaleRange(unsigned int featureExtractorIndex, const DetectionOptions & options, double & minScale, double & maxScale) const
+{
+    minScale = maxScale = 0.0;
+    if (options.minObjectSize.max() <= 0 && options.maxObjectSize.max() <= 0)
+        return;
+    
+    // An object detected by a root of a given size at a given scale has the size of the root divided by the scale
+    const shared_ptr<FeatureExtractor> & featureExtractor = this->featureExtractors[featureExtractorIndex];
+    double lowest = numeric_limits<double>::infinity(), highest = 0.0;
+    bool hasParts = false;
+    for (map<std::string, Mixture *>::const_iterator m = this->mixtures.begin(); m != this->mixtures.end(); m++)
+        if (this->featureExtractorIndices.at(m->first) == featureExtractorIndex)
+            for (vector<Model>::const_iterator model = m->second->models().begin(); model != m->second->models().end(); model++)
+            {
+                const Size rootSize = featureExtractor->cellsToPixels(model->rootSize());
+                double low = 0.0, high = numeric_limits<double>::infinity();
+                if (options.maxObjectSize.width > 0)
+                    low = max(low, rootSize.width / static_cast<double>(options.maxObjectSize.width));
+                if (options.maxObjectSize.height > 0)
+                    low = max(low, rootSize.height / static_cast<double>(options.maxObjectSize.height));
+                if (options.minObjectSize.width > 0)
+                    high = min(high, rootSize.width / static_cast<double>(options.minObjectSize.width));
+                if (options.minObjectSize.height > 0)
+                    high = min(high, rootSize.height / static_cast<double>(options.minObjectSize.height));
+                if (low <= high)
+                {
+                    lowest = min(lowest, low);
+                    highest = max(highest, high);
+                    hasParts = hasParts || (model->nbParts() > 0);
+                }
+            }
+    
+    // No model can detect objects of the requested sizes at any scale
+    if (lowest > highest)
+    {
+        minScale = numeric_limits<double>::max();
+        maxScale = numeric_limits<double>::min();
+        return;
+    }
+    
+    // Allow for one additional level, since the sizes of the detections are rounded to full cells.
+    // Parts are placed one octave above the root.
+    const double tolerance = pow(2.0, 1.0 / max(this->interval, 1));
+    minScale = lowest / tolerance;
+    if (highest < numeric_limits<double>::infinity())
+        maxScale = highest * tolerance * ((hasParts) ? 2 : 1);
+}
+
+
+void DPMDetection::nonMaximumSuppression(vector<Detection> & detections, double overlap)
+{
+    // Stable sorting makes the result independent of the order of detections with equal scores
+    stable_sort(detections.begin(), detections.end());
+    if (detections.size() < 2)
+        return;
+    
+    // Determine the area covered by the detections
+    int minX = detections[0].left(), minY = detections[0].top(), maxX = detections[0].right(), maxY = detections[0].bottom();
+    for (vector<Detection>::const_iterator det = detections.begin() + 1; det != detections.end(); det++)
+    {
+        minX = min(minX, det->left());
+        minY = min(minY, det->top());
+        maxX = max(maxX, det->right());
+        maxY = max(maxY, det->bottom());
+    }
+    
+    // Kept detections are stored in a separate grid for each size class. The size class c comprises
+    // detections whose longer side is between 2^c and 2^(c+1) - 1, so that it covers at most 2 x 2
+    // cells of size 2^(c+1). Detections of class c can't cover more than 4^(c+1) pixels of another one.
+    struct Grid
+    {
+        int shift;
+        int cols;
+        vector< vector<size_t> > cells;
+    };
+    vector<Grid> grids;
+    
+    size_t numKept = 0;
+    for (size_t i = 0; i < detections.size(); i++)
+    {
+        const Detection & det = detections[i];
+        const double minCoveredArea = overlap * det.area();
+        
+        // Compare with nearby kept detections which are large enough to suppress this one
+        bool suppressed = false;
+        for (size_t c = 0; c < grids.size() && !suppressed; c++)
+        {
+            const Grid & grid = grids[c];
+            if (grid.cells.empty() || static_cast<double>(1 << grid.shift) * (1 << grid.shift) <= minCoveredArea)
+                continue;
+            const int x0 = (det.left() - minX) >> grid.shift, x1 = (det.right() - minX) >> grid.shift;
+            const int y0 = (det.top() - minY) >> grid.shift, y1 = (det.bottom() - minY) >> grid.shift;
+            for (int y = y0; y <= y1 && !suppressed; y++)
+                for (int x = x0; x <= x1 && !suppressed; x++)
+                    for (vector<size_t>::const_iterator k = grid.cells[y * grid.cols + x].begin(); k != grid.cells[y * grid.cols + x].end(); k++)
+                    {
+                        // Intersector tests the fraction of the area of its argument covered by the reference
+                        if (Intersector(detections[*k], overlap, true)(det))
+                        {
+                            suppressed = true;
+                            break;
+                        }
+                    }
+        }
+        if (suppressed)
+            continue;
+        
+        // Keep the detection and add it to the grid of its size class
+        if (numKept != i)
+            detections[numKept] = std::move(detections[i]);
+        const Detection & kept = detections[numKept];
+        int sizeClass = 0;
+        while ((2 << sizeClass) <= max(kept.width(), kept.height()))
+            sizeClass++;
+        if (grids.size() <= static_cast<size_t>(sizeClass))
+            grids.resize(sizeClass + 1);
+        Grid & grid = grids[sizeClass];
+        if (grid.cells.empty())
+        {
+            grid.shift = sizeClass + 1;
+            grid.cols = ((maxX - minX) >> grid.shift) + 1;
+            grid.cells.resize(static_cast<size_t>(grid.cols) * (((maxY - minY) >> grid.shift) + 1));
+        }
+        const int x0 = (kept.left() - minX) >> grid.shift, x1 = (kept.right() - minX) >> grid.shift;
+        const int y0 = (kept.top() - minY) >> grid.shift, y1 = (kept.bottom() - minY) >> grid.shift;
+        for (int y = y0; y <= y1; y++)
+            for (int x = x0; x <= x1; x++)
+                grid.cells[y * grid.cols + x].push_back(numKept);
+        numKept++;
+    }
+    detections.resize(numKept);
+}
+
+
+int DPMDetection::initPatchwork(unsigned int rows, unsigned int cols, unsigned int numFeatures) const
+{
+    // Initialize the Patchwork class (only if there are no plans for a sufficient size yet)
     const Size maxFilterSize = this->maxModelSize(); // the Mixture class will add padding according to the filter size
-    int w = (rows + maxFilterSize.height + 2 + 15) & ~15;
-    int h = (cols + maxFilterSize.width + 2 + 15) & ~15;
-    if ( w > Patchwork::MaxCols() || h > Patchwork::MaxRows() || numFeatures != Patchwork::NumFeatures() )
+    const int maxRows = (rows + maxFilterSize.height + 2 + 15) & ~15;
+    const int maxCols = (cols + maxFilterSize.width + 2 + 15) & ~15;
+    Patchwork::PlaneSize planeSize;
+    if (!Patchwork::FindPlaneSize(maxRows, maxCols, numFeatures, planeSize))
     {
-        w = max(w, Patchwork::MaxCols());
-        h = max(h, Patchwork::MaxRows());
         if (this->verbose) {
-            cerr << "Init values for Patchwork: " << w << " x " << h << " x " << numFeatures << endl;
+            cerr << "Init values for Patchwork: " << maxRows << " x " << maxCols << " x " << numFeatures << endl;
             start();
         }
 
-        if (!Patchwork::Init(w, h, numFeatures)) {
+        if (!Patchwork::Init(maxRows, maxCols, numFeatures)) {
             if (this->verbose)
                 cerr << "\nCould not initialize the Patchwork class" << endl;
             return ARTOS_RES_INTERNAL_ERROR;
@@ -449,14 +1289,41 @@ int DPMDetection::initPatchwork(unsigned int rows, unsigned int cols, unsigned i
         }
         
         // Cache filters
-        for ( map<std::string, Mixture *>::iterator i = this->mixtures.begin(); i != this->mixtures.end(); i++ )
-            i->second->cacheFilters();
+        planeSize = Patchwork::PlaneSize(maxRows, maxCols, numFeatures);
+        for ( map<std::string, Mixture *>::const_iterator i = this->mixtures.begin(); i != this->mixtures.end(); i++ )
+            if (i->second->featureExtractor()->numFeatures() == numFeatures)
+                i->second->transformedFilters(planeSize);
         if (this->verbose) 
             cerr << "Transformed the filters in " << stop() << " ms" << endl;
     }
     return ARTOS_RES_OK;
 }
 
+int DPMDetection::prepare ( unsigned int width, unsigned int height ) const
+{
+    if ( mixtures.size() == 0 )
+        return ARTOS_DETECT_RES_NO_MODELS;
+    
+    // Build the feature pyramids of an empty image of the given size to determine the size of their levels
+    JPEGImage image(width, height, 3);
+    if (image.empty())
+        return ARTOS_DETECT_RES_INVALID_IMAGE;
+    image.toMatrix().setZero();
+    
+    for (unsigned int feIndex = 0; feIndex < this->featureExtractors.size(); feIndex++)
+    {
+        FeaturePyramid pyramid;
+        this->computePyramid(image, feIndex, pyramid);
+        if (pyramid.empty())
+            return ARTOS_DETECT_RES_INVALID_IMAGE;
+        
+        int errcode = this->initPatchwork(pyramid.levels()[0].rows(), pyramid.levels()[0].cols(), pyramid.levels()[0].channels());
+        if (errcode != ARTOS_RES_OK)
+            return errcode;
+    }
+    return ARTOS_RES_OK;
+}
+
 int DPMDetection::addModels ( const std::string & modellistfn )
 {
     ifstream ifs ( modellistfn.c_str(), ifstream::in);
@@ -3,6 +3,8 @@
 
 #include <string>
 #include <map>
+#include <vector>
+#include <functional>
 
 #include "libartos_def.h"
 #include "Mixture.h"
@@ -43,8 +45,82 @@ struct Detection : public Rectangle
     }
 };
 
+/**
+* Restrictions of the search space of DPMDetection::detect(), which speed up detection considerably if the range
+* of object sizes or the regions of the image where objects may appear are known in advance, e.g. for a fixed camera.
+*/
+struct DetectionOptions
+{
+    Size minObjectSize; /**< Minimum size of the bounding box of detected objects in pixels. Pyramid levels where all models would be
+                             smaller are not computed at all. Dimensions set to 0 impose no limit. */
+    Size maxObjectSize; /**< Maximum size of the bounding box of detected objects in pixels. Pyramid levels where all models would be
+                             larger are not computed at all. Dimensions set to 0 impose no limit. */
+    std::vector<Rectangle> regions; /**< Regions of interest. If not empty, only objects whose centre lies inside one of these regions
+                                         will be detected. Features are computed for each region and some context around it only, which
+                                         covers objects up to `maxObjectSize` or, if not set, up to the size of the region. */
+    
+    DetectionOptions() : minObjectSize(), maxObjectSize(), regions() {};
+};
+
+/**
+* Buffers for the intermediate results of a detection, which can be passed to DPMDetection::detect()
+* to be reused by subsequent detections, e.g. on the frames of a video.
+*
+* The buffers are only reallocated if the size of the images or the set of models changes, so that
+* the patchwork planes, their frequency-domain products with the filters, the score matrices and the
+* detection candidates don't have to be allocated for every image.
+*
+* A workspace may be used with several detectors, but only by one detection at a time.
+*
+* The feature pyramids are not part of the workspace. To recycle their memory as well, install a
+* FeatureMatrixPool as default allocator using FeatureMatrixAllocator::setDefault().
+*/
+class DetectionWorkspace
+{
+
+public:
+
+    /**
+    * Releases the memory held by this workspace.
+    */
+    void clear()
+    {
+        this->patchwork = Patchwork();
+        this->products.clear();
+        this->scores.clear();
+        this->argmaxes.clear();
+        this->convolutions.clear();
+        this->candidates.clear();
+        this->candidates.shrink_to_fit();
+        this->projectedLevels.clear();
+        this->cascadeScores.clear();
+    };
+
+
+protected:
+
+    friend class DPMDetection;
+
+    Patchwork patchwork;
+    Patchwork::Products products;
+    std::map< std::string, std::vector<ScalarMatrix> > scores;
+    std::map< std::string, std::vector<Mixture::Indices> > argmaxes;
+    std::vector< std::vector<ScalarMatrix> > convolutions;
+    std::vector<Detection> candidates;
+    std::vector<FeatureMatrix> projectedLevels;
+    std::map< std::string, std::vector< std::vector<ScalarMatrix> > > cascadeScores;
+
+};
+
 /**
 * Class for fast detection of objects on images using deformable part models, based on the FFLD library.
+*
+* Once all models have been added and all parameters have been set, detect(), detectMax() and prepare()
+* may be called concurrently from multiple threads on the same instance. The models and their transformed
+* filters are shared by all threads, while any intermediate results are kept per call.
+* Modifying the detector (e.g. by adding models or changing parameters) while a detection is in progress
+* is not allowed, though.
+*
 * @author Erik Rodner
 * @author Bjoern Barz <bjoern.barz@uni-jena.de>
 */
@@ -123,13 +199,47 @@ public:
     /**
     * Detects objects in a given image which match one of the models added before using addModel() or addModels().
     *
+    * @param[in] image The image, which may be a JPEGImage or a view on pixels owned by someone else (see ImageView),
+    * e.g. a frame of a video stream. The pixels are not copied for processing them at their original scale.
+    *
+    * @param[out] detections A vector that will receive information about the detected objects.
+    *
+    * @return Returns zero on success, otherwise a negative error code.
+    */
+    int detect ( const ImageView & image, std::vector<Detection> & detections ) const;
+
+    /**
+    * Detects objects in a given image which match one of the models added before using addModel() or addModels(),
+    * reusing the buffers of a workspace for intermediate results.
+    *
     * @param[in] image The image.
     *
     * @param[out] detections A vector that will receive information about the detected objects.
     *
+    * @param[in,out] workspace Buffers for intermediate results, which should be passed to all detections
+    * in a sequence of images of the same size to avoid reallocating them.
+    *
     * @return Returns zero on success, otherwise a negative error code.
     */
-    int detect ( const JPEGImage & image, std::vector<Detection> & detections );
+    int detect ( const ImageView & image, std::vector<Detection> & detections, DetectionWorkspace & workspace ) const;
+
+    /**
+    * Detects objects in a given image which match one of the models added before using addModel() or addModels(),
+    * restricting the search to a range of object sizes and to regions of interest.
+    *
+    * @param[in] image The image.
+    *
+    * @param[out] detections A vector that will receive information about the detected objects.
+    *
+    * @param[in,out] workspace Buffers for intermediate results.
+    *
+    * @param[in] options The range of object sizes and the regions of interest. See DetectionOptions for details.
+    *
+    * @return Returns zero on success, otherwise a negative error code. Regions too small for any model to fit
+    * into do not cause an error, but don't give any detections.
+    */
+    int detect ( const ImageView & image, std::vector<Detection> & detections, DetectionWorkspace & workspace,
+                 const DetectionOptions & options ) const;
 
     /**
     * Matches the models added before using addModel() or addModels() against a given feature pyramid to detect objects.
@@ -147,7 +257,34 @@ public:
     *
     * @return Returns zero on success, otherwise a negative error code.
     */
-    int detect( int width, int height, const FeaturePyramid & pyramid, std::vector<Detection> & detections, unsigned int featureExtractorIndex = 0 );
+    int detect( int width, int height, const FeaturePyramid & pyramid, std::vector<Detection> & detections, unsigned int featureExtractorIndex = 0 ) const;
+
+    /**
+    * Matches the models added before using addModel() or addModels() against a given feature pyramid to detect objects,
+    * reusing the buffers of a workspace for intermediate results.
+    *
+    * See detect(int, int, const FeaturePyramid&, std::vector<Detection>&, unsigned int) const for a description of the
+    * other parameters.
+    *
+    * @param[in,out] workspace Buffers for intermediate results.
+    */
+    int detect( int width, int height, const FeaturePyramid & pyramid, std::vector<Detection> & detections,
+                DetectionWorkspace & workspace, unsigned int featureExtractorIndex = 0 ) const;
+
+    /**
+    * Prepares the detector for images of a given size by planning the FFTW transforms and transforming the filters of
+    * all models in advance, so that this doesn't have to be done during the first detection on such images.
+    *
+    * Plans are kept for multiple sizes, so this may be called for each image size expected by an application
+    * after all models have been added.
+    *
+    * @param[in] width The width of the images.
+    *
+    * @param[in] height The height of the images.
+    *
+    * @return Returns zero on success, otherwise a negative error code.
+    */
+    int prepare ( unsigned int width, unsigned int height ) const;
 
     /**
     * Detects only the highest scoring object in a given image which matches one of the models added before using addModel() or addModels().
@@ -158,7 +295,79 @@ public:
     *
     * @return Returns zero on success, otherwise a negative error code.
     */
-    int detectMax ( const JPEGImage & image, Detection & detection );
+    int detectMax ( const ImageView & image, Detection & detection ) const;
+
+    /**
+    * Detects only the highest scoring object in a given image which matches one of the models added before using
+    * addModel() or addModels(), reusing the buffers of a workspace for intermediate results.
+    *
+    * @param[in] image The image.
+    *
+    * @param[out] detection A detection object which will receive information about the highest scoring detection.
+    *
+    * @param[in,out] workspace Buffers for intermediate results.
+    *
+    * @return Returns zero on success, otherwise a negative error code.
+    */
+    int detectMax ( const ImageView & image, Detection & detection, DetectionWorkspace & workspace ) const;
+    
+    /**
+    * Function which provides the image with a given index in a batch, e.g. by reading it from disk.
+    * It will be called from multiple threads in parallel and should return an empty image on failure.
+    */
+    typedef std::function<JPEGImage(size_t)> ImageLoader;
+    
+    /**
+    * Detects objects in a batch of images which match one of the models added before using addModel() or addModels().
+    *
+    * Instead of parallelizing each stage of the detection for a single image, several images are processed
+    * at once by a pool of threads, so that feature extraction, convolution and non-maximum suppression of
+    * different images overlap and no cores are idle between those stages. This gives a considerably higher
+    * throughput for large amounts of images than calling detect() for each image, at the cost of holding
+    * the feature pyramids of multiple images in memory at the same time.
+    *
+    * @param[in] images The images.
+    *
+    * @param[out] detections A vector that will receive the detected objects for each image.
+    *
+    * @param[out] results Optionally, a pointer to a vector that will receive the result code of the detection
+    * on each image (zero on success, otherwise a negative error code).
+    *
+    * @param[in] numThreads The number of images to be processed in parallel. If set to 0, the number of
+    * hardware threads will be used. With a single thread, the stages of each image are parallelized instead.
+    *
+    * @return Returns the number of images on which detection failed or a negative error code if
+    * no detection could be performed at all.
+    */
+    int detectBatch ( const std::vector<JPEGImage> & images, std::vector< std::vector<Detection> > & detections,
+                      std::vector<int> * results = NULL, unsigned int numThreads = 0 ) const;
+    
+    /**
+    * Detects objects in a batch of images which match one of the models added before using addModel() or addModels().
+    *
+    * The images will be loaded by the threads processing them, so that loading overlaps with the detection
+    * on other images, and at most one image per thread is held in memory at the same time.
+    * See detectBatch(const std::vector<JPEGImage>&, std::vector< std::vector<Detection> >&, std::vector<int>*, unsigned int) const
+    * for details.
+    *
+    * @param[in] numImages The number of images in the batch.
+    *
+    * @param[in] loader Function which provides the image with a given index. Images which could not be loaded
+    * will be reported with the error code `ARTOS_DETECT_RES_INVALID_IMG_DATA`.
+    *
+    * @param[out] detections A vector that will receive the detected objects for each image.
+    *
+    * @param[out] results Optionally, a pointer to a vector that will receive the result code of the detection
+    * on each image (zero on success, otherwise a negative error code).
+    *
+    * @param[in] numThreads The number of images to be processed in parallel. If set to 0, the number of
+    * hardware threads will be used.
+    *
+    * @return Returns the number of images on which detection failed or a negative error code if
+    * no detection could be performed at all.
+    */
+    int detectBatch ( size_t numImages, const ImageLoader & loader, std::vector< std::vector<Detection> > & detections,
+                      std::vector<int> * results = NULL, unsigned int numThreads = 0 ) const;
     
     /**
     * Adds a model to the detection stack.
@@ -166,7 +375,8 @@ public:
     * @param[in] classname The name of the class ('bicycle' for example). It is used to name the objects detected in an image.
     * If there already is a model with the same class name, it will be replaced with this new one.
     *
-    * @param[in] modelfile The filename of the model to load.
+    * @param[in] modelfile The filename of the model to load. It may be in text or binary format (see Mixture::readFromFile()).
+    * Binary model files are mapped into memory and used in place, which makes loading large numbers of models much faster.
     *
     * @param[in] threshold The detection threshold for this model.
     *
@@ -317,14 +527,131 @@ public:
     * feature pyramid would have to be built for every feature extractor, which will slow down detection significantly.
     */
     int differentFeatureExtractors() const { return this->featureExtractors.size(); };
+    
+    /**
+    * Enables or disables the approximation of feature pyramid levels from a few exactly computed levels per octave,
+    * which speeds up the construction of feature pyramids at the cost of slightly less accurate features.
+    *
+    * @param[in] approximation The approximation method to be used. FeaturePyramid::Approximation::NONE disables approximation.
+    *
+    * @param[in] exactLevels The number of levels per octave whose features are computed exactly (between 1 and the
+    * number of levels per octave). The first level of each octave is always one of them.
+    */
+    void setPyramidApproximation(FeaturePyramid::Approximation approximation, int exactLevels = 1);
+    
+    /**
+    * @return The approximation method used for constructing feature pyramids.
+    */
+    FeaturePyramid::Approximation getPyramidApproximation() const { return this->pyramidApproximation; };
+    
+    /**
+    * @return The number of levels per octave whose features are computed exactly if approximation is enabled.
+    */
+    int getPyramidExactLevels() const { return this->pyramidExactLevels; };
+    
+    /**
+    * Enables or disables non-maximum suppression across classes. If enabled, detections of different classes
+    * overlapping each other are suppressed in favour of the highest scoring one, in addition to the non-maximum
+    * suppression applied to the detections of each class separately.
+    *
+    * @param[in] crossClassNMS True if non-maximum suppression should be applied across classes.
+    */
+    void setCrossClassNMS(bool crossClassNMS) { this->crossClassNMS = crossClassNMS; };
+    
+    /**
+    * @return True if non-maximum suppression is applied across classes.
+    */
+    bool getCrossClassNMS() const { return this->crossClassNMS; };
+    
+    /**
+    * Learns a cascade which rejects most locations early, so that the full scores of the models only have to be
+    * computed for a few pyramid levels or not at all. This speeds up detection considerably if there are many models,
+    * most of which don't match most images.
+    *
+    * The features and the root filters of all models are projected onto a few principal components of the cells
+    * of their filters, which gives an approximation of the root scores at a fraction of the cost of the full scores.
+    * For each component of each model, the approximate scores at all locations where the full score exceeds the
+    * detection threshold on the given images are recorded. Subsequent detections reject all locations whose
+    * approximate score is below the threshold which retains a given fraction of those (see setCascadeRecall()).
+    * Models whose locations are rejected entirely are not convolved at all and the distance transforms of the
+    * parts of the others are skipped for rejected pyramid levels.
+    *
+    * Components which don't exceed the detection threshold on any of the images are never pruned. Models which
+    * are added or replaced after learning the cascade are not pruned until it is learned again.
+    *
+    * @param[in] images The images to learn the cascade from, e.g. the images the models have been trained or evaluated on.
+    *
+    * @param[in] projectionDims The number of principal components the features are projected onto.
+    *
+    * @return Returns zero on success, otherwise a negative error code.
+    */
+    int learnCascade ( const std::vector<JPEGImage> & images, unsigned int projectionDims = 6 );
+    
+    /**
+    * Learns a cascade which rejects most locations early. See
+    * learnCascade(const std::vector<JPEGImage>&, unsigned int) for details.
+    *
+    * @param[in] numImages The number of images to learn the cascade from.
+    *
+    * @param[in] loader Function which provides the image with a given index. Images which could not be loaded
+    * are skipped. Unlike with detectBatch(), the function is only called from a single thread.
+    *
+    * @param[in] projectionDims The number of principal components the features are projected onto.
+    *
+    * @return Returns zero on success, otherwise a negative error code.
+    */
+    int learnCascade ( size_t numImages, const ImageLoader & loader, unsigned int projectionDims = 6 );
+    
+    /**
+    * Removes the cascade learned by learnCascade(), so that the full scores are computed at all locations again.
+    */
+    void clearCascade();
+    
+    /**
+    * @return True if a cascade has been learned using learnCascade().
+    */
+    bool hasCascade() const { return !this->cascadeThresholds.empty(); };
+    
+    /**
+    * Changes the trade-off between speed and recall of the cascade learned by learnCascade().
+    *
+    * @param[in] recall The fraction of the locations exceeding the detection threshold on the images the cascade
+    * has been learned from which are not rejected by the cascade. Lower values reject more locations, which makes
+    * detection faster, but will miss more objects. Defaults to 0.99.
+    */
+    void setCascadeRecall(double recall);
+    
+    /**
+    * @return The fraction of the detections on the images the cascade has been learned from which is retained by the cascade.
+    */
+    double getCascadeRecall() const { return this->cascadeRecall; };
+    
+    /**
+    * Sorts a list of detections in descending order by their score and removes every detection which
+    * overlaps with a higher scoring one by at least a given fraction of its area.
+    *
+    * Detections which have been kept are indexed by a spatial grid for each order of magnitude of their
+    * size, so that each detection has only to be compared with the few kept ones in its neighbourhood
+    * which are large enough to cover it. Thus, the cost is nearly linear in the number of detections.
+    *
+    * @param[in,out] detections The detections.
+    *
+    * @param[in] overlap Minimum fraction of the area of a detection which has to be covered by a
+    * higher scoring one for the detection to be suppressed.
+    */
+    static void nonMaximumSuppression(std::vector<Detection> & detections, double overlap);
 
 
 protected:
 
     double overlap;
     int interval;
+    FeaturePyramid::Approximation pyramidApproximation;
+    int pyramidExactLevels;
+    bool crossClassNMS;
     bool verbose;
     unsigned int nextModelIndex;
+    double cascadeRecall;
 
     std::map<std::string, Mixture*> mixtures;
     std::map<std::string, double> thresholds;
@@ -334,9 +661,134 @@ protected:
     
     std::vector< std::shared_ptr<FeatureExtractor> > featureExtractors;
     
-    int initPatchwork(unsigned int rows, unsigned int cols, unsigned int numFeatures);
+    std::vector<ScalarMatrix> cascadeProjections; /**< Principal components of the filter cells for each feature extractor (one per column). */
+    std::map< std::string, std::vector<FeatureMatrix> > cascadeFilters; /**< Projected root filters of each component of each model. */
+    std::map< std::string, std::vector< std::vector<FeatureScalar> > > cascadeSamples; /**< Sorted approximate scores of the detections of each component on the training images. */
+    std::map< std::string, std::vector<FeatureScalar> > cascadeThresholds; /**< Thresholds for the approximate scores of each component. */
+    
+    int initPatchwork(unsigned int rows, unsigned int cols, unsigned int numFeatures) const;
+    
+    /**
+    * Computes the feature pyramid of an image using one of the feature extractors of this detector.
+    *
+    * If the feature extractor does not support being called from multiple threads in parallel,
+    * concurrent calls of this function (even on different detectors) will be serialized.
+    *
+    * @param[in] image The image.
+    *
+    * @param[in] featureExtractorIndex The index of the feature extractor in `featureExtractors`.
+    *
+    * @param[out] pyramid Receives the feature pyramid, which will be empty if the image is invalid.
+    *
+    * @param[in] minScale Levels with a scale below this will be omitted. Non-positive values impose no limit.
+    *
+    * @param[in] maxScale Levels with a scale above this will be omitted. Non-positive values impose no limit.
+    */
+    void computePyramid(const ImageView & image, unsigned int featureExtractorIndex, FeaturePyramid & pyramid,
+                        double minScale = 0.0, double maxScale = 0.0) const;
+    
+    /**
+    * Determines the range of pyramid scales where the models using a given feature extractor may
+    * detect objects of the sizes allowed by given detection options.
+    *
+    * @param[in] featureExtractorIndex The index of the feature extractor in `featureExtractors`.
+    *
+    * @param[in] options The detection options.
+    *
+    * @param[out] minScale Receives the minimum scale or 0 if there is no limit.
+    *
+    * @param[out] maxScale Receives the maximum scale or 0 if there is no limit. The scales one octave above the
+    * largest scale of the roots are included for part-based models.
+    */
+    void pyramidScaleRange(unsigned int featureExtractorIndex, const DetectionOptions & options, double & minScale, double & maxScale) const;
+    
+    /**
+    * Detects objects in an image, restricted to a range of object sizes, but not to regions of interest.
+    * See detect(const ImageView&, std::vector<Detection>&, DetectionWorkspace&, const DetectionOptions&) const.
+    */
+    int detectImage ( const ImageView & image, std::vector<Detection> & detections, DetectionWorkspace & workspace,
+                      const DetectionOptions & options ) const;
+    
+    /**
+    * Matches the models using a given feature extractor against a feature pyramid, discarding detections
+    * outside of the range of object sizes given by detection options.
+    * See detect(int, int, const FeaturePyramid&, std::vector<Detection>&, unsigned int) const.
+    */
+    int detectPyramid ( int width, int height, const FeaturePyramid & pyramid, std::vector<Detection> & detections,
+                        DetectionWorkspace & workspace, unsigned int featureExtractorIndex, const DetectionOptions & options ) const;
+    
+    /**
+    * Applies non-maximum suppression across classes to the detections produced by a single call to one of the
+    * detect() functions, if enabled by setCrossClassNMS(). Detections passed in by the caller are not affected.
+    *
+    * @param[in,out] detections The list of detections.
+    *
+    * @param[in] first Index of the first detection in @p detections produced by the call.
+    */
+    void suppressAcrossClasses ( std::vector<Detection> & detections, std::size_t first ) const;
+
+    /**
+    * Computes the scores of all mixtures using a given feature extractor on a feature pyramid.
+    *
+    * The pyramid is packed into a single Patchwork with padding sufficient for the largest of those mixtures,
+    * so that it has to be transformed only once. The transformed pyramid is then convolved with the filters
+    * of several mixtures at once.
+    *
+    * @param[in] pyramid The feature pyramid.
+    *
+    * @param[in] featureExtractorIndex The index of the feature extractor in `featureExtractors`.
+    *
+    * @param[in,out] workspace The scores of each mixture for each pyramid level and the indices of the best
+    * component of each mixture for each pyramid level will be stored in the `scores` and `argmaxes` members
+    * of this workspace, indexed by class name. Entries for mixtures using other feature extractors are kept.
+    *
+    * @param[in] useCascade If set to true and a cascade has been learned, locations rejected by the cascade
+    * will have a score of negative infinity and mixtures whose locations have all been rejected will have no scores.
+    */
+    void convolveMixtures(const FeaturePyramid & pyramid, unsigned int featureExtractorIndex,
+                          DetectionWorkspace & workspace, bool useCascade = true) const;
+    
+    /**
+    * Computes the approximate scores of the root filters of all mixtures using a given feature extractor
+    * which are part of the cascade on a feature pyramid.
+    *
+    * @param[in] pyramid The feature pyramid.
+    *
+    * @param[in] featureExtractorIndex The index of the feature extractor in `featureExtractors`.
+    *
+    * @param[in,out] workspace The approximate scores of each component of each mixture for each pyramid level will be
+    * stored in the `cascadeScores` member of this workspace, indexed by class name. Entries for mixtures which are not
+    * part of the cascade are removed.
+    */
+    void computeCascadeScores(const FeaturePyramid & pyramid, unsigned int featureExtractorIndex,
+                              DetectionWorkspace & workspace) const;
+    
+    /**
+    * Derives the thresholds of the cascade from the recorded approximate scores according to `cascadeRecall`.
+    */
+    void updateCascadeThresholds();
 
     int addModelPointer ( const std::string & classname, Mixture * model, double threshold, const std::string & synsetId = "" );
+    
+    /**
+    * Runs the detector on a batch of images using a pool of threads, each processing one image at a time.
+    *
+    * @param[in] numImages The number of images in the batch.
+    *
+    * @param[in] getImage Function which provides the image with a given index. It may either return
+    * a reference to an existing image or load the image into the buffer given as second argument
+    * and return a reference to that buffer.
+    *
+    * @param[out] detections A vector that will receive the detected objects for each image.
+    *
+    * @param[out] results Optionally, a pointer to a vector that will receive the result code for each image.
+    *
+    * @param[in] numThreads The number of threads. If set to 0, the number of hardware threads will be used.
+    *
+    * @return Returns the number of images on which detection failed or a negative error code.
+    */
+    int runBatch ( size_t numImages, const std::function<const JPEGImage & (size_t, JPEGImage &)> & getImage,
+                   std::vector< std::vector<Detection> > & detections, std::vector<int> * results, unsigned int numThreads ) const;
 
 
 private:
@@ -62,6 +62,33 @@ Size FeatureExtractor::pixelCoordsToCells(const Size & pixels) const
 }
 
 
+void FeatureExtractor::extract(const ImageView & img, FeatureMatrix & feat) const
+{
+    if (img.image())
+        this->extract(*img.image(), feat);
+    else
+        this->extract(JPEGImage(img), feat);
+}
+
+
+void FeatureExtractor::extract(const ImageView & img, FeatureMatrix & feat, const Size & cellSize) const
+{
+    if (img.image())
+        this->extract(*img.image(), feat, cellSize);
+    else
+        this->extract(JPEGImage(img), feat, cellSize);
+}
+
+
+void FeatureExtractor::computeChannels(const ImageView & img, FeatureMatrix & channels, const Size & cellSize) const
+{
+    if (img.image())
+        this->computeChannels(*img.image(), channels, cellSize);
+    else
+        this->computeChannels(JPEGImage(img), channels, cellSize);
+}
+
+
 int32_t FeatureExtractor::getIntParam(const string & paramName) const
 {
     auto it = this->m_intParams.find(paramName);
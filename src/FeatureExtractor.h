@@ -130,6 +130,13 @@ public:
     */
     virtual bool supportsMultiThread() const { return true; };
     
+    /**
+    * @return Returns true if this feature extractor implements computeChannels() and channelsToFeatures(),
+    * so that the features of some scales of an image can be approximated by resampling the channels
+    * computed for another scale (see FeaturePyramid::Approximation).
+    */
+    virtual bool supportsChannelApproximation() const { return false; };
+    
     /**
     * Specifies if it is considered reasonable to process feature extraction of multiple
     * scales of an image by patchworking them together, so that multiple scales are processed at
@@ -229,6 +236,37 @@ public:
     virtual void extract(const JPEGImage & img, FeatureMatrix & feat, const Size & cellSize) const
     { throw NotSupportedException("This feature extractor does not support variable cell sizes."); };
     
+    /**
+    * Computes features for an image given by a view on pixels owned by someone else.
+    *
+    * The default implementation passes the JPEGImage the view refers to or, if there is none, a copy
+    * of the pixels to extract(const JPEGImage&, FeatureMatrix&) const. Feature extractors which can
+    * process the pixels in place should override this method to avoid that copy.
+    *
+    * @param[in] img The image to compute features for.
+    *
+    * @param[out] feat Destination matrix to store the extracted features in.
+    * It will be resized to fit the number of cells in the given image.
+    */
+    virtual void extract(const ImageView & img, FeatureMatrix & feat) const;
+    
+    /**
+    * Computes features for an image given by a view on pixels owned by someone else using a non-default cell size.
+    *
+    * The default implementation passes the JPEGImage the view refers to or, if there is none, a copy
+    * of the pixels to extract(const JPEGImage&, FeatureMatrix&, const Size&) const.
+    *
+    * @param[in] img The image to compute features for.
+    *
+    * @param[out] feat Destination matrix to store the extracted features in.
+    * It will be resized to fit the number of cells in the given image.
+    *
+    * @param[in] cellSize The size of the feature cells.
+    *
+    * @throws NotSupportedException This feature extractor does not support variable cell sizes.
+    */
+    virtual void extract(const ImageView & img, FeatureMatrix & feat, const Size & cellSize) const;
+    
     /**
     * Transforms a feature matrix into a feature representation of the horizontally flipped image.
     *
@@ -246,6 +284,67 @@ public:
     */
     virtual void flip(const FeatureMatrix & feat, FeatureMatrix & flipped) const
     { throw NotSupportedException("This feature extractor does not support flipping of feature matrices."); };
+    
+    /**
+    * Computes intermediate channels of an image, which the actual features can be derived from
+    * using channelsToFeatures().
+    *
+    * In contrast to the final features, those channels may be resampled in order to approximate
+    * the channels of a scaled version of the image, following "Fast Feature Pyramids for Object Detection"
+    * by Dollar et al. (PAMI 2014). Thus, they must be organized in cells of the given size and must not
+    * be normalized in any way.
+    * The channel matrix may have a border of cells which are not part of the final features, but that
+    * border must be of the same size along each side and must not depend on the size of the image.
+    *
+    * @param[in] img The image to compute channels for.
+    *
+    * @param[out] channels Destination matrix to store the channels in.
+    *
+    * @param[in] cellSize The size of the cells. If any dimension is 0, the default cell size will be used.
+    *
+    * @throws NotSupportedException This feature extractor does not support channel approximation.
+    */
+    virtual void computeChannels(const JPEGImage & img, FeatureMatrix & channels, const Size & cellSize) const
+    { throw NotSupportedException("This feature extractor does not support channel approximation."); };
+    
+    /**
+    * Computes intermediate channels of an image given by a view on pixels owned by someone else.
+    *
+    * The default implementation passes the JPEGImage the view refers to or, if there is none, a copy
+    * of the pixels to computeChannels(const JPEGImage&, FeatureMatrix&, const Size&) const.
+    *
+    * @param[in] img The image to compute channels for.
+    *
+    * @param[out] channels Destination matrix to store the channels in.
+    *
+    * @param[in] cellSize The size of the cells. If any dimension is 0, the default cell size will be used.
+    *
+    * @throws NotSupportedException This feature extractor does not support channel approximation.
+    */
+    virtual void computeChannels(const ImageView & img, FeatureMatrix & channels, const Size & cellSize) const;
+    
+    /**
+    * Derives features from channels computed by computeChannels() or resampled from such.
+    *
+    * `extract(img, feat, cellSize)` is equivalent to `computeChannels(img, channels, cellSize)` followed by
+    * `channelsToFeatures(channels, feat)`.
+    *
+    * @param[in] channels The channels to compute the features from.
+    *
+    * @param[out] feat Destination matrix to store the features in.
+    *
+    * @throws NotSupportedException This feature extractor does not support channel approximation.
+    */
+    virtual void channelsToFeatures(const FeatureMatrix & channels, FeatureMatrix & feat) const
+    { throw NotSupportedException("This feature extractor does not support channel approximation."); };
+    
+    /**
+    * Channels of an image downscaled by a factor `s` can be approximated by resampling the channels of the
+    * original image and multiplying them with `s^(-lambda)`. This function provides that exponent `lambda`.
+    *
+    * @return Returns the exponent of the power law relating channels across scales.
+    */
+    virtual FeatureScalar channelScalingExponent() const { return 0; };
 
     /**
     * Retrieves the value of an integer parameter specific to the concrete feature extraction method.
@@ -4,7 +4,11 @@
 #include <cstddef>
 #include <cstring>
 #include <cassert>
+#include <memory>
+#include <type_traits>
+#include <new>
 #include <Eigen/Core>
+#include "FeatureMatrixAllocator.h"
 
 namespace ARTOS
 {
@@ -27,6 +31,11 @@ typedef float FeatureScalar; /**< Default scalar type used throughout ARTOS. */
 *    representation of an image.
 * 3. We need a convenient interface for casting cells and channels to Eigen matrices
 *    for algebraic and fast vectorized operations.
+*
+* Storage allocated by a feature matrix is obtained from the default FeatureMatrixAllocator
+* and is aligned to FeatureMatrixAllocator::Alignment bytes. Its size is rounded up to a multiple
+* of the alignment as well, so that vectorized kernels may read full vectors beyond the last element
+* without leaving the allocated memory (the values of those padding elements are undefined, though).
 */
 template<typename Scalar>
 class FeatureMatrix_
@@ -46,7 +55,7 @@ public:
     /**
     * Constructs an empty feature matrix with 0 elements.
     */
-    FeatureMatrix_() : m_rows(0), m_cols(0), m_channels(0), m_size(0), m_numEl(0), m_data_p(NULL), m_data(NULL, 0, 0), m_allocated(false) {};
+    FeatureMatrix_() : m_rows(0), m_cols(0), m_channels(0), m_size(0), m_numEl(0), m_data_p(NULL), m_data(NULL, 0, 0) {};
     
     /**
     * Constructs a feature matrix with specific dimensions.
@@ -59,8 +68,9 @@ public:
     */
     FeatureMatrix_(Index rows, Index cols, Index channels)
     : m_rows(rows), m_cols(cols), m_channels(channels), m_size(rows * cols * channels), m_numEl(m_size),
-      m_data_p((m_size > 0) ? new Scalar[m_size] : NULL),
-      m_data(m_data_p, rows, cols * channels), m_allocated(m_size > 0)
+      m_allocator((m_size > 0) ? FeatureMatrixAllocator::getDefault() : std::shared_ptr<FeatureMatrixAllocator>()),
+      m_data_p(allocateStorage(m_allocator.get(), m_size)),
+      m_data(m_data_p, rows, cols * channels)
     {};
     
     /**
@@ -109,7 +119,7 @@ public:
     */
     FeatureMatrix_(Scalar * data, Index rows, Index cols, Index channels)
     : m_rows(rows), m_cols(cols), m_channels(channels), m_size(rows * cols * channels), m_numEl(m_size),
-      m_data_p(data), m_data(data, rows, cols * channels), m_allocated(false)
+      m_data_p(data), m_data(data, rows, cols * channels)
     {};
     
     /**
@@ -132,11 +142,11 @@ public:
     */
     FeatureMatrix_(FeatureMatrix_ && other)
     : m_rows(other.m_rows), m_cols(other.m_cols), m_channels(other.m_channels), m_size(other.m_size), m_numEl(other.m_numEl),
-      m_data_p(other.m_data_p), m_data(m_data_p, m_rows, m_cols * m_channels), m_allocated(other.m_allocated)
+      m_allocator(std::move(other.m_allocator)), m_data_p(other.m_data_p), m_data(m_data_p, m_rows, m_cols * m_channels)
     {
-        other.m_rows = other.m_cols = other.m_channels = other.m_size = 0;
+        other.m_rows = other.m_cols = other.m_channels = other.m_size = other.m_numEl = 0;
         other.m_data_p = NULL;
-        other.m_allocated = false;
+        other.m_allocator.reset();
     };
     
     /**
@@ -150,22 +160,17 @@ public:
     : FeatureMatrix_(other.rows(), other.cols(), other.channels())
     {
         if (!other.empty() && this->m_data_p != NULL)
-        {
-            Scalar * myData = this->m_data_p, * myDataEnd = myData + this->m_size;
-            const OtherScalar * otherData = other.raw();
-            for (; myData != myDataEnd; myData++, otherData++)
-                *myData = static_cast<Scalar>(*otherData);
-        }
+            this->asVector() = other.asVector().template cast<Scalar>();
     };
     
-    virtual ~FeatureMatrix_() { if (this->m_allocated) delete[] this->m_data_p; };
+    ~FeatureMatrix_() { this->releaseStorage(); };
     
     /**
     * Copies the contents of another feature matrix to this one.
     *
     * @param[in] other The feature matrix to be copied.
     */
-    virtual FeatureMatrix_ & operator=(const FeatureMatrix_ & other)
+    FeatureMatrix_ & operator=(const FeatureMatrix_ & other)
     {
         if (this == &other)
             return *this;
@@ -181,13 +186,12 @@ public:
     *
     * @param[in] other The feature matrix whose data is to be moved.
     */
-    virtual FeatureMatrix_ & operator=(FeatureMatrix_ && other)
+    FeatureMatrix_ & operator=(FeatureMatrix_ && other)
     {
         if (this == &other)
             return *this;
         
-        if (this->m_allocated)
-            delete[] this->m_data_p;
+        this->releaseStorage();
         
         this->m_rows = other.m_rows;
         this->m_cols = other.m_cols;
@@ -195,12 +199,12 @@ public:
         this->m_size = other.m_size;
         this->m_numEl = other.m_numEl;
         this->m_data_p = other.m_data_p;
-        this->m_allocated = other.m_allocated;
+        this->m_allocator = std::move(other.m_allocator);
         new (&(this->m_data)) Eigen::Map<ScalarMatrix>(this->m_data_p, this->m_rows, this->m_cols * this->m_channels);
         
-        other.m_rows = other.m_cols = other.m_channels = other.m_size = 0;
+        other.m_rows = other.m_cols = other.m_channels = other.m_size = other.m_numEl = 0;
         other.m_data_p = NULL;
-        other.m_allocated = false;
+        other.m_allocator.reset();
         
         return *this;
     };
@@ -216,12 +220,7 @@ public:
     {
         this->resize(other.rows(), other.cols(), other.channels());
         if (!other.empty() && this->m_data_p != NULL)
-        {
-            Scalar * myData = this->m_data_p, * myDataEnd = myData + this->numEl();
-            const OtherScalar * otherData = other.raw();
-            for (; myData != myDataEnd; myData++, otherData++)
-                *myData = static_cast<Scalar>(*otherData);
-        }
+            this->asVector() = other.asVector().template cast<Scalar>();
         return *this;
     };
     
@@ -272,10 +271,9 @@ public:
         Index numEl = rows * cols * channels;
         if (numEl > this->m_size)
         {
-            if (this->m_allocated)
-                delete[] this->m_data_p;
-            this->m_data_p = new Scalar[numEl];
-            this->m_allocated = true;
+            this->releaseStorage();
+            this->m_allocator = FeatureMatrixAllocator::getDefault();
+            this->m_data_p = allocateStorage(this->m_allocator.get(), numEl);
             this->m_size = numEl;
         }
         this->m_rows = rows;
@@ -296,12 +294,13 @@ public:
     {
         if (this->m_size > this->numEl())
         {
-            Scalar * newData = new Scalar[this->numEl()];
-            std::memcpy(reinterpret_cast<void*>(newData), reinterpret_cast<const void*>(this->m_data_p), sizeof(Scalar) * this->numEl());
-            if (this->m_allocated)
-                delete[] this->m_data_p;
+            std::shared_ptr<FeatureMatrixAllocator> allocator = (this->numEl() > 0) ? FeatureMatrixAllocator::getDefault() : std::shared_ptr<FeatureMatrixAllocator>();
+            Scalar * newData = allocateStorage(allocator.get(), this->numEl());
+            if (newData != NULL)
+                std::memcpy(reinterpret_cast<void*>(newData), reinterpret_cast<const void*>(this->m_data_p), sizeof(Scalar) * this->numEl());
+            this->releaseStorage();
             this->m_data_p = newData;
-            this->m_allocated = true;
+            this->m_allocator = std::move(allocator);
             this->m_size = this->numEl();
             new (&(this->m_data)) Eigen::Map<ScalarMatrix>(this->m_data_p, this->m_rows, this->m_cols * this->m_channels);
         }
@@ -653,6 +652,56 @@ public:
 
 protected:
     
+    /**
+    * Computes the number of bytes allocated for a given number of elements.
+    *
+    * @param[in] numEl The number of elements.
+    *
+    * @return Returns `numEl * sizeof(Scalar)` rounded up to the next multiple of FeatureMatrixAllocator::Alignment.
+    */
+    static std::size_t storageSize(Index numEl)
+    {
+        return (numEl * sizeof(Scalar) + FeatureMatrixAllocator::Alignment - 1) & ~(FeatureMatrixAllocator::Alignment - 1);
+    };
+    
+    /**
+    * Allocates storage for a given number of elements.
+    *
+    * Elements of arithmetic types are left uninitialized, while elements of other types (e.g. `std::complex`)
+    * are value-initialized.
+    *
+    * @param[in] allocator The allocator to obtain the memory from. May be NULL if `numEl` is 0.
+    *
+    * @param[in] numEl The number of elements.
+    *
+    * @return Returns a pointer to the new storage or NULL if `numEl` is 0.
+    */
+    static Scalar * allocateStorage(FeatureMatrixAllocator * allocator, Index numEl)
+    {
+        if (numEl == 0)
+            return NULL;
+        Scalar * data = reinterpret_cast<Scalar*>(allocator->allocate(storageSize(numEl)));
+        if (!std::is_arithmetic<Scalar>::value)
+            for (Index i = 0; i < numEl; i++)
+                new (data + i) Scalar();
+        return data;
+    };
+    
+    /**
+    * Returns the storage allocated by this feature matrix to its allocator. External data is left untouched.
+    */
+    void releaseStorage()
+    {
+        if (this->m_allocator)
+        {
+            if (!std::is_arithmetic<Scalar>::value)
+                for (Index i = 0; i < this->m_size; i++)
+                    this->m_data_p[i].~Scalar();
+            this->m_allocator->deallocate(reinterpret_cast<void*>(this->m_data_p), storageSize(this->m_size));
+            this->m_allocator.reset();
+        }
+    };
+    
     Index m_rows; /**< Number of rows of this feature matrix. */
     Index m_cols; /**< Number of columns of this feature matrix. */
     Index m_channels; /**< Number of rows of this feature matrix. */
@@ -660,16 +709,287 @@ protected:
     Index m_size; /**< Size of the allocated array. */
     Index m_numEl; /**< Cached value of m_rows * m_cols * m_channels. */
     
+    std::shared_ptr<FeatureMatrixAllocator> m_allocator; /**< Allocator of the data storage or NULL if the data is external or there is none. */
+    
     Scalar * m_data_p; /**< Pointer to the raw data. */
     
     Eigen::Map<ScalarMatrix> m_data; /**< Eigen wrapper around the data. */
+
+};
+
+
+/**
+* @brief Container for 3-dimensional data stored channel by channel
+*
+* In contrast to FeatureMatrix_, this class stores the channels of the matrix as contiguous
+* planes, one after another, i.e. the memory storage order is like follows:
+*
+*     (0,0,0), (0,1,0), ..., (1,0,0), (1,1,0), ..., (0,0,1), (0,1,1), ...
+*
+* This layout is beneficial for operations processing each channel independently, e.g. Fourier
+* transforms of the single channels, since channel() returns a contiguous matrix instead of a
+* strided view. The storage is obtained from the default FeatureMatrixAllocator, like for FeatureMatrix_.
+*
+* Conversion from and to the interleaved layout of FeatureMatrix_ requires a transposition of the
+* data, except for matrices with a single channel or a single cell, where both layouts coincide.
+* In that case, the storage of a temporary FeatureMatrix_ is adopted without copying.
+*/
+template<typename Scalar>
+class PlanarFeatureMatrix_
+{
+
+public:
+
+    typedef typename FeatureMatrix_<Scalar>::Index Index; /**< Index types for the dimensions of the matrix. */
+    
+    typedef typename FeatureMatrix_<Scalar>::ScalarMatrix ScalarMatrix; /**< A matrix of scalar values. */
+    
+    typedef Eigen::Map<ScalarMatrix> ChannelMap;
+    typedef Eigen::Map<const ScalarMatrix> ConstChannelMap;
+
+    /**
+    * Constructs an empty planar feature matrix with 0 elements.
+    */
+    PlanarFeatureMatrix_() : m_rows(0), m_cols(0), m_channels(0) {};
+    
+    /**
+    * Constructs a planar feature matrix with specific dimensions.
+    *
+    * @param[in] rows The number of rows of the matrix.
+    *
+    * @param[in] cols The number of columns of the matrix.
+    *
+    * @param[in] channels The number of channels (usually features) of the matrix.
+    */
+    PlanarFeatureMatrix_(Index rows, Index cols, Index channels)
+    : m_rows(rows), m_cols(cols), m_channels(channels), m_planes(channels * rows, cols, 1) {};
+    
+    /**
+    * Constructs a planar feature matrix with the contents of an interleaved one.
+    *
+    * @param[in] other The feature matrix to be converted.
+    */
+    explicit PlanarFeatureMatrix_(const FeatureMatrix_<Scalar> & other) : PlanarFeatureMatrix_() { this->assign(other); };
+    
+    /**
+    * Constructs a planar feature matrix with the contents of an interleaved one, which is left empty.
+    * If both layouts coincide, the storage of `other` is adopted without copying.
+    *
+    * @param[in] other The feature matrix to be converted.
+    */
+    explicit PlanarFeatureMatrix_(FeatureMatrix_<Scalar> && other) : PlanarFeatureMatrix_() { this->assign(std::move(other)); };
+    
+    /**
+    * @return Returns true if this feature matrix has no elements.
+    */
+    bool empty() const { return this->m_planes.empty(); };
+    
+    /**
+    * @return Returns the number of rows of this feature matrix.
+    */
+    Index rows() const { return this->m_rows; };
+    
+    /**
+    * @return Returns the number of columns of this feature matrix.
+    */
+    Index cols() const { return this->m_cols; };
+    
+    /**
+    * @return Returns the number of channels (usually features) of this feature matrix.
+    */
+    Index channels() const { return this->m_channels; };
+    
+    /**
+    * @return Returns the number of elements in this feature matrix, i.e. rows * cols * channels.
+    */
+    Index numEl() const { return this->m_planes.numEl(); };
+    
+    /**
+    * @return Returns the number of cells in this feature matrix, i.e. rows * cols.
+    */
+    Index numCells() const { return this->m_rows * this->m_cols; };
+    
+    /**
+    * Changes the size of this feature matrix.
+    *
+    * New memory will only be allocated if rows * cols * channels is greater than before.
+    * In that case, existing data will be lost.
+    *
+    * @param[in] rows The new number of rows.
+    *
+    * @param[in] cols The new number of columns.
+    *
+    * @param[in] channels The new number of channels.
+    */
+    void resize(Index rows, Index cols, Index channels)
+    {
+        this->m_rows = rows;
+        this->m_cols = cols;
+        this->m_channels = channels;
+        this->m_planes.resize(channels * rows, cols, 1);
+    };
+    
+    /**
+    * Replaces the contents of this matrix with a range of channels of an interleaved feature matrix.
+    *
+    * @param[in] other The feature matrix to be converted.
+    *
+    * @param[in] firstChannel The index of the first channel of `other` to be copied.
+    *
+    * @param[in] numChannels The number of channels to be copied. If this is 0, all channels
+    * from `firstChannel` on will be copied.
+    */
+    void assign(const FeatureMatrix_<Scalar> & other, Index firstChannel = 0, Index numChannels = 0)
+    {
+        assert(firstChannel + numChannels <= other.channels());
+        if (numChannels == 0)
+            numChannels = other.channels() - firstChannel;
+        this->resize(other.rows(), other.cols(), numChannels);
+        if (!other.empty())
+        {
+            if (firstChannel == 0 && numChannels == other.channels())
+                Eigen::Map<ScalarMatrix>(this->m_planes.raw(), numChannels, this->numCells()) = other.asCellMatrix().transpose();
+            else
+                this->setBlock(0, 0, other, firstChannel);
+        }
+    };
+    
+    /**
+    * Replaces the contents of this matrix with those of an interleaved feature matrix, which is left empty.
+    * If both layouts coincide, the storage of `other` is adopted without copying.
+    *
+    * @param[in] other The feature matrix to be converted.
+    */
+    void assign(FeatureMatrix_<Scalar> && other)
+    {
+        if (other.channels() <= 1 || other.numCells() <= 1)
+        {
+            const Index rows = other.rows(), cols = other.cols(), channels = other.channels();
+            this->m_planes = std::move(other);
+            this->resize(rows, cols, channels);
+        }
+        else
+        {
+            this->assign(static_cast<const FeatureMatrix_<Scalar> &>(other));
+            other = FeatureMatrix_<Scalar>();
+        }
+    };
+    
+    /**
+    * Copies an interleaved feature matrix into a block of this matrix, starting at a given cell.
+    *
+    * @param[in] firstRow The row of this matrix corresponding to the first row of `other`.
+    *
+    * @param[in] firstCol The column of this matrix corresponding to the first column of `other`.
+    *
+    * @param[in] other The feature matrix to be copied. The block must fit into this matrix.
+    *
+    * @param[in] firstChannel The index of the channel of `other` corresponding to the first channel
+    * of this matrix. `other` must provide at least `firstChannel + channels()` channels.
+    */
+    void setBlock(Index firstRow, Index firstCol, const FeatureMatrix_<Scalar> & other, Index firstChannel = 0)
+    {
+        assert(firstRow + other.rows() <= this->m_rows && firstCol + other.cols() <= this->m_cols
+               && firstChannel + this->m_channels <= other.channels());
+        
+        // De-interleave row by row, so that the source row stays in cache while the channels are distributed
+        const Index otherChannels = other.channels(), numCols = other.cols();
+        for (Index y = 0; y < other.rows(); y++)
+        {
+            const Scalar * src = other.raw() + y * numCols * otherChannels + firstChannel;
+            for (Index c = 0; c < this->m_channels; c++)
+            {
+                Scalar * dest = this->m_planes.raw() + (c * this->m_rows + firstRow + y) * this->m_cols + firstCol;
+                for (Index x = 0; x < numCols; x++)
+                    dest[x] = src[x * otherChannels + c];
+            }
+        }
+    };
+    
+    /**
+    * Converts this matrix to an interleaved feature matrix.
+    *
+    * @param[out] out The feature matrix to store the result in.
+    */
+    void toInterleaved(FeatureMatrix_<Scalar> & out) const
+    {
+        out.resize(this->m_rows, this->m_cols, this->m_channels);
+        if (!this->empty())
+            out.asCellMatrix() = Eigen::Map<const ScalarMatrix>(this->m_planes.raw(), this->m_channels, this->numCells()).transpose();
+    };
+    
+    /**
+    * Sets all elements of the feature matrix to a constant value.
+    */
+    void setConstant(const Scalar val) { this->m_planes.setConstant(val); };
+    
+    /**
+    * Sets all elements of the feature matrix to 0.
+    */
+    void setZero() { this->m_planes.setZero(); };
+    
+    /**
+    * @return Returns a pointer to the raw data storage of this feature matrix.
+    * The returned pointer may be NULL if the matrix is empty.
+    */
+    Scalar * raw() { return this->m_planes.raw(); };
+    
+    /**
+    * @return Returns a const pointer to the raw data storage of this feature matrix.
+    * The returned pointer may be NULL if the matrix is empty.
+    */
+    const Scalar * raw() const { return this->m_planes.raw(); };
+    
+    /**
+    * Returns an Eigen::Map object wrapping the contiguous plane of a single channel of this matrix.
+    */
+    ChannelMap channel(Index c)
+    {
+        assert(c >= 0 && c < this->m_channels);
+        return ChannelMap(this->m_planes.raw() + c * this->numCells(), this->m_rows, this->m_cols);
+    };
+    
+    /**
+    * Returns a constant Eigen::Map object wrapping the contiguous plane of a single channel of this matrix.
+    */
+    ConstChannelMap channel(Index c) const
+    {
+        assert(c >= 0 && c < this->m_channels);
+        return ConstChannelMap(this->m_planes.raw() + c * this->numCells(), this->m_rows, this->m_cols);
+    };
+    
+    /**
+    * Returns a reference to an element of this feature matrix.
+    */
+    Scalar & operator()(Index i, Index j, Index c)
+    {
+        assert(i >= 0 && j >= 0 && c >= 0 && i < this->m_rows && j < this->m_cols && c < this->m_channels);
+        return *(this->m_planes.raw() + (c * this->m_rows + i) * this->m_cols + j);
+    };
+    
+    /**
+    * Returns a const reference to an element of this feature matrix.
+    */
+    const Scalar & operator()(Index i, Index j, Index c) const
+    {
+        assert(i >= 0 && j >= 0 && c >= 0 && i < this->m_rows && j < this->m_cols && c < this->m_channels);
+        return *(this->m_planes.raw() + (c * this->m_rows + i) * this->m_cols + j);
+    };
+
+
+protected:
+    
+    Index m_rows; /**< Number of rows of this feature matrix. */
+    Index m_cols; /**< Number of columns of this feature matrix. */
+    Index m_channels; /**< Number of channels of this feature matrix. */
     
-    bool m_allocated; /**< True if this object has allocated the data storage by itself. */
+    FeatureMatrix_<Scalar> m_planes; /**< Storage of the channel planes, stacked vertically as a single-channel matrix. */
 
 };
 
 
 typedef FeatureMatrix_<FeatureScalar> FeatureMatrix; /**< Feature matrix using the default scalar type. */
+typedef PlanarFeatureMatrix_<FeatureScalar> PlanarFeatureMatrix; /**< Planar feature matrix using the default scalar type. */
 typedef FeatureMatrix::Cell FeatureCell; /**< Feature vector type of a single cell. */
 typedef FeatureMatrix::ScalarMatrix ScalarMatrix; /**< A matrix of scalar values. */
 
@@ -0,0 +1,120 @@
+#include "FeatureMatrixAllocator.h"
+#include <new>
+#include <cstdlib>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+using namespace ARTOS;
+using namespace std;
+
+
+shared_ptr<FeatureMatrixAllocator> & FeatureMatrixAllocator::defaultAllocator()
+{
+    static shared_ptr<FeatureMatrixAllocator> allocator = make_shared<AlignedAllocator>();
+    return allocator;
+}
+
+
+shared_ptr<FeatureMatrixAllocator> FeatureMatrixAllocator::getDefault()
+{
+    return atomic_load(&defaultAllocator());
+}
+
+
+void FeatureMatrixAllocator::setDefault(const shared_ptr<FeatureMatrixAllocator> & allocator)
+{
+    atomic_store(&defaultAllocator(), (allocator) ? allocator : static_pointer_cast<FeatureMatrixAllocator>(make_shared<AlignedAllocator>()));
+}
+
+
+void * AlignedAllocator::allocate(size_t bytes)
+{
+    return AlignedAllocator::alignedMalloc(bytes);
+}
+
+
+void AlignedAllocator::deallocate(void * ptr, size_t /*bytes*/)
+{
+    AlignedAllocator::alignedFree(ptr);
+}
+
+
+void * AlignedAllocator::alignedMalloc(size_t bytes)
+{
+    void * ptr = NULL;
+#ifdef _WIN32
+    ptr = _aligned_malloc(bytes, Alignment);
+#else
+    if (posix_memalign(&ptr, Alignment, bytes) != 0)
+        ptr = NULL;
+#endif
+    if (ptr == NULL)
+        throw bad_alloc();
+    return ptr;
+}
+
+
+void AlignedAllocator::alignedFree(void * ptr)
+{
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+
+FeatureMatrixPool::~FeatureMatrixPool()
+{
+    this->clear();
+}
+
+
+void * FeatureMatrixPool::allocate(size_t bytes)
+{
+    {
+        lock_guard<mutex> lock(this->m_mutex);
+        unordered_map< size_t, vector<void*> >::iterator blocks = this->m_freeBlocks.find(bytes);
+        if (blocks != this->m_freeBlocks.end() && !blocks->second.empty())
+        {
+            void * ptr = blocks->second.back();
+            blocks->second.pop_back();
+            this->m_cachedBytes -= bytes;
+            return ptr;
+        }
+    }
+    return AlignedAllocator::alignedMalloc(bytes);
+}
+
+
+void FeatureMatrixPool::deallocate(void * ptr, size_t bytes)
+{
+    {
+        lock_guard<mutex> lock(this->m_mutex);
+        if (this->m_cachedBytes + bytes <= this->m_maxCachedBytes)
+        {
+            this->m_freeBlocks[bytes].push_back(ptr);
+            this->m_cachedBytes += bytes;
+            return;
+        }
+    }
+    AlignedAllocator::alignedFree(ptr);
+}
+
+
+void FeatureMatrixPool::clear()
+{
+    lock_guard<mutex> lock(this->m_mutex);
+    for (unordered_map< size_t, vector<void*> >::iterator blocks = this->m_freeBlocks.begin(); blocks != this->m_freeBlocks.end(); blocks++)
+        for (vector<void*>::iterator ptr = blocks->second.begin(); ptr != blocks->second.end(); ptr++)
+            AlignedAllocator::alignedFree(*ptr);
+    this->m_freeBlocks.clear();
+    this->m_cachedBytes = 0;
+}
+
+
+size_t FeatureMatrixPool::cachedBytes() const
+{
+    lock_guard<mutex> lock(this->m_mutex);
+    return this->m_cachedBytes;
+}
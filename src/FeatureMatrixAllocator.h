@@ -0,0 +1,159 @@
+#ifndef ARTOS_FEATUREMATRIXALLOCATOR_H
+#define ARTOS_FEATUREMATRIXALLOCATOR_H
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace ARTOS
+{
+
+/**
+* Interface for allocators providing the memory of FeatureMatrix_ objects.
+*
+* All feature matrices which allocate their own storage obtain it from the allocator set by setDefault()
+* at the time of allocation and keep a reference to that allocator until they release the memory again.
+* Thus, the default allocator may be changed at any time without affecting existing matrices.
+*
+* Implementations must be thread-safe, since feature matrices are allocated by multiple threads.
+*/
+class FeatureMatrixAllocator
+{
+
+public:
+
+    /**
+    * Alignment of the memory provided by all allocators in bytes, which is sufficient for aligned loads
+    * of AVX-512 vectors and corresponds to the size of a cache line on common architectures.
+    */
+    static const std::size_t Alignment = 64;
+
+    virtual ~FeatureMatrixAllocator() {};
+
+    /**
+    * Allocates memory.
+    *
+    * @param[in] bytes The number of bytes to be allocated, which will always be a multiple of Alignment.
+    *
+    * @return Returns a pointer to uninitialized memory aligned to Alignment bytes.
+    *
+    * @throws std::bad_alloc The memory could not be allocated.
+    */
+    virtual void * allocate(std::size_t bytes) = 0;
+
+    /**
+    * Releases memory allocated by allocate().
+    *
+    * @param[in] ptr The pointer returned by allocate().
+    *
+    * @param[in] bytes The number of bytes passed to allocate().
+    */
+    virtual void deallocate(void * ptr, std::size_t bytes) = 0;
+
+    /**
+    * @return Returns the allocator currently used for new feature matrices.
+    */
+    static std::shared_ptr<FeatureMatrixAllocator> getDefault();
+
+    /**
+    * Changes the allocator used for new feature matrices.
+    *
+    * @param[in] allocator The new default allocator. If this is a NULL pointer, an AlignedAllocator will be used.
+    */
+    static void setDefault(const std::shared_ptr<FeatureMatrixAllocator> & allocator);
+
+
+protected:
+
+    static std::shared_ptr<FeatureMatrixAllocator> & defaultAllocator();
+
+};
+
+
+/**
+* Allocates aligned memory from the heap. This is the allocator used by default.
+*/
+class AlignedAllocator : public FeatureMatrixAllocator
+{
+
+public:
+
+    virtual void * allocate(std::size_t bytes) override;
+
+    virtual void deallocate(void * ptr, std::size_t bytes) override;
+
+    /**
+    * Allocates aligned memory from the heap.
+    *
+    * @param[in] bytes The number of bytes to be allocated.
+    *
+    * @return Returns a pointer to uninitialized memory aligned to Alignment bytes.
+    *
+    * @throws std::bad_alloc The memory could not be allocated.
+    */
+    static void * alignedMalloc(std::size_t bytes);
+
+    /**
+    * Releases memory allocated by alignedMalloc().
+    *
+    * @param[in] ptr The pointer returned by alignedMalloc().
+    */
+    static void alignedFree(void * ptr);
+
+};
+
+
+/**
+* Allocator which keeps released memory for reuse by subsequent allocations of the same size.
+*
+* Applications processing many images of the same size, e.g. the frames of a video, can install a pool
+* as default allocator using FeatureMatrixAllocator::setDefault() to recycle the memory of feature pyramid
+* levels, patchwork planes and other feature matrices instead of allocating it again for every image.
+*/
+class FeatureMatrixPool : public FeatureMatrixAllocator
+{
+
+public:
+
+    /**
+    * Constructs an empty pool.
+    *
+    * @param[in] maxCachedBytes The maximum total size of released memory blocks kept for reuse.
+    * Blocks released while this limit is reached are returned to the heap immediately.
+    */
+    FeatureMatrixPool(std::size_t maxCachedBytes = 512 << 20) : m_maxCachedBytes(maxCachedBytes), m_cachedBytes(0) {};
+
+    virtual ~FeatureMatrixPool();
+
+    FeatureMatrixPool(const FeatureMatrixPool &) = delete;
+    FeatureMatrixPool & operator=(const FeatureMatrixPool &) = delete;
+
+    virtual void * allocate(std::size_t bytes) override;
+
+    virtual void deallocate(void * ptr, std::size_t bytes) override;
+
+    /**
+    * Returns all memory blocks kept for reuse to the heap.
+    */
+    void clear();
+
+    /**
+    * @return Returns the total size of the memory blocks currently kept for reuse.
+    */
+    std::size_t cachedBytes() const;
+
+
+protected:
+
+    std::size_t m_maxCachedBytes; /**< Maximum total size of the blocks kept for reuse. */
+    std::size_t m_cachedBytes; /**< Total size of the blocks kept for reuse. */
+    std::unordered_map< std::size_t, std::vector<void*> > m_freeBlocks; /**< Blocks kept for reuse, indexed by their size. */
+    mutable std::mutex m_mutex; /**< Guards the members of the pool against concurrent access. */
+
+};
+
+}
+
+#endif
@@ -10,6 +10,56 @@ using namespace ARTOS;
 using namespace std;
 
 
+// Resamples a feature matrix by a given factor to a given size using bilinear interpolation and scales each channel
+// by a given factor. A border of cells around the matrix, which does not scale with the content, is kept aligned.
+static void resampleLevel(const FeatureMatrix & src, FeatureMatrix & dst, const Size & size, const Size & border,
+                          double scale, const FeatureCell & factors)
+{
+    dst = FeatureMatrix(size.height, size.width, src.channels());
+    if (dst.empty())
+        return;
+    
+    // The scale is not derived from the sizes of the matrices, since these are rounded to full cells
+    const float invScale = 1.0 / scale;
+    
+    // Bilinear interpolation coefficients
+    vector<int> x0(size.width), x1(size.width);
+    vector<float> a(size.width);
+    for (int j = 0; j < size.width; ++j)
+    {
+        const float x = min(max((j - border.width + 0.5f) * invScale - 0.5f + border.width, 0.0f), src.cols() - 1.0f);
+        x0[j] = x;
+        x1[j] = min(x0[j] + 1, static_cast<int>(src.cols()) - 1);
+        a[j] = x - x0[j];
+    }
+    
+    for (int i = 0; i < size.height; ++i)
+    {
+        const float y = min(max((i - border.height + 0.5f) * invScale - 0.5f + border.height, 0.0f), src.rows() - 1.0f);
+        const int y0 = y;
+        const int y1 = min(y0 + 1, static_cast<int>(src.rows()) - 1);
+        const float c = y - y0;
+        
+        for (int j = 0; j < size.width; ++j)
+            dst(i, j) = (((src(y0, x0[j]) * (1 - a[j]) + src(y0, x1[j]) * a[j]) * (1 - c)
+                         + (src(y1, x0[j]) * (1 - a[j]) + src(y1, x1[j]) * a[j]) * c).array() * factors.array()).matrix();
+    }
+}
+
+
+// Scales an image by a given factor, resampling the smallest of the given octaves which is large enough.
+// The result is stored in a buffer of the calling thread, which is reused by subsequent calls.
+static ImageView scaleImage(const ImageView & image, double scale, const vector<JPEGImage> & octaves)
+{
+    if (scale == 1.0)
+        return image;
+    
+    static thread_local JPEGImage scaled;
+    JPEGImage::Scale(image, image.width() * scale + 0.5, image.height() * scale + 0.5, octaves, scaled);
+    return scaled;
+}
+
+
 FeaturePyramid::FeaturePyramid(int interval, const vector<FeatureMatrix> & levels, const vector<double> * scales)
 : m_interval(0), m_scales(), m_featureExtractor(FeatureExtractor::defaultFeatureExtractor())
 {
@@ -36,7 +86,8 @@ FeaturePyramid::FeaturePyramid(int interval, vector<FeatureMatrix> && levels, co
 }
 
 
-FeaturePyramid::FeaturePyramid(const JPEGImage & image, const shared_ptr<FeatureExtractor> & featureExtractor, int interval, unsigned int minSize)
+FeaturePyramid::FeaturePyramid(const ImageView & image, const shared_ptr<FeatureExtractor> & featureExtractor, int interval, unsigned int minSize,
+                               Approximation approximation, int exactLevels, double minScale, double maxScale)
 : m_interval(0)
 {
     this->m_featureExtractor = (featureExtractor) ? featureExtractor : FeatureExtractor::defaultFeatureExtractor();
@@ -46,25 +97,25 @@ FeaturePyramid::FeaturePyramid(const JPEGImage & image, const shared_ptr<Feature
     
     // Compute the number of scales such that the smallest size of the last level is minSize
     const Size minPixelSize = this->m_featureExtractor->cellsToPixels(Size(minSize));
-    const int maxScale = interval * ceil(log(min(
+    const int lastLevel = interval * ceil(log(min(
         image.width() / static_cast<double>(minPixelSize.width),
         image.height() / static_cast<double>(minPixelSize.height)
     )) / log(2.0));
     
     // Begin with scales smaller than the size of the original image if the feature extractor requires this
     const Size maxImgSize = this->m_featureExtractor->maxImageSize();
-    const int minScale = max(0, static_cast<int>(max(
+    int firstLevel = max(0, static_cast<int>(max(
         (maxImgSize.width > 0) ? ceil(log(2 * image.width() / static_cast<double>(maxImgSize.width)) / log(2.0) * interval) : 0,
         (maxImgSize.height > 0) ? ceil(log(2 * image.height() / static_cast<double>(maxImgSize.height)) / log(2.0) * interval) : 0
     )));
     
     // Cannot compute the pyramid on images too small
-    if (maxScale - minScale < interval)
+    if (lastLevel - firstLevel < interval)
         return;
     
     // Compute scales of each level in the pyramid
     m_interval = interval;
-    m_scales.resize(maxScale - minScale + 1);
+    m_scales.resize(lastLevel - firstLevel + 1);
     
     int i;
 #pragma omp parallel for private(i)
@@ -73,30 +124,49 @@ FeaturePyramid::FeaturePyramid(const JPEGImage & image, const shared_ptr<Feature
         double scale = pow(2.0, static_cast<double>(-i) / interval);
         
         // First octave at twice the image resolution
-        if (i >= minScale)
-            this->m_scales[i - minScale] = scale * 2;
+        if (i >= firstLevel)
+            this->m_scales[i - firstLevel] = scale * 2;
         
         // Second octave at the original resolution
-        if (i + interval >= minScale && i + interval <= maxScale)
-            this->m_scales[i + interval - minScale] = scale;
+        if (i + interval >= firstLevel && i + interval <= lastLevel)
+            this->m_scales[i + interval - firstLevel] = scale;
         
         // Remaining octaves
-        for (int j = 2; i + j * interval <= maxScale; ++j)
+        for (int j = 2; i + j * interval <= lastLevel; ++j)
         {
             scale *= 0.5;
-            if (i + j * interval >= minScale)
-                this->m_scales[i + j * interval - minScale] = scale;
+            if (i + j * interval >= firstLevel)
+                this->m_scales[i + j * interval - firstLevel] = scale;
         }
     }
     
-    if (this->m_featureExtractor->patchworkProcessing())
-        this->buildLevelsPatchworked(image);
+    // Omit the levels outside of the requested range of scales (which are in descending order)
+    vector<double>::iterator first = this->m_scales.begin(), last = this->m_scales.end();
+    if (maxScale > 0)
+        first = find_if(first, last, [maxScale](double scale) { return scale <= maxScale; });
+    if (minScale > 0)
+        last = find_if(first, last, [minScale](double scale) { return scale < minScale; });
+    firstLevel += first - this->m_scales.begin();
+    this->m_scales.erase(last, this->m_scales.end());
+    this->m_scales.erase(this->m_scales.begin(), first);
+    if (this->m_scales.empty())
+        return;
+    
+    // Compute the octaves of the image once, so that all levels can be resampled from them
+    const vector<JPEGImage> octaves = JPEGImage::ComputeOctaves(image, minPixelSize.width, minPixelSize.height);
+    
+    if (approximation == Approximation::CHANNELS && exactLevels < interval && this->m_featureExtractor->supportsChannelApproximation())
+        this->buildLevelsApproximated(image, octaves, firstLevel, max(exactLevels, 1), approximation);
+    else if (approximation == Approximation::FEATURES && exactLevels < interval)
+        this->buildLevelsApproximated(image, octaves, firstLevel, max(exactLevels, 1), approximation);
+    else if (this->m_featureExtractor->patchworkProcessing())
+        this->buildLevelsPatchworked(image, octaves);
     else
-        this->buildLevels(image);
+        this->buildLevels(image, octaves);
 }
 
 
-void FeaturePyramid::buildLevels(const JPEGImage & image)
+void FeaturePyramid::buildLevels(const ImageView & image, const vector<JPEGImage> & octaves)
 {
     if (image.empty() || this->m_scales.empty())
         return;
@@ -118,7 +188,7 @@ void FeaturePyramid::buildLevels(const JPEGImage & image)
             try
             {
                 this->m_featureExtractor->extract(
-                    image.resize(image.width() * scale / 2 + 0.5, image.height() * scale / 2 + 0.5),
+                    scaleImage(image, scale / 2, octaves),
                     m_levels[i],
                     this->m_featureExtractor->cellSize() / 2
                 );
@@ -126,16 +196,124 @@ void FeaturePyramid::buildLevels(const JPEGImage & image)
             catch (NotSupportedException & e)
             {
                 // This should not happen if the feature extractor behaves consistently.
-                this->m_featureExtractor->extract(image.resize(image.width() * scale + 0.5, image.height() * scale + 0.5), m_levels[i]);
+                this->m_featureExtractor->extract(scaleImage(image, scale, octaves), m_levels[i]);
             }
         }
         else
-            this->m_featureExtractor->extract(image.resize(image.width() * scale + 0.5, image.height() * scale + 0.5), m_levels[i]);
+            this->m_featureExtractor->extract(scaleImage(image, scale, octaves), m_levels[i]);
+    }
+}
+
+
+void FeaturePyramid::buildLevelsApproximated(const ImageView & image, const vector<JPEGImage> & octaves, int firstLevel, int exactLevels, Approximation approximation)
+{
+    if (image.empty() || this->m_scales.empty())
+        return;
+    
+    const int numLevels = this->m_scales.size();
+    const bool useChannels = (approximation == Approximation::CHANNELS);
+    this->m_levels.resize(numLevels);
+    vector<FeatureMatrix> channels((useChannels) ? numLevels : 0);
+    
+    // Spread the exact levels evenly over each octave, beginning with the first one.
+    // The first level of the pyramid is always computed exactly, since the first level
+    // of its octave may be missing.
+    vector<int> source(numLevels);
+    for (int i = 0; i < numLevels; ++i)
+        source[i] = (i == 0 || (((i + firstLevel) % this->m_interval) * exactLevels) % this->m_interval < exactLevels) ? i : source[i - 1];
+    
+    // Compute the channels or features of the exact levels
+    int i;
+    bool threadSafe = this->m_featureExtractor->supportsMultiThread();
+    #pragma omp parallel for private(i) if(threadSafe)
+    for (i = 0; i < numLevels; ++i)
+        if (source[i] == i)
+        {
+            double scale = this->m_scales[i];
+            Size cellSize = this->m_featureExtractor->cellSize();
+            
+            // First octave at twice the image resolution
+            if (scale > 1.0 && cellSize.min() > 1 && this->m_featureExtractor->supportsVariableCellSize())
+            {
+                scale /= 2;
+                cellSize = cellSize / 2;
+            }
+            
+            const ImageView scaled = scaleImage(image, scale, octaves);
+            if (useChannels)
+            {
+                this->m_featureExtractor->computeChannels(scaled, channels[i], cellSize);
+                this->m_featureExtractor->channelsToFeatures(channels[i], this->m_levels[i]);
+            }
+            else if (cellSize != this->m_featureExtractor->cellSize())
+                this->m_featureExtractor->extract(scaled, this->m_levels[i], cellSize);
+            else
+                this->m_featureExtractor->extract(scaled, this->m_levels[i]);
+        }
+    
+    // Estimate the power law exponent of each feature channel from the mean responses of consecutive exact levels
+    vector<FeatureCell> lambdas;
+    if (!useChannels)
+    {
+        vector<int> exact;
+        for (i = 0; i < numLevels; ++i)
+            if (source[i] == i && !this->m_levels[i].empty())
+                exact.push_back(i);
+        
+        lambdas.resize(numLevels);
+        for (i = 0; i < numLevels; ++i)
+            if (source[i] != i)
+            {
+                // Use the exact levels enclosing this one or the last two exact levels if there is none below it
+                vector<int>::const_iterator next = upper_bound(exact.begin(), exact.end(), i);
+                if (next == exact.end() && exact.size() > 1)
+                    --next;
+                if (next == exact.end() || next == exact.begin())
+                {
+                    lambdas[i] = FeatureCell::Zero(this->m_levels[source[i]].channels());
+                    continue;
+                }
+                const FeatureMatrix & fine = this->m_levels[*(next - 1)], & coarse = this->m_levels[*next];
+                const FeatureCell fineMean = fine.asCellMatrix().colwise().sum().transpose() / static_cast<FeatureScalar>(fine.rows() * fine.cols());
+                const FeatureCell coarseMean = coarse.asCellMatrix().colwise().sum().transpose() / static_cast<FeatureScalar>(coarse.rows() * coarse.cols());
+                const FeatureScalar logRatio = log(this->m_scales[*(next - 1)] / this->m_scales[*next]);
+                lambdas[i].resize(fine.channels());
+                for (int c = 0; c < fine.channels(); ++c)
+                    lambdas[i](c) = (fineMean(c) > 0 && coarseMean(c) > 0)
+                                    ? min(max(log(coarseMean(c) / fineMean(c)) / logRatio, static_cast<FeatureScalar>(-1)), static_cast<FeatureScalar>(1))
+                                    : 0;
+            }
     }
+    
+    // Approximate the remaining levels by resampling the channels or features of the nearest finer exact level
+    const FeatureScalar lambda = (useChannels) ? this->m_featureExtractor->channelScalingExponent() : 0;
+    #pragma omp parallel for private(i) if(threadSafe)
+    for (i = 0; i < numLevels; ++i)
+        if (source[i] != i)
+        {
+            const int s = source[i];
+            const Size size = max(this->m_featureExtractor->pixelsToCells(Size(
+                image.width() * this->m_scales[i] + 0.5, image.height() * this->m_scales[i] + 0.5
+            )), Size(1));
+            if (useChannels)
+            {
+                const Size border(channels[s].cols() - this->m_levels[s].cols(), channels[s].rows() - this->m_levels[s].rows());
+                FeatureMatrix resampled;
+                resampleLevel(channels[s], resampled, size + border, border / 2, this->m_scales[i] / this->m_scales[s],
+                              FeatureCell::Constant(channels[s].channels(), pow(this->m_scales[s] / this->m_scales[i], lambda)));
+                this->m_featureExtractor->channelsToFeatures(resampled, this->m_levels[i]);
+            }
+            else
+            {
+                const FeatureScalar logScale = log(this->m_scales[s] / this->m_scales[i]);
+                resampleLevel(this->m_levels[s], this->m_levels[i], size, Size(0), this->m_scales[i] / this->m_scales[s],
+                              (lambdas[i] * logScale).array().exp().matrix());
+            }
+        }
 }
 
 
-void FeaturePyramid::buildLevelsPatchworked(const JPEGImage & image)
+void FeaturePyramid::buildLevelsPatchworked(const ImageView & image, const vector<JPEGImage> & octaves)
 {
     if (image.empty() || this->m_scales.empty())
         return;
@@ -181,11 +359,14 @@ void FeaturePyramid::buildLevelsPatchworked(const JPEGImage & image)
     
     // Fill patchwork planes
     vector<JPEGImage> planes;
+    vector<uint8_t *> planeBits;
     planes.reserve(numPlanes);
+    planeBits.reserve(numPlanes);
     for (i = 0; i < numPlanes; i++)
     {
         planes.push_back(JPEGImage(maxSize.width, maxSize.height, image.depth()));
         planes.back().toMatrix().setZero();
+        planeBits.push_back(planes.back().bits());
     }
     
     #pragma omp parallel for private(i)
@@ -195,8 +376,10 @@ void FeaturePyramid::buildLevelsPatchworked(const JPEGImage & image)
         assert(rect.plane() >= 0 && rect.plane() < planes.size());
         assert(rect.x() % this->m_featureExtractor->cellSize().width == 0 && rect.y() % this->m_featureExtractor->cellSize().height == 0);
         double scale = this->m_scales[i];
-        JPEGImage scaled = (scale != 1.0) ? image.resize(image.width() * scale + 0.5, image.height() * scale + 0.5) : image;
-        planes[rect.plane()].toMatrix().data().block(rect.y(), rect.x() * scaled.depth(), scaled.height(), scaled.width() * scaled.depth()) = scaled.toMatrix().data();
+        const ImageView scaled = scaleImage(image, scale, octaves);
+        for (int y = 0; y < scaled.height(); y++)
+            copy(scaled.scanLine(y), scaled.scanLine(y) + scaled.width() * scaled.depth(),
+                 planeBits[rect.plane()] + ((rect.y() + y) * maxSize.width + rect.x()) * scaled.depth());
     }
     
     // Run feature extractor over planes
@@ -13,6 +13,14 @@ namespace ARTOS
 * 2^(1 - @c i / @c interval), so that the first scale is at double the resolution of the original image.
 * Some scales may be omitted due to restrictions of the feature extractor.
 *
+* Instead of extracting features from each scale of the image, the features of most levels may optionally
+* be approximated from a few levels per octave, following "Fast Feature Pyramids for Object Detection"
+* by Dollar et al. (PAMI 2014). See Approximation for details.
+*
+* The octaves of the image are computed once using JPEGImage::computeOctaves() and each scale is resampled from
+* the smallest octave which is large enough, so that images loaded using JPEGImage::ReadWithOctaves() are resampled
+* from the octaves decoded directly from the jpeg stream instead of the full resolution image.
+*
 * @author Bjoern Barz <bjoern.barz@uni-jena.de>
 */
 class FeaturePyramid
@@ -20,6 +28,20 @@ class FeaturePyramid
 
 public:
 
+    /**
+    * Methods for approximating the features of some levels of the pyramid from other levels.
+    */
+    enum class Approximation : uint8_t
+    {
+        NONE,       /**< Features of each level are extracted from the scaled image. */
+        CHANNELS,   /**< Intermediate channels (e. g. gradient histograms) are computed for a few levels per octave only
+                         and resampled for the remaining levels of the octave. Requires a feature extractor with
+                         FeatureExtractor::supportsChannelApproximation(), otherwise features will be extracted from each scale. */
+        FEATURES    /**< Features are extracted for a few levels per octave only and resampled for the remaining levels of the octave.
+                         Each channel is corrected by a power law whose exponent is estimated from the exact levels.
+                         Works with any feature extractor, but is less accurate than CHANNELS. */
+    };
+
     /**
     * Constructs an empty pyramid. An empty pyramid has no level.
     */
@@ -44,13 +66,22 @@ public:
     FeaturePyramid(int interval, std::vector<FeatureMatrix> && levels, const std::vector<double> * scales = NULL);
     
     /**
-    * Constructs a pyramid from a JPEGImage.
-    * @param[in] image The JPEGImage.
+    * Constructs a pyramid from an image.
+    * @param[in] image The image, which may be a JPEGImage or a view on pixels owned by someone else,
+    * e.g. a frame of a video stream, which will only be copied for levels whose scale is not 1.
     * @param[in] featureExtractor The feature extractor to be used by this pyramid.
     * @param[in] interval Number of levels per octave in the pyramid (at least 1).
     * @param[in] minSize Minimum number of cells in x or y direction in the smallest scale in the pyramid.
-    */
-    FeaturePyramid(const JPEGImage & image, const std::shared_ptr<FeatureExtractor> & featureExtractor = nullptr, int interval = 10, unsigned int minSize = 5);
+    * @param[in] approximation Specifies if and how the features of some levels will be approximated from other levels.
+    * @param[in] exactLevels If approximation is enabled, this specifies the number of levels per octave (between 1 and
+    * `interval`) whose features are computed exactly. The first level of each octave is always one of them.
+    * @param[in] minScale Levels with a scale below this are omitted without being computed. Non-positive values impose no limit.
+    * @param[in] maxScale Levels with a scale above this are omitted without being computed. Non-positive values impose no limit.
+    * If no level lies between `minScale` and `maxScale`, the pyramid will be empty, but interval() will be positive,
+    * in contrast to the case of an image too small or invalid.
+    */
+    FeaturePyramid(const ImageView & image, const std::shared_ptr<FeatureExtractor> & featureExtractor = nullptr, int interval = 10, unsigned int minSize = 5,
+                   Approximation approximation = Approximation::NONE, int exactLevels = 1, double minScale = 0.0, double maxScale = 0.0);
     
     /**
     * @return True if the pyramid is empty. An empty pyramid has no level.
@@ -122,16 +153,30 @@ protected:
     /**
     * Constructs `m_levels` according to `m_scales` using `m_featureExtractor`.
     * @param[in] img The image to extract features from.
+    * @param[in] octaves The octaves of the image, as obtained from JPEGImage::computeOctaves().
     */
-    void buildLevels(const JPEGImage & img);
+    void buildLevels(const ImageView & img, const std::vector<JPEGImage> & octaves);
     
     /**
     * Constructs `m_levels` according to `m_scales` by placing multiple scales of the image
     * together on a plane of fixed size in order to reduce the number of calls to `m_featureExtractor->extract()`.
     * `m_featureExtractor->borderSize()` will be used as padding between images on the same plane.
     * @param[in] img The image to extract features from.
+    * @param[in] octaves The octaves of the image, as obtained from JPEGImage::computeOctaves().
+    */
+    void buildLevelsPatchworked(const ImageView & img, const std::vector<JPEGImage> & octaves);
+    
+    /**
+    * Constructs `m_levels` according to `m_scales` by computing the channels or features of a few levels per octave
+    * and resampling them for the remaining levels.
+    * @param[in] img The image to extract features from.
+    * @param[in] octaves The octaves of the image, as obtained from JPEGImage::computeOctaves().
+    * @param[in] firstLevel The index of the first level in `m_scales` with respect to a pyramid beginning at twice the image resolution.
+    * @param[in] exactLevels The number of levels per octave whose channels or features are computed from the scaled image.
+    * @param[in] approximation Approximation::CHANNELS to resample the channels obtained from `m_featureExtractor->computeChannels()`
+    * or Approximation::FEATURES to resample the features obtained from `m_featureExtractor->extract()`.
     */
-    void buildLevelsPatchworked(const JPEGImage & img);
+    void buildLevelsApproximated(const ImageView & img, const std::vector<JPEGImage> & octaves, int firstLevel, int exactLevels, Approximation approximation);
 
 };
 
@@ -3,6 +3,13 @@
 #include <cstdint>
 #include <cmath>
 #include <cassert>
+#include <mutex>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__)) && !defined(ARTOS_NO_SIMD)
+#define ARTOS_HOG_SIMD
+#include <immintrin.h>
+#endif
+
 using namespace ARTOS;
 using namespace std;
 
@@ -58,7 +65,7 @@ Size HOGFeatureExtractor::pixelsToCells(const Size & pixels) const
 }
 
 
-void HOGFeatureExtractor::extract(const JPEGImage & img, FeatureMatrix & feat, const Size & cellSize) const
+void HOGFeatureExtractor::extract(const ImageView & img, FeatureMatrix & feat, const Size & cellSize) const
 {
     HOGFeatureExtractor::HOG(img, feat, Size(1, 1), (cellSize.width > 0 && cellSize.height > 0) ? cellSize : this->cellSize());
     if (feat.rows() > 2 && feat.cols() > 2)
@@ -155,6 +162,67 @@ Size HOGFeatureExtractor::computeOptimalModelSize(const vector<Size> & sizes, co
 }
 
 
+// Table of all the possible tangents (1MB)
+static FeatureScalar ATAN2_TABLE[512][512] = {{0}};
+static once_flag ATAN2_TABLE_FILLED;
+
+static void fillAtan2Table()
+{
+    for (int dy = -255; dy <= 255; ++dy) {
+        for (int dx = -255; dx <= 255; ++dx) {
+            // Angle in the range [-pi, pi]
+            double angle = atan2(static_cast<double>(dy), static_cast<double>(dx));
+            
+            // Convert it to the range [9.0, 27.0]
+            angle = angle * (9.0 / M_PI) + 18.0;
+            
+            // Convert it to the range [0, 18)
+            if (angle >= 18.0)
+                angle -= 18.0;
+            
+            ATAN2_TABLE[dy + 255][dx + 255] = max(angle, 0.0);
+        }
+    }
+}
+
+
+// Gradient orientation of the pixel at column x, split among the two nearest orientation bins,
+// using the channel with the largest gradient magnitude
+static inline void gradient(const uint8_t * linem, const uint8_t * line, const uint8_t * linep,
+                            int x, int width, int depth,
+                            int & bin0, int & bin1, FeatureScalar & magnitude0, FeatureScalar & magnitude1)
+{
+    const int xp = min(x + 1, width - 1);
+    const int xm = max(x - 1, 0);
+    
+    // Use the channel with the largest gradient magnitude
+    FeatureScalar magnitude = 0;
+    FeatureScalar theta = 0;
+    
+    for (int i = 0; i < depth; ++i)
+    {
+        const int dx = static_cast<int>(line[xp * depth + i]) -
+                       static_cast<int>(line[xm * depth + i]);
+        const int dy = static_cast<int>(linep[x * depth + i]) -
+                       static_cast<int>(linem[x * depth + i]);
+        
+        if (dx * dx + dy * dy > magnitude)
+        {
+            magnitude = dx * dx + dy * dy;
+            theta = ATAN2_TABLE[dy + 255][dx + 255];
+        }
+    }
+    
+    magnitude = sqrt(magnitude);
+    
+    // Linear interpolation between the two nearest orientations
+    bin0 = theta;
+    bin1 = (bin0 < 17) ? (bin0 + 1) : 0;
+    magnitude1 = magnitude * (theta - bin0);
+    magnitude0 = magnitude - magnitude1;
+}
+
+
 // Bilinear interpolation among the 4 neighboring cells
 static inline void interpolate(int x, int y, int bin0, int bin1, FeatureScalar magnitude0, FeatureScalar magnitude1,
                                const Size & cellSize, FeatureMatrix & matrix)
@@ -183,32 +251,221 @@ static inline void interpolate(int x, int y, int bin0, int bin1, FeatureScalar m
 }
 
 
-void HOGFeatureExtractor::HOG(const JPEGImage & image, FeatureMatrix & feat, const Size & padding, const Size & cellSize)
+// Computes the "gradient energy" ||C(i,j)||^2 of each cell in a given row of a histogram matrix
+static inline void computeEnergy(const FeatureMatrix & hist, int y, FeatureScalar * energy)
+{
+    for (int x = 0; x < hist.cols(); ++x)
+    {
+        const FeatureScalar * cell = &hist(y, x, 0);
+        FeatureScalar e = 0;
+        for (int i = 0; i < 9; ++i)
+            e += (cell[i] + cell[i + 9]) * (cell[i] + cell[i + 9]);
+        energy[x] = e;
+    }
+}
+
+
+// Computes the normalization factors of the 2x2 blocks of cells between two rows of gradient energies
+static inline void computeBlockNorms(const FeatureScalar * energyTop, const FeatureScalar * energyBottom, int cols,
+                                     FeatureScalar * norms)
+{
+    const FeatureScalar EPS = numeric_limits<FeatureScalar>::epsilon();
+    for (int x = 0; x < cols - 1; ++x)
+        norms[x] = 1 / sqrt(energyTop[x] + energyTop[x + 1] + energyBottom[x] + energyBottom[x + 1] + EPS);
+}
+
+
+// Turns a cell into a padding cell, which has only the truncation feature set
+static inline void truncate(FeatureMatrix & feat, int y, int x)
 {
-    // Table of all the possible tangents (1MB)
-    static FeatureScalar ATAN2_TABLE[512][512] = {{0}};
+    feat(y, x).setZero();
+    feat(y, x, 31) = 1;
+}
+
+
+/*
+* Vectorized gradient computation.
+*
+* The following kernels compute the same as gradient() for 8 pixels of an image row at once,
+* beginning at column 1. They stop early enough to never read beyond the end of the row
+* and return the first column which has not been processed, so that the remaining pixels
+* can be handled by the scalar code.
+* SSE2 and AVX2 variants are compiled independently of the target architecture and the
+* appropriate one is chosen at run-time depending on the capabilities of the CPU.
+*/
+
+typedef int (*GradientRowKernel)(const uint8_t * linem, const uint8_t * line, const uint8_t * linep,
+                                 int width, int depth,
+                                 int * bin0, int * bin1, FeatureScalar * magnitude0, FeatureScalar * magnitude1);
+
+#ifdef ARTOS_HOG_SIMD
+
+// Loads a channel of 8 consecutive pixels as 16-bit integers
+__attribute__((target("sse2")))
+static inline __m128i loadPixels_SSE2(const uint8_t * p, int depth)
+{
+    if (depth == 1)
+        return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)), _mm_setzero_si128());
+    else
+        return _mm_setr_epi16(p[0], p[depth], p[2 * depth], p[3 * depth],
+                              p[4 * depth], p[5 * depth], p[6 * depth], p[7 * depth]);
+}
+
+
+// Selects elements from a where mask is set and from b otherwise
+__attribute__((target("sse2")))
+static inline __m128i select_SSE2(__m128i mask, __m128i a, __m128i b)
+{
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+
+__attribute__((target("sse2")))
+static int gradientRow_SSE2(const uint8_t * linem, const uint8_t * line, const uint8_t * linep,
+                            int width, int depth,
+                            int * bin0, int * bin1, FeatureScalar * magnitude0, FeatureScalar * magnitude1)
+{
+    const FeatureScalar * table = &ATAN2_TABLE[0][0];
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i seventeen = _mm_set1_epi32(17);
+    const __m128i indexWeights = _mm_set1_epi32(1 | (512 << 16)); // dx + 512 * dy
+    const __m128i indexOffset = _mm_set1_epi32(255 * 512 + 255);
     
-    // Fill the atan2 table
-#pragma omp critical
-    if (ATAN2_TABLE[0][0] == 0) {
-        for (int dy = -255; dy <= 255; ++dy) {
-            for (int dx = -255; dx <= 255; ++dx) {
-                // Angle in the range [-pi, pi]
-                double angle = atan2(static_cast<double>(dy), static_cast<double>(dx));
-                
-                // Convert it to the range [9.0, 27.0]
-                angle = angle * (9.0 / M_PI) + 18.0;
-                
-                // Convert it to the range [0, 18)
-                if (angle >= 18.0)
-                    angle -= 18.0;
-                
-                ATAN2_TABLE[dy + 255][dx + 255] = max(angle, 0.0);
+    alignas(16) int32_t index[8];
+    
+    int x = 1;
+    for (; x + 11 < width; x += 8)
+    {
+        // Gradient magnitudes are compared as integers and the table index of the
+        // winning channel is kept for each of the two halves of 4 pixels
+        __m128i bestMagnitude[2] = { zero, zero };
+        __m128i bestIndex[2] = { indexOffset, indexOffset };
+        for (int i = 0; i < depth; ++i)
+        {
+            const __m128i dx = _mm_sub_epi16(loadPixels_SSE2(line + (x + 1) * depth + i, depth),
+                                             loadPixels_SSE2(line + (x - 1) * depth + i, depth));
+            const __m128i dy = _mm_sub_epi16(loadPixels_SSE2(linep + x * depth + i, depth),
+                                             loadPixels_SSE2(linem + x * depth + i, depth));
+            const __m128i d[2] = { _mm_unpacklo_epi16(dx, dy), _mm_unpackhi_epi16(dx, dy) };
+            for (int h = 0; h < 2; ++h)
+            {
+                const __m128i magnitude = _mm_madd_epi16(d[h], d[h]); // dx * dx + dy * dy
+                const __m128i mask = _mm_cmpgt_epi32(magnitude, bestMagnitude[h]);
+                bestMagnitude[h] = select_SSE2(mask, magnitude, bestMagnitude[h]);
+                bestIndex[h] = select_SSE2(mask, _mm_add_epi32(_mm_madd_epi16(d[h], indexWeights), indexOffset),
+                                           bestIndex[h]);
             }
         }
+        
+        _mm_store_si128(reinterpret_cast<__m128i *>(index), bestIndex[0]);
+        _mm_store_si128(reinterpret_cast<__m128i *>(index + 4), bestIndex[1]);
+        for (int h = 0; h < 2; ++h)
+        {
+            const int32_t * ind = index + 4 * h;
+            const __m128 theta = _mm_setr_ps(table[ind[0]], table[ind[1]], table[ind[2]], table[ind[3]]);
+            const __m128 magnitude = _mm_sqrt_ps(_mm_cvtepi32_ps(bestMagnitude[h]));
+            const __m128i theta0 = _mm_cvttps_epi32(theta);
+            const __m128i theta1 = _mm_and_si128(_mm_add_epi32(theta0, one), _mm_cmpgt_epi32(seventeen, theta0));
+            const __m128 m1 = _mm_mul_ps(magnitude, _mm_sub_ps(theta, _mm_cvtepi32_ps(theta0)));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(bin0 + x + 4 * h), theta0);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(bin1 + x + 4 * h), theta1);
+            _mm_storeu_ps(magnitude0 + x + 4 * h, _mm_sub_ps(magnitude, m1));
+            _mm_storeu_ps(magnitude1 + x + 4 * h, m1);
+        }
+    }
+    return x;
+}
+
+
+// Loads a channel of 8 consecutive pixels as 32-bit integers
+__attribute__((target("avx2")))
+static inline __m256i loadPixels_AVX2(const uint8_t * p, int depth)
+{
+    if (depth == 1)
+        return _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)));
+    else if (depth == 3)
+    {
+        // Pick every third byte from the 24 bytes occupied by the 8 pixels
+        const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        const __m128i hi = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(p + 16));
+        const __m128i shuffleLo = _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+        const __m128i shuffleHi = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, -1, -1, -1, -1, -1, -1, -1, -1);
+        return _mm256_cvtepu8_epi32(_mm_or_si128(_mm_shuffle_epi8(lo, shuffleLo), _mm_shuffle_epi8(hi, shuffleHi)));
     }
+    else
+    {
+        const __m256i offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(depth));
+        return _mm256_and_si256(_mm256_i32gather_epi32(reinterpret_cast<const int *>(p), offsets, 1),
+                                _mm256_set1_epi32(0xFF));
+    }
+}
+
+
+__attribute__((target("avx2")))
+static int gradientRow_AVX2(const uint8_t * linem, const uint8_t * line, const uint8_t * linep,
+                            int width, int depth,
+                            int * bin0, int * bin1, FeatureScalar * magnitude0, FeatureScalar * magnitude1)
+{
+    const FeatureScalar * table = &ATAN2_TABLE[0][0];
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i seventeen = _mm256_set1_epi32(17);
+    const __m256i indexOffset = _mm256_set1_epi32(255 * 512 + 255);
     
-    while (ATAN2_TABLE[510][510] == 0);
+    int x = 1;
+    for (; x + 11 < width; x += 8)
+    {
+        __m256i bestMagnitude = _mm256_setzero_si256();
+        __m256i bestIndex = indexOffset;
+        for (int i = 0; i < depth; ++i)
+        {
+            const __m256i dx = _mm256_sub_epi32(loadPixels_AVX2(line + (x + 1) * depth + i, depth),
+                                                loadPixels_AVX2(line + (x - 1) * depth + i, depth));
+            const __m256i dy = _mm256_sub_epi32(loadPixels_AVX2(linep + x * depth + i, depth),
+                                                loadPixels_AVX2(linem + x * depth + i, depth));
+            const __m256i magnitude = _mm256_add_epi32(_mm256_mullo_epi32(dx, dx), _mm256_mullo_epi32(dy, dy));
+            const __m256i mask = _mm256_cmpgt_epi32(magnitude, bestMagnitude);
+            bestMagnitude = _mm256_blendv_epi8(bestMagnitude, magnitude, mask);
+            bestIndex = _mm256_blendv_epi8(bestIndex,
+                                           _mm256_add_epi32(_mm256_add_epi32(_mm256_slli_epi32(dy, 9), dx), indexOffset),
+                                           mask);
+        }
+        
+        const __m256 theta = _mm256_i32gather_ps(table, bestIndex, 4);
+        const __m256 magnitude = _mm256_sqrt_ps(_mm256_cvtepi32_ps(bestMagnitude));
+        const __m256i theta0 = _mm256_cvttps_epi32(theta);
+        const __m256i theta1 = _mm256_and_si256(_mm256_add_epi32(theta0, one), _mm256_cmpgt_epi32(seventeen, theta0));
+        const __m256 m1 = _mm256_mul_ps(magnitude, _mm256_sub_ps(theta, _mm256_cvtepi32_ps(theta0)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(bin0 + x), theta0);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(bin1 + x), theta1);
+        _mm256_storeu_ps(magnitude0 + x, _mm256_sub_ps(magnitude, m1));
+        _mm256_storeu_ps(magnitude1 + x, m1);
+    }
+    return x;
+}
+
+#endif
+
+
+// Selects the gradient kernel best suited for the CPU we're running on
+static GradientRowKernel selectGradientRowKernel()
+{
+#ifdef ARTOS_HOG_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return gradientRow_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return gradientRow_SSE2;
+#endif
+    return 0;
+}
+
+
+// Computes the unnormalized histograms of oriented gradients, which are stored in the first 18 channels of feat
+static void computeHistograms(const ImageView & image, FeatureMatrix & feat, const Size & padding, const Size & cellSize, bool simd)
+{
+    // Fill the atan2 table
+    call_once(ATAN2_TABLE_FILLED, fillAtan2Table);
     
     // Some shortcuts
     const int width = image.width();
@@ -230,99 +487,149 @@ void HOGFeatureExtractor::HOG(const JPEGImage & image, FeatureMatrix & feat, con
                          (width + cellSize.width / 2) / cellSize.width + padding.width * 2,
                          FeatureCell::Zero(32));
     
-    for (int y = 0; y < height; ++y)
+    static const GradientRowKernel gradientRowKernel = selectGradientRowKernel();
+    
+    if (simd && gradientRowKernel)
     {
-        const int yp = min(y + 1, height - 1);
-        const int ym = max(y - 1, 0);
+        // Gradients are computed for an entire row at once. Their magnitudes are then accumulated
+        // in a single row of cells, interpolating only horizontally, so that the vertical
+        // interpolation can be done for all cells of the row and all orientations at once.
+        const Size csh = cellSize / 2;
+        vector<int> bin0(width), bin1(width), cellCol(width);
+        vector<FeatureScalar> magnitude0(width), magnitude1(width), weightLeft(width), weightRight(width);
+        for (int x = 0; x < width; ++x)
+        {
+            cellCol[x] = (x + padCells.width - csh.width) / cellSize.width;
+            weightRight[x] = ((x + padCells.width - csh.width) % cellSize.width) * 2 + 1;
+            weightLeft[x] = cellSize.width * 2 - weightRight[x];
+        }
         
-        const uint8_t * linep = reinterpret_cast<const uint8_t *>(image.scanLine(yp));
-        const uint8_t * line = reinterpret_cast<const uint8_t *>(image.scanLine(y));
-        const uint8_t * linem = reinterpret_cast<const uint8_t *>(image.scanLine(ym));
+        // Accumulated orientation histograms of the current row, with the same layout as a row of feat
+        const int firstCol = cellCol[0], numCols = cellCol[width - 1] + 2 - firstCol;
+        FeatureMatrix rowHist(1, feat.cols(), 32);
+        Eigen::Map<Eigen::ArrayXf> rowHistArray(&rowHist(0, firstCol, 0), numCols * 32);
         
-        for (int x = 0; x < width; ++x)
+        for (int y = 0; y < height; ++y)
         {
-            const int xp = min(x + 1, width - 1);
-            const int xm = max(x - 1, 0);
+            const uint8_t * linep = reinterpret_cast<const uint8_t *>(image.scanLine(min(y + 1, height - 1)));
+            const uint8_t * line = reinterpret_cast<const uint8_t *>(image.scanLine(y));
+            const uint8_t * linem = reinterpret_cast<const uint8_t *>(image.scanLine(max(y - 1, 0)));
             
-            // Use the channel with the largest gradient magnitude
-            FeatureScalar magnitude = 0;
-            FeatureScalar theta = 0;
+            // Compute the gradients of this row
+            gradient(linem, line, linep, 0, width, depth, bin0[0], bin1[0], magnitude0[0], magnitude1[0]);
+            for (int x = gradientRowKernel(linem, line, linep, width, depth, bin0.data(), bin1.data(),
+                                           magnitude0.data(), magnitude1.data());
+                 x < width; ++x)
+                gradient(linem, line, linep, x, width, depth, bin0[x], bin1[x], magnitude0[x], magnitude1[x]);
             
-            for (int i = 0; i < depth; ++i)
+            // Horizontal interpolation
+            rowHistArray.setZero();
+            for (int x = 0; x < width; ++x)
             {
-                const int dx = static_cast<int>(line[xp * depth + i]) -
-                               static_cast<int>(line[xm * depth + i]);
-                const int dy = static_cast<int>(linep[x * depth + i]) -
-                               static_cast<int>(linem[x * depth + i]);
-                
-                if (dx * dx + dy * dy > magnitude)
-                {
-                    magnitude = dx * dx + dy * dy;
-                    theta = ATAN2_TABLE[dy + 255][dx + 255];
-                }
+                FeatureScalar * left = &rowHist(0, cellCol[x], 0);
+                FeatureScalar * right = left + 32;
+                left[bin0[x]] += magnitude0[x] * weightLeft[x];
+                left[bin1[x]] += magnitude1[x] * weightLeft[x];
+                right[bin0[x]] += magnitude0[x] * weightRight[x];
+                right[bin1[x]] += magnitude1[x] * weightRight[x];
             }
             
-            magnitude = sqrt(magnitude);
+            // Vertical interpolation
+            const int i = (y + padCells.height - csh.height) / cellSize.height;
+            const int a = ((y + padCells.height - csh.height) % cellSize.height) * 2 + 1;
+            const int b = cellSize.height * 2 - a;
+            Eigen::Map<Eigen::ArrayXf>(&feat(i, firstCol, 0), numCols * 32) += rowHistArray * static_cast<FeatureScalar>(b);
+            Eigen::Map<Eigen::ArrayXf>(&feat(i + 1, firstCol, 0), numCols * 32) += rowHistArray * static_cast<FeatureScalar>(a);
+        }
+    }
+    else
+    {
+        // Scalar reference implementation
+        for (int y = 0; y < height; ++y)
+        {
+            const int yp = min(y + 1, height - 1);
+            const int ym = max(y - 1, 0);
+            
+            const uint8_t * linep = reinterpret_cast<const uint8_t *>(image.scanLine(yp));
+            const uint8_t * line = reinterpret_cast<const uint8_t *>(image.scanLine(y));
+            const uint8_t * linem = reinterpret_cast<const uint8_t *>(image.scanLine(ym));
             
-            // Bilinear interpolation
-            const int theta0 = theta;
-            const int theta1 = (theta0 < 17) ? (theta0 + 1) : 0;
-            const FeatureScalar magnitude1 = magnitude * (theta - theta0);
-            interpolate(x + padCells.width, y + padCells.height,
-                        theta0, theta1, magnitude - magnitude1, magnitude1,
-                        cellSize, feat);
+            for (int x = 0; x < width; ++x)
+            {
+                int bin0, bin1;
+                FeatureScalar magnitude0, magnitude1;
+                gradient(linem, line, linep, x, width, depth, bin0, bin1, magnitude0, magnitude1);
+                
+                // Bilinear interpolation
+                interpolate(x + padCells.width, y + padCells.height,
+                            bin0, bin1, magnitude0, magnitude1,
+                            cellSize, feat);
+            }
         }
     }
+}
+
+
+// Normalizes histograms computed by computeHistograms() and computes the final HOG features in-place
+static void normalizeHistograms(FeatureMatrix & feat, const Size & padding)
+{
+    // Normalize the histograms and compute the final features in a single pass over the rows of cells.
+    // The "gradient energy" ||C(i,j)||^2 of the rows above and below the current one as well as the
+    // normalization factors of the 2x2 blocks of cells above and below it are kept in rolling buffers.
+    const int rows = feat.rows();
+    const int cols = feat.cols();
+    vector<FeatureScalar> energy(3 * cols), norms(2 * cols);
+    FeatureScalar * normsAbove = &norms[0];
+    FeatureScalar * normsBelow = &norms[cols];
     
-    // Compute the "gradient energy" of each cell, i.e. ||C(i,j)||^2
-    feat.channel(31).setZero();
-    for (int i = 0; i < 9; ++i)
-        feat.channel(31) += (feat.channel(i) + feat.channel(i + 9)).cwiseAbs2();
+    computeEnergy(feat, padding.height - 1, &energy[((padding.height - 1) % 3) * cols]);
+    computeEnergy(feat, padding.height, &energy[(padding.height % 3) * cols]);
+    computeBlockNorms(&energy[((padding.height - 1) % 3) * cols], &energy[(padding.height % 3) * cols], cols, normsAbove);
     
-    // Compute the four normalization factors then normalize and clamp everything
-    const FeatureScalar EPS = numeric_limits<FeatureScalar>::epsilon();
-    for (int y = padding.height; y < feat.rows() - padding.height; ++y)
-        for (int x = padding.width; x < feat.cols() - padding.width; ++x)
+    // Truncation features of the top padding
+    for (int y = 0; y < padding.height; ++y)
+        for (int x = 0; x < cols; ++x)
+            truncate(feat, y, x);
+    
+    for (int y = padding.height; y < rows - padding.height; ++y)
+    {
+        computeEnergy(feat, y + 1, &energy[((y + 1) % 3) * cols]);
+        computeBlockNorms(&energy[(y % 3) * cols], &energy[((y + 1) % 3) * cols], cols, normsBelow);
+        
+        for (int x = 0; x < padding.width; ++x)
+            truncate(feat, y, x);
+        
+        for (int x = padding.width; x < cols - padding.width; ++x)
         {
+            FeatureScalar * cell = &feat(y, x, 0);
+            
             // Normalization factors
-            const FeatureScalar n0 = 1 / sqrt(feat(y - 1, x - 1, 31) +
-                                              feat(y - 1, x    , 31) +
-                                              feat(y    , x - 1, 31) +
-                                              feat(y    , x    , 31) + EPS);
-            const FeatureScalar n1 = 1 / sqrt(feat(y - 1, x    , 31) +
-                                              feat(y - 1, x + 1, 31) +
-                                              feat(y    ,     x, 31) +
-                                              feat(y    , x + 1, 31) + EPS);
-            const FeatureScalar n2 = 1 / sqrt(feat(y    , x - 1, 31) +
-                                              feat(y    , x    , 31) +
-                                              feat(y + 1, x - 1, 31) +
-                                              feat(y + 1, x    , 31) + EPS);
-            const FeatureScalar n3 = 1 / sqrt(feat(y    , x    , 31) +
-                                              feat(y    , x + 1, 31) +
-                                              feat(y + 1, x    , 31) +
-                                              feat(y + 1, x + 1, 31) + EPS);
+            const FeatureScalar n0 = normsAbove[x - 1];
+            const FeatureScalar n1 = normsAbove[x];
+            const FeatureScalar n2 = normsBelow[x - 1];
+            const FeatureScalar n3 = normsBelow[x];
             
             // Contrast-insensitive features
             for (int i = 0; i < 9; ++i)
             {
-                const FeatureScalar sum = feat(y, x, i) + feat(y, x, i + 9);
+                const FeatureScalar sum = cell[i] + cell[i + 9];
                 const FeatureScalar h0 = min(sum * n0, FeatureScalar(0.2));
                 const FeatureScalar h1 = min(sum * n1, FeatureScalar(0.2));
                 const FeatureScalar h2 = min(sum * n2, FeatureScalar(0.2));
                 const FeatureScalar h3 = min(sum * n3, FeatureScalar(0.2));
-                feat(y, x, i + 18) = (h0 + h1 + h2 + h3) * FeatureScalar(0.5);
+                cell[i + 18] = (h0 + h1 + h2 + h3) * FeatureScalar(0.5);
             }
             
             // Contrast-sensitive features
             FeatureScalar t0 = 0, t1 = 0, t2 = 0, t3 = 0;
             for (int i = 0; i < 18; ++i)
             {
-                const FeatureScalar sum = feat(y, x, i);
+                const FeatureScalar sum = cell[i];
                 const FeatureScalar h0 = min(sum * n0, FeatureScalar(0.2));
                 const FeatureScalar h1 = min(sum * n1, FeatureScalar(0.2));
                 const FeatureScalar h2 = min(sum * n2, FeatureScalar(0.2));
                 const FeatureScalar h3 = min(sum * n3, FeatureScalar(0.2));
-                feat(y, x, i) = (h0 + h1 + h2 + h3) * FeatureScalar(0.5);
+                cell[i] = (h0 + h1 + h2 + h3) * FeatureScalar(0.5);
                 t0 += h0;
                 t1 += h1;
                 t2 += h2;
@@ -330,22 +637,59 @@ void HOGFeatureExtractor::HOG(const JPEGImage & image, FeatureMatrix & feat, con
             }
             
             // Texture features
-            feat(y, x, 27) = t0 * FeatureScalar(0.2357);
-            feat(y, x, 28) = t1 * FeatureScalar(0.2357);
-            feat(y, x, 29) = t2 * FeatureScalar(0.2357);
-            feat(y, x, 30) = t3 * FeatureScalar(0.2357);
+            cell[27] = t0 * FeatureScalar(0.2357);
+            cell[28] = t1 * FeatureScalar(0.2357);
+            cell[29] = t2 * FeatureScalar(0.2357);
+            cell[30] = t3 * FeatureScalar(0.2357);
+            
+            // Truncation feature
+            cell[31] = 0;
         }
+        
+        for (int x = cols - padding.width; x < cols; ++x)
+            truncate(feat, y, x);
+        
+        swap(normsAbove, normsBelow);
+    }
     
-    // Truncation features
-    for (int y = 0; y < feat.rows(); ++y)
-        for (int x = 0; x < feat.cols(); ++x)
-        {
-            if (y < padding.height || y >= feat.rows() - padding.height || x < padding.width || x >= feat.cols() - padding.width)
-            {
-                feat(y, x).setZero();
-                feat(y, x, 31) = 1;
-            }
-            else
-                feat(y, x, 31) = 0;
-        }
-}
\ No newline at end of file
+    // Truncation features of the bottom padding
+    for (int y = rows - padding.height; y < rows; ++y)
+        for (int x = 0; x < cols; ++x)
+            truncate(feat, y, x);
+}
+
+
+void HOGFeatureExtractor::HOG(const ImageView & image, FeatureMatrix & feat, const Size & padding, const Size & cellSize, bool simd)
+{
+    computeHistograms(image, feat, padding, cellSize, simd);
+    normalizeHistograms(feat, padding);
+}
+
+
+void HOGFeatureExtractor::computeChannels(const ImageView & img, FeatureMatrix & channels, const Size & cellSize) const
+{
+    FeatureMatrix hist;
+    computeHistograms(img, hist, Size(1, 1), (cellSize.width > 0 && cellSize.height > 0) ? cellSize : this->cellSize(), true);
+    channels = FeatureMatrix(hist.rows(), hist.cols(), 18);
+    channels.asCellMatrix() = hist.asCellMatrix().leftCols(18);
+}
+
+
+void HOGFeatureExtractor::channelsToFeatures(const FeatureMatrix & channels, FeatureMatrix & feat) const
+{
+    assert(channels.channels() == 18);
+    feat = FeatureMatrix(channels.rows(), channels.cols(), 32);
+    feat.asCellMatrix().leftCols(18) = channels.asCellMatrix();
+    feat.asCellMatrix().rightCols(14).setZero();
+    normalizeHistograms(feat, Size(1, 1));
+    if (feat.rows() > 2 && feat.cols() > 2)
+        feat.crop(1, 1, feat.rows() - 2, feat.cols() - 2); // cut off padding
+}
+
+
+FeatureScalar HOGFeatureExtractor::channelScalingExponent() const
+{
+    // Dollar et al. measured a value of approximately 0.1 for gradient histograms on natural images.
+    // Since histograms are block-normalized afterwards, the exact value is of minor importance.
+    return 0.1f;
+}
@@ -74,6 +74,12 @@ public:
     */
     virtual bool supportsVariableCellSize() const override;
     
+    /**
+    * @return Always returns true, since the unnormalized histograms of oriented gradients can be
+    * resampled to approximate the features of other scales.
+    */
+    virtual bool supportsChannelApproximation() const override { return true; };
+    
     /**
     * Converts a width and height given in pixels to cells.
     *
@@ -92,6 +98,17 @@ public:
     * It will be resized to fit the number of cells in the given image.
     */
     virtual void extract(const JPEGImage & img, FeatureMatrix & feat) const override
+    { this->extract(ImageView(img), feat, this->cellSize()); };
+    
+    /**
+    * Computes HOG features for an image given by a view on pixels owned by someone else without copying them.
+    *
+    * @param[in] img The image to compute HOG features for.
+    *
+    * @param[out] feat Destination matrix to store the extracted features in.
+    * It will be resized to fit the number of cells in the given image.
+    */
+    virtual void extract(const ImageView & img, FeatureMatrix & feat) const override
     { this->extract(img, feat, this->cellSize()); };
     
     /**
@@ -108,7 +125,61 @@ public:
     *
     * @param[in] cellSize The size of the feature cells.
     */
-    virtual void extract(const JPEGImage & img, FeatureMatrix & feat, const Size & cellSize) const override;
+    virtual void extract(const JPEGImage & img, FeatureMatrix & feat, const Size & cellSize) const override
+    { this->extract(ImageView(img), feat, cellSize); };
+    
+    /**
+    * Computes HOG features for an image given by a view on pixels owned by someone else using a non-default cell size.
+    *
+    * @param[in] img The image to compute HOG features for.
+    *
+    * @param[out] feat Destination matrix to store the extracted features in.
+    * It will be resized to fit the number of cells in the given image.
+    *
+    * @param[in] cellSize The size of the feature cells.
+    */
+    virtual void extract(const ImageView & img, FeatureMatrix & feat, const Size & cellSize) const override;
+    
+    /**
+    * Computes the unnormalized histograms of oriented gradients of an image, which can be normalized
+    * by channelsToFeatures() to obtain HOG features.
+    *
+    * @param[in] img The image to compute the histograms for.
+    *
+    * @param[out] channels Destination matrix to store the 18 contrast-sensitive histogram bins of each cell in.
+    * It will have a border of one cell along each side.
+    *
+    * @param[in] cellSize The size of the cells. If any dimension is 0, the default cell size will be used.
+    */
+    virtual void computeChannels(const JPEGImage & img, FeatureMatrix & channels, const Size & cellSize) const override
+    { this->computeChannels(ImageView(img), channels, cellSize); };
+    
+    /**
+    * Computes the unnormalized histograms of oriented gradients of an image given by a view on pixels
+    * owned by someone else.
+    *
+    * @param[in] img The image to compute the histograms for.
+    *
+    * @param[out] channels Destination matrix to store the 18 contrast-sensitive histogram bins of each cell in.
+    * It will have a border of one cell along each side.
+    *
+    * @param[in] cellSize The size of the cells. If any dimension is 0, the default cell size will be used.
+    */
+    virtual void computeChannels(const ImageView & img, FeatureMatrix & channels, const Size & cellSize) const override;
+    
+    /**
+    * Normalizes histograms of oriented gradients computed by computeChannels() and derives HOG features from them.
+    *
+    * @param[in] channels The histograms obtained from computeChannels() or resampled from such.
+    *
+    * @param[out] feat Destination matrix to store the HOG features in.
+    */
+    virtual void channelsToFeatures(const FeatureMatrix & channels, FeatureMatrix & feat) const override;
+    
+    /**
+    * @return Returns the exponent of the power law relating histograms of oriented gradients across scales.
+    */
+    virtual FeatureScalar channelScalingExponent() const override;
     
     /**
     * Transforms a feature matrix into a feature representation of the horizontally flipped image.
@@ -170,8 +241,12 @@ public:
     *
     * @param[in] cellSize The number of pixels in each direction per histogram cell.
     * Each dimension must be a multiple of 2.
+    *
+    * @param[in] simd If set to true, gradients will be computed using SSE2 or AVX2 instructions, depending on
+    * the capabilities of the CPU, if available. Otherwise, the scalar reference implementation will be used,
+    * which yields the same features up to floating point rounding errors.
     */
-    static void HOG(const JPEGImage & image, FeatureMatrix & feat, const Size & padding, const Size & cellSize);
+    static void HOG(const ImageView & image, FeatureMatrix & feat, const Size & padding, const Size & cellSize, bool simd = true);
 
 
 private:
@@ -24,6 +24,11 @@ namespace ARTOS
 * packed together in an uncompressed (!) Tar archive which is located at
 * `<repoDirectory>/Annotation/<synsetId>.tar`.
 *
+* When a file is looked up in one of these archives for the first time, an index of the archive
+* mapping filenames to offsets is loaded from `<synsetId>.tar.idx` next to the archive, or created
+* there if it is missing or outdated (see TarExtractor::findFileInArchive()), so that images and
+* annotations can be accessed randomly without scanning the archive.
+*
 * Last, but not least, the synset list file should be located at `<repoDirectory>/synset_wordlist.txt`
 * and contains one record per line consisting of the synsets id, followed by a space and a list of
 * words or phrases describing the synset (e. g. "n02119789 kit fox, Vulpes macrotis").
@@ -91,18 +91,16 @@ bool SynsetImage::loadBoundingBoxes()
         // Search for the annotation file in the annotations tar archive and extract it
         string tarFilename = this->m_synsetId + ".tar";
         string tarPath = join_path(3, this->m_repoDir.c_str(), IMAGENET_ANNOTATION_DIR, tarFilename.c_str());
-        TarExtractor tar(tarPath);
-        TarFileInfo info;
+        TarFileInfo info = TarExtractor::findFileInArchive(tarPath, this->m_filename,
+                                                           TarExtractor::IGNORE_FILE_EXT | TarExtractor::IGNORE_DIRECTORY);
         char * xmlData = NULL;
-        uint64_t bufsize;
-        do
+        uint64_t bufsize = 0;
+        if (info.type == tft_file)
         {
-            info = tar.readHeader();
-            if (info.type == tft_file && strip_file_extension(extract_basename(info.filename)) == this->m_filename)
-                xmlData = tar.extract(bufsize);
+            TarExtractor tar(tarPath);
+            xmlData = tar.extract(info.index, bufsize);
+            tar.close();
         }
-        while (xmlData == NULL && tar.nextFile());
-        tar.close();
         
         this->loadBoundingBoxes(xmlData, bufsize);
         if (xmlData != NULL)
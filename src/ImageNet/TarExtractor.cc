@@ -1,33 +1,54 @@
 #include "TarExtractor.h"
 #include <cstdlib>
+#include <cstdio>
 #include <map>
+#include <mutex>
+#include <sstream>
+#include <algorithm>
+#include <thread>
+#include <functional>
 #include "sysutils.h"
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
 using namespace ARTOS;
 using namespace std;
 
 typedef map<string, TarFileInfo> FileInfoMap;
-typedef map<string, FileInfoMap> ArchiveFileInfoMap;
-typedef map<unsigned int, ifstream::pos_type> FileOffsetMap;
-typedef map<string, FileOffsetMap> ArchiveFileOffsetMap;
 
 /**
-* Map of caches (also maps) for file and directory information in Tar archives
-* used by TarExtractor::findFile() and TarExtractor::findFileInArchive().
+* Information about all records in a Tar archive, which is read from an index file stored next
+* to the archive or created by walking through the archive once.
 */
-static ArchiveFileInfoMap fileInfoCache;
+typedef struct {
+    vector<TarFileInfo> files; /**< Files, directories etc. in the archive, sorted by their index. */
+    map<unsigned int, FileInfoMap> lookup; /**< Lookup tables by name, built on demand for each combination of findFile() flags. */
+} ArchiveIndex;
+
+typedef map<string, ArchiveIndex> ArchiveIndexMap;
 
 /**
-* Map of caches (also maps) for file information in Tar archives (ignoring file extensions)
-* used by TarExtractor::findFile() and TarExtractor::findFileInArchive().
+* Map of indices of Tar archives used by TarExtractor::findFile(), TarExtractor::findFileInArchive()
+* and TarExtractor::seekFile(), so that files can be located without having to walk through the
+* entire archive sequentially.
 */
-static ArchiveFileInfoMap fileInfoCache_noExt;
+static ArchiveIndexMap indexCache;
 
 /**
-* Map of caches (also maps), which store the stream offset for file indices in Tar archives
-* for faster use of the TarExtractor::seekFile() method without having to walk through the
-* entire archive sequentially.
+* Protects indexCache, since images may be loaded from several threads concurrently.
+*/
+static mutex indexCacheMutex;
+
+/**
+* Version identifier written to the first line of index files.
 */
-static ArchiveFileOffsetMap fileOffsetCache;
+static const char * const indexFileMagic = "ARTOS-TARINDEX 1";
+
+const char * const TarExtractor::indexFileExtension = ".idx";
 
 /**
 * Converts an octal number string from a Tar file header to an uint64_t.
@@ -42,6 +63,124 @@ static uint64_t tar_octal_to_uint64(const char * tar_octal, size_t len)
     return strtoull(num_str, NULL, 8);
 }
 
+/**
+* Reads the index of a Tar archive from a file written by writeIndexFile().
+*
+* @return Returns false if the index file does not exist, is invalid or does not belong to
+* an archive with the given size and modification time.
+*/
+static bool readIndexFile(const string & indexFilename, const uint64_t tarSize, const uint64_t tarMtime, vector<TarFileInfo> & files)
+{
+    ifstream indexFile(indexFilename.c_str());
+    string line;
+    if (!indexFile.is_open() || !getline(indexFile, line) || line != indexFileMagic)
+        return false;
+    
+    uint64_t size, mtime;
+    if (!getline(indexFile, line) || !(istringstream(line) >> size >> mtime) || size != tarSize || mtime != tarMtime)
+        return false;
+    
+    TarFileInfo info;
+    long long offset;
+    int type;
+    files.clear();
+    while (getline(indexFile, line))
+    {
+        // Format: index, offset, file size, mtime and type separated by spaces, followed by a tab and the filename
+        size_t sep = line.find('\t');
+        if (sep == string::npos || !(istringstream(line.substr(0, sep)) >> info.index >> offset >> info.filesize >> info.mtime >> type)
+                || type < 0 || type > tft_unknown)
+            return false;
+        info.offset = static_cast<streamoff>(offset);
+        info.type = static_cast<TarFileType>(type);
+        info.filename = line.substr(sep + 1);
+        files.push_back(info);
+    }
+    return !indexFile.bad();
+}
+
+/**
+* Writes the index of a Tar archive to a file.
+* The index is written to a temporary file first, which is renamed afterwards, so that other processes
+* never read an incomplete index. The name of the temporary file is unique for each process and thread,
+* since several of them may be building the index of the same archive at the same time.
+* Failures (e.g. due to a read-only repository) are silently ignored.
+*/
+static void writeIndexFile(const string & indexFilename, const uint64_t tarSize, const uint64_t tarMtime, const vector<TarFileInfo> & files)
+{
+    ostringstream tmpFilenameStream;
+    tmpFilenameStream << indexFilename << '.' << getpid() << '.' << hash<thread::id>()(this_thread::get_id()) << ".tmp";
+    string tmpFilename = tmpFilenameStream.str();
+    ofstream indexFile(tmpFilename.c_str(), ofstream::out | ofstream::trunc);
+    if (!indexFile.is_open())
+        return;
+    indexFile << indexFileMagic << '\n' << tarSize << ' ' << tarMtime << '\n';
+    for (vector<TarFileInfo>::const_iterator it = files.begin(); it != files.end(); it++)
+        indexFile << it->index << ' ' << static_cast<long long>(static_cast<streamoff>(it->offset)) << ' '
+                  << it->filesize << ' ' << it->mtime << ' ' << static_cast<int>(it->type) << '\t' << it->filename << '\n';
+    indexFile.close();
+    if (indexFile.fail() || rename(tmpFilename.c_str(), indexFilename.c_str()) != 0)
+        remove(tmpFilename.c_str());
+}
+
+/**
+* Returns the index of a Tar archive, which will be read from the index file stored next to the
+* archive or created and stored there if it is missing or outdated. Indices are loaded only once
+* for each archive.
+*
+* @param[in] tarfilename The path of the Tar archive.
+*
+* @param[in] lock A lock on indexCacheMutex, which has to be held by the calling thread.
+* It is released while the index is being loaded.
+*
+* @return Returns a pointer to the index, which will remain valid for the lifetime of the
+* program, or NULL if the archive could not be opened.
+*/
+static ArchiveIndex * getArchiveIndex(const string & tarfilename, unique_lock<mutex> & lock)
+{
+    ArchiveIndexMap::iterator cached = indexCache.find(tarfilename);
+    if (cached != indexCache.end())
+        return &(cached->second);
+    
+    lock.unlock();
+    uint64_t tarSize, tarMtime;
+    vector<TarFileInfo> files;
+    if (!file_stats(tarfilename, tarSize, tarMtime))
+    {
+        lock.lock();
+        return NULL;
+    }
+    string indexFilename = tarfilename + TarExtractor::indexFileExtension;
+    if (!readIndexFile(indexFilename, tarSize, tarMtime, files))
+    {
+        // Walk through the archive once and store the index for later use
+        TarExtractor tar(tarfilename);
+        if (!tar.isOpen())
+        {
+            lock.lock();
+            return NULL;
+        }
+        files.clear();
+        tar.listFiles(files);
+        tar.close();
+        writeIndexFile(indexFilename, tarSize, tarMtime, files);
+    }
+    lock.lock();
+    
+    ArchiveIndex & index = indexCache[tarfilename];
+    if (index.files.empty())
+        index.files.swap(files);
+    return &index;
+}
+
+/**
+* Comparison function for searching file records by index.
+*/
+static bool fileIndexLess(const TarFileInfo & info, const unsigned int fileIndex)
+{
+    return info.index < fileIndex;
+}
+
 
 
 void TarExtractor::open(const string & tarfilename)
@@ -84,30 +223,7 @@ void TarExtractor::listFiles(std::vector<TarFileInfo> & fileinfo, const TarFileT
 
 TarFileInfo TarExtractor::findFile(string filename, const unsigned int flags)
 {
-    if (flags & TarExtractor::IGNORE_FILE_EXT)
-        filename = strip_file_extension(filename);
-    
-    // Search for cache
-    ArchiveFileInfoMap * cache = (flags & TarExtractor::IGNORE_FILE_EXT) ? &fileInfoCache_noExt : &fileInfoCache;
-    ArchiveFileInfoMap::const_iterator infoCache = cache->find(this->m_tarPath);
-    if (infoCache == cache->end())
-    {
-        // Create cache if it does not exist
-        this->cacheFileInfo(flags & TarExtractor::IGNORE_FILE_EXT);
-        infoCache = cache->find(this->m_tarPath);
-    }
-    
-    // Search in cache
-    FileInfoMap::const_iterator fileInfo = infoCache->second.find(filename);
-    if (fileInfo != infoCache->second.end())
-        return fileInfo->second;
-    else
-    {
-        TarFileInfo info;
-        info.filename = "";
-        info.type = tft_unknown;
-        return info;
-    }
+    return TarExtractor::findFileInArchive(this->m_tarPath, filename, flags);
 }
 
 TarFileInfo TarExtractor::readHeader()
@@ -220,32 +336,36 @@ bool TarExtractor::nextFile()
     uint64_t padded_filesize = (fsize_overhang == 0) ? info.filesize : info.filesize + 512 - fsize_overhang;
     this->m_tarfile.seekg(512 + padded_filesize, ifstream::cur);
     this->m_fileIndex++;
-    fileOffsetCache[this->m_tarPath][this->m_fileIndex] = this->m_tarfile.tellg();
     return this->good();
 }
 
 bool TarExtractor::seekFile(const unsigned int fileIndex)
 {
-    // Search in cache
-    FileOffsetMap & cache = fileOffsetCache[this->m_tarPath];
-    FileOffsetMap::iterator cacheEntry = cache.find(fileIndex);
-    if (cacheEntry != cache.end())
-    {
-        this->m_tarfile.clear();
-        this->m_tarfile.seekg(cacheEntry->second);
-        this->m_fileIndex = fileIndex;
-        this->m_eof = false;
-        return true;
-    }
-    else
+    // Search in index
+    if (fileIndex > 0)
     {
-        // Search sequentially
-        this->rewind();
-        for (unsigned int i = 0; i < fileIndex; i++)
-            if (!this->nextFile())
-                return false;
-        return true;
+        unique_lock<mutex> lock(indexCacheMutex);
+        const ArchiveIndex * index = getArchiveIndex(this->m_tarPath, lock);
+        if (index != NULL)
+        {
+            vector<TarFileInfo>::const_iterator info = lower_bound(index->files.begin(), index->files.end(), fileIndex, fileIndexLess);
+            if (info != index->files.end() && info->index == fileIndex)
+            {
+                this->m_tarfile.clear();
+                this->m_tarfile.seekg(info->offset - streamoff(headerSize));
+                this->m_fileIndex = fileIndex;
+                this->m_eof = false;
+                return true;
+            }
+        }
     }
+    
+    // Search sequentially
+    this->rewind();
+    for (unsigned int i = 0; i < fileIndex; i++)
+        if (!this->nextFile())
+            return false;
+    return true;
 }
 
 void TarExtractor::rewind()
@@ -256,50 +376,44 @@ void TarExtractor::rewind()
     this->m_eof = false;
 }
 
-void TarExtractor::cacheFileInfo(const bool ignoreExt)
-{
-    FileInfoMap & cache = (ignoreExt) ? fileInfoCache_noExt[this->m_tarPath] : fileInfoCache[this->m_tarPath];
-    vector<TarFileInfo> fileInfo;
-    unsigned int startPos = this->tellIndex();
-    this->listFiles(fileInfo);
-    this->seekFile(startPos);
-    string filename;
-    for (vector<TarFileInfo>::const_iterator it = fileInfo.begin(); it != fileInfo.end(); it++)
-        if (it->type == tft_file || (!ignoreExt && it->type == tft_directory))
-        {
-            filename = (ignoreExt) ? strip_file_extension(it->filename) : it->filename;
-            cache.insert(FileInfoMap::value_type(filename, *it));
-        }
-}
-
-
 TarFileInfo TarExtractor::findFileInArchive(const string & tarfilename, string filename, const unsigned int flags)
 {
     TarFileInfo info;
     info.filename = "";
     info.type = tft_unknown;
     
+    if (flags & TarExtractor::IGNORE_DIRECTORY)
+        filename = extract_basename(filename);
     if (flags & TarExtractor::IGNORE_FILE_EXT)
         filename = strip_file_extension(filename);
     
-    // Search in cache
-    ArchiveFileInfoMap * cache = (flags & TarExtractor::IGNORE_FILE_EXT) ? &fileInfoCache_noExt : &fileInfoCache;
-    ArchiveFileInfoMap::const_iterator infoCache = cache->find(tarfilename);
-    if (infoCache != cache->end())
+    unique_lock<mutex> lock(indexCacheMutex);
+    ArchiveIndex * index = getArchiveIndex(tarfilename, lock);
+    if (index != NULL)
     {
-        FileInfoMap::const_iterator fileInfo = infoCache->second.find(filename);
-        if (fileInfo != infoCache->second.end())
-            info = fileInfo->second;
-    }
-    else
-    {
-        // Initially cache file information in that archive
-        TarExtractor tar(tarfilename);
-        if (tar.isOpen())
+        // Build lookup table for the given flags on first use
+        map<unsigned int, FileInfoMap>::iterator lookup = index->lookup.find(flags);
+        if (lookup == index->lookup.end())
         {
-            info = tar.findFile(filename, flags);
-            tar.close();
+            lookup = index->lookup.insert(make_pair(flags, FileInfoMap())).first;
+            bool filesOnly = (flags & (TarExtractor::IGNORE_FILE_EXT | TarExtractor::IGNORE_DIRECTORY));
+            string name;
+            for (vector<TarFileInfo>::const_iterator it = index->files.begin(); it != index->files.end(); it++)
+                if (it->type == tft_file || (!filesOnly && it->type == tft_directory))
+                {
+                    name = it->filename;
+                    if (flags & TarExtractor::IGNORE_DIRECTORY)
+                        name = extract_basename(name);
+                    if (flags & TarExtractor::IGNORE_FILE_EXT)
+                        name = strip_file_extension(name);
+                    lookup->second.insert(FileInfoMap::value_type(name, *it));
+                }
         }
+        
+        // Search in lookup table
+        FileInfoMap::const_iterator fileInfo = lookup->second.find(filename);
+        if (fileInfo != lookup->second.end())
+            info = fileInfo->second;
     }
     
     return info;
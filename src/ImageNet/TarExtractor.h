@@ -107,6 +107,16 @@ public:
     * Flag that tells findFile() to ignore the file extensions.
     */
     static const unsigned int IGNORE_FILE_EXT = 1;
+    
+    /**
+    * Flag that tells findFile() to ignore the directory part of the filenames in the archive.
+    */
+    static const unsigned int IGNORE_DIRECTORY = 2;
+    
+    /**
+    * Suffix appended to the path of a tar archive to obtain the name of its index file.
+    */
+    static const char * const indexFileExtension;
 
 
     /**
@@ -177,8 +187,7 @@ public:
     /**
     * Searches for information about a file or directory with a given name in the tar archive.
     *
-    * This operation is faster for multiple search requests than iterating over all files in the archive
-    * using nextFile() and readHeader(), since it does this only once and uses an std::map as cache.
+    * This is equivalent to `findFileInArchive(getTarPath(), filename, flags)`.
     *
     * The file position indicator won't be moved by this operation.
     *
@@ -187,6 +196,8 @@ public:
     * @param[in] flags Optionally, a bit-wise combination of one of the following flags:
     *                    - IGNORE_FILE_EXT - If this is set, the file extension will be irrelevant for searching.
     *                                        In this case, only files, but not directories, may be returned.
+    *                    - IGNORE_DIRECTORY - If this is set, only the basenames of the files in the archive will
+    *                                         be compared. In this case, only files, but not directories, may be returned.
     *
     * @return TarFileInfo structure with information about the requested file or directory.
     *         If no file matching `filename` could be found, the `type` member of the structure will be `tft_unknown`.
@@ -268,8 +279,9 @@ public:
     /**
     * Moves the file position indicator to the beginning of a specific file header.
     *
-    * Since tar archives don't provide random access, this operation must rewind the file first
-    * and then move from file header to file header sequentially.
+    * Since tar archives don't provide random access, the position of the file is looked up in the
+    * index of the archive (see findFileInArchive()). Only if the index does not contain the file,
+    * this operation rewinds the file and then moves from file header to file header sequentially.
     *
     * @param[in] fileIndex The index of the file to place the file position indicator before.
     *
@@ -287,9 +299,13 @@ public:
     /**
     * Searches for information about a file or directory with a given name in a specific tar archive.
     *
-    * This operation is faster for multiple search requests than iterating over all files in the archive
-    * using nextFile() and readHeader(), since it does this only once and uses an std::map as cache, so that
-    * the archive doesn't even need to be opened on further search requests.
+    * On the first request for an archive, an index of all files in the archive is loaded from an index file
+    * stored next to the archive (`<tarfilename>.idx`). If there is no such file or if the size or the
+    * modification time of the archive don't match those stored in the index, the archive is walked through
+    * once using nextFile() and readHeader() and the index file is (re-)created, if the directory is writable.
+    * The index is cached in memory, so that further search requests don't even need to open the archive.
+    *
+    * This function is thread-safe.
     *
     * @param[in] tarfilename The path of the Tar archive.
     *
@@ -298,6 +314,8 @@ public:
     * @param[in] flags Optionally, a bit-wise combination of one of the following flags:
     *                    - IGNORE_FILE_EXT - If this is set, the file extension will be irrelevant for searching.
     *                                        In this case, only files, but not directories, may be returned.
+    *                    - IGNORE_DIRECTORY - If this is set, only the basenames of the files in the archive will
+    *                                         be compared. In this case, only files, but not directories, may be returned.
     *
     * @return TarFileInfo structure with information about the requested file or directory.
     *         If no file matching `filename` could be found, the `type` member of the structure will be `tft_unknown`.
@@ -310,16 +328,6 @@ protected:
     std::string m_tarPath; /**< Path to the opened Tar archive (may be empty) */
     unsigned int m_fileIndex; /**< Index of the current file in the tar archive */
     bool m_eof; /**< Indicates if the end of the tar file has been reached, so that there is no more data to be read */
-    
-    /**
-    * Caches information about each file and directory in the archive for use by findFile().
-    * The file position indicator is not moved.
-    *
-    * @param[in] ignoreExt If set to true, the cache for filenames without file extension
-    *                      will be built, otherwise the cache for files and directories including
-    *                      the file extension.
-    */
-    void cacheFileInfo(const bool ignoreExt = false);
 
 };
 
@@ -0,0 +1,147 @@
+#ifndef ARTOS_IMAGEVIEW_H
+#define ARTOS_IMAGEVIEW_H
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+
+namespace ARTOS
+{
+
+class JPEGImage;
+
+/**
+* A non-owning view on the pixels of an image stored in memory owned by someone else, e.g. a
+* frame of a video capture pipeline.
+*
+* Like for JPEGImage, the pixels are stored in row-major order with interleaved channels, but
+* consecutive rows may be separated by an arbitrary number of bytes (the stride), so that views
+* can also refer to padded buffers or to a region of a larger image.
+*
+* The memory the view refers to must remain valid and unmodified as long as the view or any
+* object processing it is used. JPEGImage objects can be converted to an ImageView implicitly.
+*/
+class ImageView
+{
+
+public:
+
+    /**
+    * Constructs an empty view.
+    */
+    ImageView() : m_bits(0), m_width(0), m_height(0), m_depth(0), m_stride(0), m_image(0) {};
+
+    /**
+    * Constructs a view on an image with the given @p width, @p height and @p depth, whose pixels
+    * are stored at the given location.
+    *
+    * @param[in] bits Pointer to the first pixel of the image.
+    *
+    * @param[in] width The width of the image.
+    *
+    * @param[in] height The height of the image.
+    *
+    * @param[in] depth The number of channels of the image (1 for grayscale or 3 for RGB images).
+    *
+    * @param[in] stride The number of bytes between the beginnings of two consecutive rows.
+    * If this is 0 or less than `width * depth`, the rows are assumed to be stored contiguously.
+    *
+    * @param[in] image Optionally, the JPEGImage which the view refers to in its entirety.
+    *
+    * @note The view will be empty if any of the dimensions is not positive or `bits` is a null pointer.
+    */
+    ImageView(const uint8_t * bits, int width, int height, int depth, int stride = 0, const JPEGImage * image = 0)
+    : m_bits(bits), m_width(width), m_height(height), m_depth(depth), m_stride(std::max(stride, width * depth)), m_image(image)
+    {
+        if (bits == 0 || width <= 0 || height <= 0 || depth <= 0)
+            *this = ImageView();
+    };
+
+    /**
+    * @return Returns the width of the image.
+    */
+    int width() const { return this->m_width; };
+
+    /**
+    * @return Returns the height of the image.
+    */
+    int height() const { return this->m_height; };
+
+    /**
+    * @return Returns the depth of the image, i.e. the number of color channels.
+    */
+    int depth() const { return this->m_depth; };
+
+    /**
+    * @return Returns the number of bytes between the beginnings of two consecutive rows.
+    */
+    int stride() const { return this->m_stride; };
+
+    /**
+    * @return Returns a pointer to the first pixel of the image or a null pointer if the view is empty.
+    */
+    const uint8_t * bits() const { return this->m_bits; };
+
+    /**
+    * @return Returns a pointer to the pixels of the row with index @p y.
+    * Returns a null pointer if the view is empty or if y is out of bounds.
+    */
+    const uint8_t * scanLine(int y) const
+    { return (y >= 0 && y < this->m_height) ? this->m_bits + static_cast<std::ptrdiff_t>(y) * this->m_stride : 0; };
+
+    /**
+    * @return Returns true if the rows of the image are stored contiguously without any padding.
+    */
+    bool isContiguous() const { return this->m_stride == this->m_width * this->m_depth; };
+
+    /**
+    * @return Returns true if the view is empty. An empty view has zero size.
+    */
+    bool empty() const { return (this->m_width <= 0 || this->m_height <= 0); };
+
+    /**
+    * @return Returns a pointer to the JPEGImage which this view refers to in its entirety, e.g. if it
+    * has been obtained by converting a JPEGImage, or a null pointer if there is no such image.
+    */
+    const JPEGImage * image() const { return this->m_image; };
+
+    /**
+    * Returns a view on a region of the image without copying any pixels.
+    * The region is clipped to the boundaries of the image.
+    *
+    * @param[in] x The horizontal offset of the region.
+    *
+    * @param[in] y The vertical offset of the region.
+    *
+    * @param[in] width The width of the region.
+    *
+    * @param[in] height The height of the region.
+    *
+    * @return Returns a view on the region, which will be empty if the region does not overlap the image.
+    */
+    ImageView crop(int x, int y, int width, int height) const
+    {
+        const int x1 = std::min(x + width, this->m_width), y1 = std::min(y + height, this->m_height);
+        x = std::max(x, 0);
+        y = std::max(y, 0);
+        if (x >= x1 || y >= y1)
+            return ImageView();
+        return ImageView(this->scanLine(y) + x * this->m_depth, x1 - x, y1 - y, this->m_depth, this->m_stride,
+                         (x == 0 && y == 0 && x1 - x == this->m_width && y1 - y == this->m_height) ? this->m_image : 0);
+    };
+
+
+protected:
+
+    const uint8_t * m_bits;
+    int m_width;
+    int m_height;
+    int m_depth;
+    int m_stride;
+    const JPEGImage * m_image;
+
+};
+
+}
+
+#endif
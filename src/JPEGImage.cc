@@ -21,8 +21,16 @@
 #include "JPEGImage.h"
 
 #include <algorithm>
+#include <map>
+#include <mutex>
+#include <tuple>
 #include <utility>
 
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__)) && !defined(ARTOS_NO_SIMD)
+#define ARTOS_JPEGIMAGE_SIMD
+#include <immintrin.h>
+#endif
+
 extern "C" {
 #include <jpeglib.h>
 }
@@ -49,6 +57,20 @@ height_(0), depth_(0)
         copy(bits, bits + bits_.size(), bits_.begin());
 }
 
+JPEGImage::JPEGImage(const ImageView & view) : width_(0), height_(0), depth_(0)
+{
+    if (view.empty())
+        return;
+    
+    width_ = view.width();
+    height_ = view.height();
+    depth_ = view.depth();
+    bits_.resize(width_ * height_ * depth_);
+    
+    for (int y = 0; y < height_; ++y)
+        copy(view.scanLine(y), view.scanLine(y) + width_ * depth_, bits_.begin() + y * width_ * depth_);
+}
+
 JPEGImage::JPEGImage(const string & filename) : width_(0), height_(0), depth_(0)
 {
     // Load the image
@@ -57,72 +79,92 @@ JPEGImage::JPEGImage(const string & filename) : width_(0), height_(0), depth_(0)
     if (!file)
         return;
     
-    jpeg_decompress_struct cinfo;
-    jpeg_error_mgr jerr;
+    Decode(file, 1, *this);
     
-    cinfo.err = jpeg_std_error(&jerr);
-    jpeg_create_decompress(&cinfo);
-    jpeg_stdio_src(&cinfo, file);
+    fclose(file);
+}
+
+JPEGImage::JPEGImage(FILE * filehandle) : width_(0), height_(0), depth_(0)
+{
+    if (!filehandle)
+        return;
     
-    if ((jpeg_read_header(&cinfo, TRUE) != JPEG_HEADER_OK) || (cinfo.data_precision != 8) ||
-        !jpeg_start_decompress(&cinfo)) {
-        fclose(file);
-        jpeg_destroy_decompress(&cinfo);
+    Decode(filehandle, 1, *this);
+}
+
+JPEGImage::JPEGImage(const string & filename, int scaleDenom) : width_(0), height_(0), depth_(0)
+{
+    if ((scaleDenom != 1) && (scaleDenom != 2) && (scaleDenom != 4) && (scaleDenom != 8))
         return;
-    }
     
-    vector<uint8_t> bits(cinfo.image_width * cinfo.image_height * cinfo.num_components);
+    FILE * file = fopen(filename.c_str(), "rb");
     
-    for (int y = 0; y < cinfo.image_height; ++y) {
-        JSAMPLE * row = static_cast<JSAMPLE *>(&bits[y * cinfo.image_width * cinfo.num_components]);
-        
-        if (jpeg_read_scanlines(&cinfo, &row, 1) != 1) {
-            fclose(file);
-            jpeg_abort_decompress(&cinfo);
-            jpeg_destroy_decompress(&cinfo);
-            return;
-        }
-    }
+    if (!file)
+        return;
     
-    jpeg_finish_decompress(&cinfo);
-    jpeg_destroy_decompress(&cinfo);
+    Decode(file, scaleDenom, *this);
     
     fclose(file);
-    
-    // Recopy everyting if the loading was successful
-    width_ = cinfo.image_width;
-    height_ = cinfo.image_height;
-    depth_ = cinfo.num_components;
-    bits_.swap(bits);
 }
 
-JPEGImage::JPEGImage(FILE * filehandle) : width_(0), height_(0), depth_(0)
+JPEGImage JPEGImage::ReadWithOctaves(const string & filename, int numOctaves)
 {
-    if (!filehandle)
-        return;
+    JPEGImage result;
+    FILE * file = fopen(filename.c_str(), "rb");
+    
+    if (!file)
+        return result;
+    
+    // Decode the stream again for each octave, which is still cheaper than resizing the image,
+    // since the inverse DCT and the colour conversion are performed at the reduced size only
+    if (Decode(file, 1, result)) {
+        shared_ptr< vector<JPEGImage> > octaves = make_shared< vector<JPEGImage> >();
+        for (int i = 1; i <= min(numOctaves, 3); ++i) {
+            JPEGImage octave;
+            if ((fseek(file, 0, SEEK_SET) != 0) || !Decode(file, 1 << i, octave) || (octave.depth_ != result.depth_))
+                break;
+            octaves->push_back(move(octave));
+        }
+        if (!octaves->empty())
+            result.octaves_ = octaves;
+    }
     
+    fclose(file);
+    return result;
+}
+
+bool JPEGImage::Decode(FILE * file, int scaleDenom, JPEGImage & image)
+{
     jpeg_decompress_struct cinfo;
     jpeg_error_mgr jerr;
     
     cinfo.err = jpeg_std_error(&jerr);
     jpeg_create_decompress(&cinfo);
-    jpeg_stdio_src(&cinfo, filehandle);
+    jpeg_stdio_src(&cinfo, file);
     
-    if ((jpeg_read_header(&cinfo, TRUE) != JPEG_HEADER_OK) || (cinfo.data_precision != 8) ||
-        !jpeg_start_decompress(&cinfo)) {
+    if (jpeg_read_header(&cinfo, TRUE) != JPEG_HEADER_OK) {
         jpeg_destroy_decompress(&cinfo);
-        return;
+        return false;
+    }
+    
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = scaleDenom;
+    
+    if ((cinfo.data_precision != 8) || !jpeg_start_decompress(&cinfo)) {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
     }
     
-    vector<uint8_t> bits(cinfo.image_width * cinfo.image_height * cinfo.num_components);
+    // The output dimensions are rounded up by libjpeg
+    vector<uint8_t> bits(cinfo.output_width * cinfo.output_height * cinfo.output_components);
     
-    for (int y = 0; y < cinfo.image_height; ++y) {
-        JSAMPLE * row = static_cast<JSAMPLE *>(&bits[y * cinfo.image_width * cinfo.num_components]);
+    for (int y = 0; y < cinfo.output_height; ++y) {
+        JSAMPLE * row = static_cast<JSAMPLE *>(&bits[y * cinfo.output_width * cinfo.output_components]);
         
         if (jpeg_read_scanlines(&cinfo, &row, 1) != 1) {
             jpeg_abort_decompress(&cinfo);
             jpeg_destroy_decompress(&cinfo);
-            return;
+            return false;
         }
     }
     
@@ -130,13 +172,16 @@ JPEGImage::JPEGImage(FILE * filehandle) : width_(0), height_(0), depth_(0)
     jpeg_destroy_decompress(&cinfo);
     
     // Recopy everyting if the loading was successful
-    width_ = cinfo.image_width;
-    height_ = cinfo.image_height;
-    depth_ = cinfo.num_components;
-    bits_.swap(bits);
+    image.width_ = cinfo.output_width;
+    image.height_ = cinfo.output_height;
+    image.depth_ = cinfo.output_components;
+    image.bits_.swap(bits);
+    image.octaves_.reset();
+    return true;
 }
 
-JPEGImage::JPEGImage(JPEGImage && other) : width_(other.width_), height_(other.height_), depth_(other.depth_), bits_(std::move(other.bits_))
+JPEGImage::JPEGImage(JPEGImage && other) : width_(other.width_), height_(other.height_), depth_(other.depth_), bits_(std::move(other.bits_)),
+octaves_(std::move(other.octaves_))
 {
     other.width_ = other.height_ = other.depth_ = 0;
 }
@@ -147,10 +192,16 @@ JPEGImage & JPEGImage::operator=(JPEGImage && other)
     height_ = other.height_;
     depth_ = other.depth_;
     bits_ = std::move(other.bits_);
+    octaves_ = std::move(other.octaves_);
     other.width_ = other.height_ = other.depth_ = 0;
     return *this;
 }
 
+JPEGImage::operator ImageView() const
+{
+    return ImageView(bits(), width_, height_, depth_, width_ * depth_, this);
+}
+
 int JPEGImage::width() const
 {
     return width_;
@@ -173,6 +224,7 @@ const uint8_t * JPEGImage::bits() const
 
 uint8_t * JPEGImage::bits()
 {
+    octaves_.reset();
     return empty() ? 0 : &bits_[0];
 }
 
@@ -183,11 +235,13 @@ const uint8_t * JPEGImage::scanLine(int y) const
 
 uint8_t * JPEGImage::scanLine(int y)
 {
+    octaves_.reset();
     return (empty() || (y >= height_)) ? 0 : &bits_[y * width_ * depth_];
 }
 
 FeatureMatrix_<uint8_t> JPEGImage::toMatrix()
 {
+    octaves_.reset();
     return FeatureMatrix_<uint8_t>(empty() ? nullptr : &bits_[0], height_, width_, depth_);
 }
 
@@ -196,6 +250,12 @@ const FeatureMatrix_<uint8_t> JPEGImage::toMatrix() const
     return FeatureMatrix_<uint8_t>(empty() ? nullptr : const_cast<uint8_t*>(&bits_[0]), height_, width_, depth_);
 }
 
+const vector<JPEGImage> & JPEGImage::octaves() const
+{
+    static const vector<JPEGImage> noOctaves;
+    return (octaves_) ? *octaves_ : noOctaves;
+}
+
 bool JPEGImage::empty() const
 {
     return (width() <= 0) || (height() <= 0) || (depth() <= 0);
@@ -238,54 +298,127 @@ void JPEGImage::save(const string & filename, int quality) const
 }
 
 JPEGImage JPEGImage::resize(int width, int height) const
+{
+    JPEGImage result;
+    resize(width, height, octaves(), result);
+    return result;
+}
+
+void JPEGImage::resize(int width, int height, JPEGImage & result) const
+{
+    resize(width, height, octaves(), result);
+}
+
+void JPEGImage::resize(int width, int height, const vector<JPEGImage> & octaves, JPEGImage & result) const
+{
+    Scale(*this, width, height, octaves, result);
+}
+
+void JPEGImage::Scale(const ImageView & view, int width, int height, const vector<JPEGImage> & octaves, JPEGImage & result)
 {
     // Empty image
-    if ((width <= 0) || (height <= 0))
-        return JPEGImage();
+    if ((width <= 0) || (height <= 0) || view.empty()) {
+        result.width_ = result.height_ = result.depth_ = 0;
+        result.bits_.clear();
+        result.octaves_.reset();
+        return;
+    }
     
     // Same dimensions
-    if ((width == width_) && (height == height_))
-        return *this;
+    if ((width == view.width()) && (height == view.height())) {
+        if (view.image() != &result)
+            result = (view.image()) ? *view.image() : JPEGImage(view);
+        return;
+    }
     
-    JPEGImage result;
+    // The source must not be overwritten while being read
+    if (!result.bits_.empty() && (view.bits() >= &result.bits_[0]) && (view.bits() < &result.bits_[0] + result.bits_.size())) {
+        JPEGImage tmp;
+        Scale(view, width, height, octaves, tmp);
+        result = move(tmp);
+        return;
+    }
+    
+    // Downscale the smallest octave which is large enough
+    if (!octaves.empty() && (width <= octaves[0].width_) && (height <= octaves[0].height_)) {
+        vector<JPEGImage>::const_iterator octave = octaves.begin();
+        while ((octave + 1 != octaves.end()) && (width <= (octave + 1)->width_) && (height <= (octave + 1)->height_))
+            ++octave;
+        Scale(*octave, width, height, vector<JPEGImage>(), result);
+        return;
+    }
     
+    const int depth = view.depth();
     result.width_ = width;
     result.height_ = height;
-    result.depth_ = depth_;
-    result.bits_.resize(width * height * depth_);
-    
-    // Resize the image at each octave
-    int srcWidth = width_;
-    int srcHeight = height_;
-    
-    vector<uint8_t> tmpSrc;
-    vector<uint8_t> tmpDst;
+    result.depth_ = depth;
+    result.bits_.resize(width * height * depth);
+    result.octaves_.reset();
+    
+    // Resize the image at each octave, keeping the intermediate buffers of each thread for reuse
+    static thread_local vector<uint8_t> tmpSrc;
+    static thread_local vector<uint8_t> tmpDst;
+    const uint8_t * src = view.bits();
+    int srcWidth = view.width();
+    int srcHeight = view.height();
+    int srcStride = view.stride();
     
     float scale = 0.5f;
-    int halfWidth = width_ * scale + 0.5f;
-    int halfHeight = height_ * scale + 0.5f;
+    int halfWidth = view.width() * scale + 0.5f;
+    int halfHeight = view.height() * scale + 0.5f;
     
     while ((width <= halfWidth) && (height <= halfHeight)) {
-        if (tmpDst.empty())
-            tmpDst.resize(halfWidth * halfHeight * depth_);
+        tmpDst.resize(halfWidth * halfHeight * depth);
         
-        Resize(tmpSrc.empty() ? &bits_[0] : &tmpSrc[0], srcWidth, srcHeight, &tmpDst[0], halfWidth,
-               halfHeight, depth_);
+        Resize(src, srcWidth, srcHeight, srcStride, &tmpDst[0], halfWidth, halfHeight, depth);
         
         // Dst becomes src
         tmpSrc.swap(tmpDst);
+        src = &tmpSrc[0];
         srcWidth = halfWidth;
         srcHeight = halfHeight;
+        srcStride = halfWidth * depth;
         
         // Next octave
         scale *= 0.5f;
-        halfWidth = width_ * scale + 0.5f;
-        halfHeight = height_ * scale + 0.5f;
+        halfWidth = view.width() * scale + 0.5f;
+        halfHeight = view.height() * scale + 0.5f;
     }
     
-    Resize(tmpSrc.empty() ? &bits_[0] : &tmpSrc[0], srcWidth, srcHeight, &result.bits_[0], width,
-           height, depth_);
+    Resize(src, srcWidth, srcHeight, srcStride, &result.bits_[0], width, height, depth);
+}
+
+vector<JPEGImage> JPEGImage::computeOctaves(int minWidth, int minHeight) const
+{
+    return ComputeOctaves(*this, minWidth, minHeight);
+}
+
+vector<JPEGImage> JPEGImage::ComputeOctaves(const ImageView & view, int minWidth, int minHeight)
+{
+    vector<JPEGImage> result;
+    if (view.empty())
+        return result;
     
+    static const vector<JPEGImage> noOctaves;
+    const vector<JPEGImage> & decoded = (view.image()) ? view.image()->octaves() : noOctaves;
+    float scale = 0.5f;
+    for (size_t i = 0; ; ++i, scale *= 0.5f) {
+        const int width = view.width() * scale + 0.5f;
+        const int height = view.height() * scale + 0.5f;
+        if ((width < max(minWidth, 1)) || (height < max(minHeight, 1)))
+            break;
+        
+        if (i < decoded.size()) {
+            result.push_back(decoded[i]);
+            continue;
+        }
+        
+        // Each octave is obtained from the previous one
+        JPEGImage octave(width, height, view.depth());
+        const ImageView src = (i == 0) ? view : ImageView(result[i - 1]);
+        Resize(src.bits(), src.width(), src.height(), src.stride(), &octave.bits_[0], width, height, view.depth());
+        result.push_back(move(octave));
+    }
     return result;
 }
 
@@ -365,56 +498,275 @@ JPEGImage JPEGImage::cropPadded(int x, int y, int width, int height) const
     return result;
 }
 
-// Bilinear interpolation coefficient
+// Bilinear interpolation coefficients for resampling rows or columns of a given length to another length.
+// Each target element is interpolated from the source elements at two offsets, which for rows take the
+// depth of the image into account, so that all channels of a row are processed as a single sequence.
 namespace ARTOS
 {
 namespace detail
 {
-struct Bilinear
+struct ResampleTable
 {
-    int x0;
-    int x1;
-    float a;
-    float b;
+    vector<int32_t> offset0;
+    vector<int32_t> offset1;
+    vector<float> a; // weight of the element at offset1
+    vector<float> b; // weight of the element at offset0
 };
 }
 }
 
-void JPEGImage::Resize(const uint8_t * src, int srcWidth, int srcHeight, uint8_t * dst,
+static shared_ptr<const detail::ResampleTable> resampleTable(int srcLength, int dstLength, int depth)
+{
+    // The tables are shared by all images, since pyramids of images of the same size use the same scales
+    static mutex cacheMutex;
+    static map< tuple<int, int, int>, shared_ptr<const detail::ResampleTable> > cache;
+    const tuple<int, int, int> key(srcLength, dstLength, depth);
+    {
+        lock_guard<mutex> lock(cacheMutex);
+        map< tuple<int, int, int>, shared_ptr<const detail::ResampleTable> >::const_iterator it = cache.find(key);
+        if (it != cache.end())
+            return it->second;
+    }
+    
+    shared_ptr<detail::ResampleTable> table = make_shared<detail::ResampleTable>();
+    table->offset0.resize(dstLength * depth);
+    table->offset1.resize(dstLength * depth);
+    table->a.resize(dstLength * depth);
+    table->b.resize(dstLength * depth);
+    
+    const float scale = static_cast<float>(srcLength) / dstLength;
+    for (int j = 0; j < dstLength; ++j) {
+        const float x = min(max((j + 0.5f) * scale - 0.5f, 0.0f), srcLength - 1.0f);
+        const int x0 = x;
+        const int x1 = min(x0 + 1, srcLength - 1);
+        for (int k = 0; k < depth; ++k) {
+            table->offset0[j * depth + k] = x0 * depth + k;
+            table->offset1[j * depth + k] = x1 * depth + k;
+            table->a[j * depth + k] = x - x0;
+            table->b[j * depth + k] = 1.0f - (x - x0);
+        }
+    }
+    
+    lock_guard<mutex> lock(cacheMutex);
+    if (cache.size() >= 1024)
+        cache.clear();
+    cache[key] = table;
+    return table;
+}
+
+/*
+* Resampling kernels.
+*
+* resampleRow() interpolates n elements of a row from the given source pointer, of which only the
+* given number of bytes may be read. blendRows() interpolates between two resampled rows and rounds
+* the result. halveRow() averages blocks of 2x2 pixels of two rows, storing the vertical sums of the
+* rows in a temporary buffer. All variants compute exactly the same as the scalar ones.
+* SSE2 and AVX2 variants are compiled independently of the target architecture and the
+* appropriate one is chosen at run-time depending on the capabilities of the CPU.
+*/
+
+typedef void (*ResampleRowKernel)(const uint8_t * src, size_t available, const detail::ResampleTable & table, int n, float * dst);
+typedef void (*BlendRowsKernel)(const float * row0, const float * row1, float w0, float w1, int n, uint8_t * dst);
+typedef void (*HalveRowKernel)(const uint8_t * row0, const uint8_t * row1, int dstWidth, int depth, uint16_t * sums, uint8_t * dst);
+
+static void resampleRow(const uint8_t * src, size_t /*available*/, const detail::ResampleTable & table, int n, float * dst)
+{
+    for (int k = 0; k < n; ++k)
+        dst[k] = src[table.offset0[k]] * table.b[k] + src[table.offset1[k]] * table.a[k];
+}
+
+static void blendRows(const float * row0, const float * row1, float w0, float w1, int n, uint8_t * dst)
+{
+    for (int k = 0; k < n; ++k)
+        dst[k] = row0[k] * w0 + row1[k] * w1 + 0.5f;
+}
+
+static void halveRowTail(const uint16_t * sums, int first, int dstWidth, int depth, uint8_t * dst)
+{
+    for (int j = first; j < dstWidth; ++j)
+        for (int k = 0; k < depth; ++k)
+            dst[j * depth + k] = (sums[2 * j * depth + k] + sums[(2 * j + 1) * depth + k] + 2) >> 2;
+}
+
+static void halveRow(const uint8_t * row0, const uint8_t * row1, int dstWidth, int depth, uint16_t * sums, uint8_t * dst)
+{
+    const int n = 2 * dstWidth * depth;
+    for (int k = 0; k < n; ++k)
+        sums[k] = row0[k] + row1[k];
+    halveRowTail(sums, 0, dstWidth, depth, dst);
+}
+
+#ifdef ARTOS_JPEGIMAGE_SIMD
+
+__attribute__((target("sse2")))
+static void blendRows_SSE2(const float * row0, const float * row1, float w0, float w1, int n, uint8_t * dst)
+{
+    const __m128 v0 = _mm_set1_ps(w0);
+    const __m128 v1 = _mm_set1_ps(w1);
+    const __m128 half = _mm_set1_ps(0.5f);
+    
+    int k = 0;
+    for (; k + 16 <= n; k += 16) {
+        __m128i q[4];
+        for (int i = 0; i < 4; ++i)
+            q[i] = _mm_cvttps_epi32(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(row0 + k + 4 * i), v0),
+                                                          _mm_mul_ps(_mm_loadu_ps(row1 + k + 4 * i), v1)), half));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + k),
+                         _mm_packus_epi16(_mm_packs_epi32(q[0], q[1]), _mm_packs_epi32(q[2], q[3])));
+    }
+    blendRows(row0 + k, row1 + k, w0, w1, n - k, dst + k);
+}
+
+__attribute__((target("sse2")))
+static void halveRow_SSE2(const uint8_t * row0, const uint8_t * row1, int dstWidth, int depth, uint16_t * sums, uint8_t * dst)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const int n = 2 * dstWidth * depth;
+    
+    // Vertical sums
+    int k = 0;
+    for (; k + 16 <= n; k += 16) {
+        const __m128i r0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row0 + k));
+        const __m128i r1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row1 + k));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(sums + k), _mm_add_epi16(_mm_unpacklo_epi8(r0, zero), _mm_unpacklo_epi8(r1, zero)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(sums + k + 8), _mm_add_epi16(_mm_unpackhi_epi8(r0, zero), _mm_unpackhi_epi8(r1, zero)));
+    }
+    for (; k < n; ++k)
+        sums[k] = row0[k] + row1[k];
+    
+    // Horizontal sums of adjacent pixels, which are adjacent elements for grayscale images
+    int j = 0;
+    if (depth == 1) {
+        const __m128i ones = _mm_set1_epi16(1);
+        const __m128i two = _mm_set1_epi32(2);
+        for (; j + 8 <= dstWidth; j += 8) {
+            const __m128i s0 = _mm_srli_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(sums + 2 * j)), ones), two), 2);
+            const __m128i s1 = _mm_srli_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(sums + 2 * j + 8)), ones), two), 2);
+            const __m128i packed = _mm_packs_epi32(s0, s1);
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(dst + j), _mm_packus_epi16(packed, packed));
+        }
+    }
+    halveRowTail(sums, j, dstWidth, depth, dst);
+}
+
+__attribute__((target("avx2")))
+static void resampleRow_AVX2(const uint8_t * src, size_t available, const detail::ResampleTable & table, int n, float * dst)
+{
+    const __m256i mask = _mm256_set1_epi32(0xFF);
+    
+    // The gathers load 4 bytes at each offset, which must not exceed the readable memory.
+    // The offsets are ascending, so only the last one of each group has to be checked.
+    int k = 0;
+    for (; (k + 8 <= n) && (static_cast<size_t>(table.offset1[k + 7]) + 4 <= available); k += 8) {
+        const __m256i o0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&table.offset0[k]));
+        const __m256i o1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&table.offset1[k]));
+        const __m256 p0 = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_i32gather_epi32(reinterpret_cast<const int *>(src), o0, 1), mask));
+        const __m256 p1 = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_i32gather_epi32(reinterpret_cast<const int *>(src), o1, 1), mask));
+        _mm256_storeu_ps(dst + k, _mm256_add_ps(_mm256_mul_ps(p0, _mm256_loadu_ps(&table.b[k])),
+                                                _mm256_mul_ps(p1, _mm256_loadu_ps(&table.a[k]))));
+    }
+    for (; k < n; ++k)
+        dst[k] = src[table.offset0[k]] * table.b[k] + src[table.offset1[k]] * table.a[k];
+}
+
+#endif
+
+// Select the kernels best suited for the CPU we're running on
+static ResampleRowKernel selectResampleRowKernel()
+{
+#ifdef ARTOS_JPEGIMAGE_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return resampleRow_AVX2;
+#endif
+    return resampleRow;
+}
+
+static BlendRowsKernel selectBlendRowsKernel()
+{
+#ifdef ARTOS_JPEGIMAGE_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+        return blendRows_SSE2;
+#endif
+    return blendRows;
+}
+
+static HalveRowKernel selectHalveRowKernel()
+{
+#ifdef ARTOS_JPEGIMAGE_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+        return halveRow_SSE2;
+#endif
+    return halveRow;
+}
+
+void JPEGImage::Halve(const uint8_t * src, int srcWidth, int srcStride, uint8_t * dst, int dstWidth, int dstHeight, int depth)
+{
+    static const HalveRowKernel halveRowKernel = selectHalveRowKernel();
+    static thread_local vector<uint16_t> sums;
+    sums.resize(srcWidth * depth);
+    
+    for (int i = 0; i < dstHeight; ++i) {
+        const uint8_t * row0 = src + static_cast<size_t>(2 * i) * srcStride;
+        halveRowKernel(row0, row0 + srcStride, dstWidth, depth, &sums[0], dst + i * dstWidth * depth);
+    }
+}
+
+void JPEGImage::Resize(const uint8_t * src, int srcWidth, int srcHeight, int srcStride, uint8_t * dst,
                        int dstWidth, int dstHeight, int depth)
 {
     if ((srcWidth == dstWidth) && (srcHeight == dstHeight)) {
-        copy(src, src + srcWidth * srcHeight * depth, dst);
+        for (int i = 0; i < srcHeight; ++i)
+            copy(src + static_cast<size_t>(i) * srcStride, src + static_cast<size_t>(i) * srcStride + srcWidth * depth,
+                 dst + i * srcWidth * depth);
+        return;
+    }
+    
+    // Bilinear interpolation of exactly half the size averages blocks of 2x2 pixels
+    if ((srcWidth == 2 * dstWidth) && (srcHeight == 2 * dstHeight)) {
+        Halve(src, srcWidth, srcStride, dst, dstWidth, dstHeight, depth);
         return;
     }
     
-    const float xScale = static_cast<float>(srcWidth) / dstWidth;
-    const float yScale = static_cast<float>(srcHeight) / dstHeight;
+    static const ResampleRowKernel resampleRowKernel = selectResampleRowKernel();
+    static const BlendRowsKernel blendRowsKernel = selectBlendRowsKernel();
     
-    // Bilinear interpolation coefficients
-    vector<detail::Bilinear> cols(dstWidth);
+    const shared_ptr<const detail::ResampleTable> cols = resampleTable(srcWidth, dstWidth, depth);
+    const shared_ptr<const detail::ResampleTable> rows = resampleTable(srcHeight, dstHeight, 1);
     
-    for (int j = 0; j < dstWidth; ++j) {
-        const float x = min(max((j + 0.5f) * xScale - 0.5f, 0.0f), srcWidth - 1.0f);
-        cols[j].x0 = x;
-        cols[j].x1 = min(cols[j].x0 + 1, srcWidth - 1);
-        cols[j].a = x - cols[j].x0;
-        cols[j].b = 1.0f - cols[j].a;
-    }
+    // Rows are resampled horizontally once and kept as long as they are needed for the vertical interpolation
+    const int n = dstWidth * depth;
+    const size_t srcSize = static_cast<size_t>(srcHeight - 1) * srcStride + srcWidth * depth;
+    static thread_local vector<float> buffer;
+    buffer.resize(2 * n);
+    float * resampled[2] = { &buffer[0], &buffer[n] };
+    int resampledRows[2] = { -1, -1 };
     
     for (int i = 0; i < dstHeight; ++i) {
-        const float y = min(max((i + 0.5f) * yScale - 0.5f, 0.0f), srcHeight - 1.0f);
-        const int y0 = y;
-        const int y1 = min(y0 + 1, srcHeight - 1);
-        const float c = y - y0;
-        const float d = 1.0f - c;
+        const int y0 = rows->offset0[i];
+        const int y1 = rows->offset1[i];
+        if (resampledRows[1] == y0) {
+            swap(resampled[0], resampled[1]);
+            swap(resampledRows[0], resampledRows[1]);
+        }
+        else if (resampledRows[0] != y0) {
+            const size_t offset = static_cast<size_t>(y0) * srcStride;
+            resampleRowKernel(src + offset, srcSize - offset, *cols, n, resampled[0]);
+            resampledRows[0] = y0;
+        }
+        if (resampledRows[1] != y1) {
+            if (y1 == y0) {
+                copy(resampled[0], resampled[0] + n, resampled[1]);
+            }
+            else {
+                const size_t offset = static_cast<size_t>(y1) * srcStride;
+                resampleRowKernel(src + offset, srcSize - offset, *cols, n, resampled[1]);
+            }
+            resampledRows[1] = y1;
+        }
         
-        for (int j = 0; j < dstWidth; ++j)
-            for (int k = 0; k < depth; ++k)
-                dst[(i * dstWidth + j) * depth + k] =
-                    (src[(y0 * srcWidth + cols[j].x0) * depth + k] * cols[j].b +
-                     src[(y0 * srcWidth + cols[j].x1) * depth + k] * cols[j].a) * d +
-                    (src[(y1 * srcWidth + cols[j].x0) * depth + k] * cols[j].b +
-                     src[(y1 * srcWidth + cols[j].x1) * depth + k] * cols[j].a) * c + 0.5f;
+        blendRowsKernel(resampled[0], resampled[1], rows->b[i], rows->a[i], n, dst + i * n);
     }
 }
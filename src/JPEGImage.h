@@ -25,7 +25,9 @@
 #include <vector>
 #include <cstdint>
 #include <cstdio>
+#include <memory>
 #include "FeatureMatrix.h"
+#include "ImageView.h"
 
 namespace ARTOS
 {
@@ -66,6 +68,22 @@ public:
     */
     JPEGImage(FILE * filehandle);
     
+    /**
+    * Constructs an image from a copy of the pixels of the given @p view.
+    * @note The returned image will be empty if the view is empty.
+    */
+    explicit JPEGImage(const ImageView & view);
+    
+    /**
+    * Constructs an image and tries to load the image from the jpeg file with the given
+    * @p filename at a fraction of its resolution. The image is decoded directly at that scale by
+    * the scaled inverse DCT of libjpeg, which is much faster than decoding it at full resolution
+    * and resizing it afterwards.
+    * @p scaleDenom The denominator of the scale, i.e. 1, 2, 4 or 8.
+    * @note The returned image might be empty if the image could not be loaded.
+    */
+    JPEGImage(const std::string & filename, int scaleDenom);
+    
     /**
     * Copies image data from another JPEGImage object.
     * @p other The JPEGImage whose data is to be copied.
@@ -90,6 +108,29 @@ public:
     */
     JPEGImage & operator=(JPEGImage && other);
     
+    /**
+    * Loads an image from the jpeg file with the given @p filename at full resolution and additionally
+    * decodes the first @p numOctaves octaves below it (i.e. 1/2, 1/4 and 1/8 of the resolution) directly
+    * from the jpeg stream. resize() will downscale the smallest of these octaves which is not smaller
+    * than the requested size instead of halving the full image repeatedly, which speeds up the
+    * construction of feature pyramids from files considerably.
+    * @p numOctaves The number of octaves to decode (at most 3).
+    * @return Returns the image, which might be empty if it could not be loaded.
+    */
+    static JPEGImage ReadWithOctaves(const std::string & filename, int numOctaves = 3);
+    
+    /**
+    * @return Returns the images at 1/2, 1/4, ... of the resolution of this image, which have been decoded
+    * along with it by ReadWithOctaves(), or an empty vector if there are none.
+    */
+    const std::vector<JPEGImage> & octaves() const;
+    
+    /**
+    * @return Returns a view on the pixels of this image, which is valid as long as the image is neither
+    * modified nor destroyed.
+    */
+    operator ImageView() const;
+    
     /**
     * @return Returns the width of the image.
     */
@@ -114,6 +155,7 @@ public:
     /**
     * @return Returns a pointer to the pixel data.
     * @note Returns a null pointer if the image is empty.
+    * The octaves decoded by ReadWithOctaves() are discarded, since the pixels may be modified.
     */
     uint8_t * bits();
     
@@ -126,6 +168,7 @@ public:
     /**
     * @return Returns a pointer to the pixel data at the scanline with index y. The first scanline
     * is at index 0. Returns a null pointer if the image is empty or if y is out of bounds.
+    * The octaves decoded by ReadWithOctaves() are discarded, since the pixels may be modified.
     */
     uint8_t * scanLine(int y);
     
@@ -133,6 +176,7 @@ public:
     * @return Returns a FeatureMatrix object wrapping the data of this image.
     * @note Since the returned FeatureMatrix wraps the data of this image, using it after
     *       the destruction of this JPEGImage object will result in a segmentation fault.
+    * The octaves decoded by ReadWithOctaves() are discarded, since the pixels may be modified.
     */
     FeatureMatrix_<uint8_t> toMatrix();
     
@@ -159,6 +203,43 @@ public:
     */
     JPEGImage resize(int width, int height) const;
     
+    /**
+    * Scales the image to the given @p width and @p height and stores the result in the given image,
+    * whose memory is reused if it is large enough.
+    * If either the width or the height is zero or negative, @p result will be empty.
+    */
+    void resize(int width, int height, JPEGImage & result) const;
+    
+    /**
+    * Scales the image to the given @p width and @p height by downscaling the smallest of the given
+    * @p octaves (as obtained from computeOctaves()) which is not smaller than the requested size.
+    * The result is stored in the given image, whose memory is reused if it is large enough.
+    */
+    void resize(int width, int height, const std::vector<JPEGImage> & octaves, JPEGImage & result) const;
+    
+    /**
+    * Computes the images at 1/2, 1/4, ... of the resolution of this image by halving it repeatedly, so that
+    * all scales of an image pyramid can be resampled from the octave above them with a single pass over it.
+    * Octaves decoded by ReadWithOctaves() are used instead of halving the image where available.
+    * @p minWidth Octaves narrower than this are omitted.
+    * @p minHeight Octaves lower than this are omitted.
+    */
+    std::vector<JPEGImage> computeOctaves(int minWidth = 1, int minHeight = 1) const;
+    
+    /**
+    * Scales the image referred to by the given @p view to the given @p width and @p height by downscaling
+    * the smallest of the given @p octaves which is not smaller than the requested size, if there is any.
+    * The result is stored in the given image, whose memory is reused if it is large enough.
+    * If either the width or the height is zero or negative, @p result will be empty.
+    */
+    static void Scale(const ImageView & view, int width, int height, const std::vector<JPEGImage> & octaves, JPEGImage & result);
+    
+    /**
+    * Computes the octaves of the image referred to by the given @p view like computeOctaves().
+    * If the view refers to an entire JPEGImage, octaves decoded along with it by ReadWithOctaves() are used.
+    */
+    static std::vector<JPEGImage> ComputeOctaves(const ImageView & view, int minWidth = 1, int minHeight = 1);
+    
     /**
     * Returns a copy of a region of the image located at @p x and @p y, and of dimensions @p width
     * and @p height.
@@ -177,21 +258,29 @@ public:
 private:
 
     /**
-    * Blur and downscale an image by a factor 2
+    * Decode a jpeg stream at 1/scaleDenom of its resolution into the given image
+    */
+    static bool Decode(FILE * file, int scaleDenom, JPEGImage & image);
+    
+    /**
+    * Blur and downscale an image by a factor 2 (the source must be exactly twice as large).
+    * Rows of the source image are srcStride bytes apart, while the destination is contiguous.
     */
-    static void Halve(const uint8_t * src, int srcWidth, int srcHeight, uint8_t * dst,
-                      int dstWidth, int dstHeight, int depth);
+    static void Halve(const uint8_t * src, int srcWidth, int srcStride, uint8_t * dst, int dstWidth, int dstHeight, int depth);
     
     /**
-    * Resize an image to the specified dimensions using bilinear interpolation
+    * Resize an image to the specified dimensions using separable bilinear interpolation with
+    * coefficient tables which are cached for each combination of sizes.
+    * Rows of the source image are srcStride bytes apart, while the destination is contiguous.
     */
-    static void Resize(const uint8_t * src, int srcWidth, int srcHeight, uint8_t * dst,
+    static void Resize(const uint8_t * src, int srcWidth, int srcHeight, int srcStride, uint8_t * dst,
                        int dstWidth, int dstHeight, int depth);
     
     int width_;
     int height_;
     int depth_;
     std::vector<uint8_t> bits_;
+    std::shared_ptr< const std::vector<JPEGImage> > octaves_;
 };
 
 }
@@ -0,0 +1,75 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace ARTOS;
+using namespace std;
+
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const string & filename) : m_filename(filename), m_data(NULL), m_size(0), m_mappingHandle(NULL)
+{
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return;
+
+    LARGE_INTEGER fileSize;
+    if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+    {
+        this->m_mappingHandle = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+        if (this->m_mappingHandle != NULL)
+        {
+            this->m_data = reinterpret_cast<char*>(MapViewOfFile(this->m_mappingHandle, FILE_MAP_COPY, 0, 0, 0));
+            if (this->m_data != NULL)
+                this->m_size = static_cast<size_t>(fileSize.QuadPart);
+        }
+    }
+    CloseHandle(file);
+}
+
+
+MappedFile::~MappedFile()
+{
+    if (this->m_data != NULL)
+        UnmapViewOfFile(this->m_data);
+    if (this->m_mappingHandle != NULL)
+        CloseHandle(this->m_mappingHandle);
+}
+
+#else
+
+MappedFile::MappedFile(const string & filename) : m_filename(filename), m_data(NULL), m_size(0)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) == 0 && fileStat.st_size > 0)
+    {
+        void * data = mmap(NULL, fileStat.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED)
+        {
+            this->m_data = reinterpret_cast<char*>(data);
+            this->m_size = static_cast<size_t>(fileStat.st_size);
+        }
+    }
+    close(fd);
+}
+
+
+MappedFile::~MappedFile()
+{
+    if (this->m_data != NULL)
+        munmap(this->m_data, this->m_size);
+}
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef ARTOS_MAPPEDFILE_H
+#define ARTOS_MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+
+namespace ARTOS
+{
+
+/**
+* Maps the contents of a file into memory, so that they can be used in place without reading them.
+*
+* The mapping is private: The contents may be modified in memory, but those modifications are
+* neither written back to the file nor visible to other processes mapping the same file.
+* Pages which have not been modified are shared with other processes mapping the same file,
+* so that a single copy of the file resides in physical memory.
+*
+* The memory is aligned to the page size of the system.
+*/
+class MappedFile
+{
+
+public:
+
+    /**
+    * Maps a file into memory.
+    *
+    * @param[in] filename The path to the file to be mapped.
+    * Whether this was successful can be checked with the valid() method afterwards.
+    */
+    MappedFile(const std::string & filename);
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile & operator=(const MappedFile &) = delete;
+
+    /**
+    * Unmaps the file. Pointers obtained from data() will be invalid afterwards.
+    */
+    virtual ~MappedFile();
+
+    /**
+    * @return Returns true if the file has been mapped successfully and is not empty.
+    */
+    bool valid() const { return (this->m_data != NULL); };
+
+    /**
+    * @return Returns a pointer to the beginning of the mapped contents of the file or NULL if the
+    * file could not be mapped.
+    */
+    char * data() { return this->m_data; };
+
+    /**
+    * @return Returns a pointer to the beginning of the mapped contents of the file or NULL if the
+    * file could not be mapped.
+    */
+    const char * data() const { return this->m_data; };
+
+    /**
+    * @return Returns the size of the mapped file in bytes.
+    */
+    std::size_t size() const { return this->m_size; };
+
+    /**
+    * @return Returns the path to the mapped file.
+    */
+    const std::string & filename() const { return this->m_filename; };
+
+
+protected:
+
+    std::string m_filename; /**< Path to the mapped file. */
+    char * m_data; /**< Pointer to the mapped memory. */
+    std::size_t m_size; /**< Size of the mapped memory. */
+#ifdef _WIN32
+    void * m_mappingHandle; /**< Handle of the file mapping object. */
+#endif
+
+};
+
+}
+
+#endif
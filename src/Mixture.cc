@@ -26,21 +26,22 @@
 #include <sstream>
 #include <cstring>
 #include "strutils.h"
+#include "sysutils.h"
 
 using namespace ARTOS;
 using namespace std;
 
-Mixture::Mixture() : featureExtractor_(FeatureExtractor::defaultFeatureExtractor()), cached_(0)
+Mixture::Mixture() : featureExtractor_(FeatureExtractor::defaultFeatureExtractor())
 {
 }
 
 Mixture::Mixture(const shared_ptr<FeatureExtractor> & featureExtractor)
-: featureExtractor_((featureExtractor) ? featureExtractor : FeatureExtractor::defaultFeatureExtractor()), cached_(0)
+: featureExtractor_((featureExtractor) ? featureExtractor : FeatureExtractor::defaultFeatureExtractor())
 {
 }
 
 Mixture::Mixture(const vector<Model> & models, const shared_ptr<FeatureExtractor> & featureExtractor)
-: models_(models), featureExtractor_((featureExtractor) ? featureExtractor : FeatureExtractor::defaultFeatureExtractor()), cached_(0)
+: models_(models), featureExtractor_((featureExtractor) ? featureExtractor : FeatureExtractor::defaultFeatureExtractor())
 {
     for (const auto & m : models_)
         if (!m.empty() && m.nbFeatures() != featureExtractor_->numFeatures())
@@ -48,29 +49,52 @@ Mixture::Mixture(const vector<Model> & models, const shared_ptr<FeatureExtractor
 }
 
 Mixture::Mixture(vector<Model> && models, const shared_ptr<FeatureExtractor> & featureExtractor)
-: models_(std::move(models)), featureExtractor_((featureExtractor) ? featureExtractor : FeatureExtractor::defaultFeatureExtractor()), cached_(0)
+: models_(std::move(models)), featureExtractor_((featureExtractor) ? featureExtractor : FeatureExtractor::defaultFeatureExtractor())
 {
     for (const auto & m : models_)
         if (!m.empty() && m.nbFeatures() != featureExtractor_->numFeatures())
             throw IncompatibleException("Number of features of models to be added to a mixture does not match the one reported by the given FeatureExtractor.");
 }
 
-Mixture::Mixture(const Mixture & other) : models_(other.models_), featureExtractor_(other.featureExtractor_), cached_(0)
+Mixture::Mixture(const Mixture & other) : models_(other.models_), featureExtractor_(other.featureExtractor_)
 {
 }
 
-Mixture::Mixture(Mixture && other) : models_(std::move(other.models_)), featureExtractor_(other.featureExtractor_), cached_(0)
+Mixture::Mixture(Mixture && other)
+: mappedFile_(std::move(other.mappedFile_)), models_(std::move(other.models_)), featureExtractor_(other.featureExtractor_)
 {
+    // Keep the transformed filters, e.g. the spectra read from a binary model file
+    lock_guard<mutex> lock(other.filterCacheMutex_);
+    filterCache_ = std::move(other.filterCache_);
+    sharedFilters_ = std::move(other.sharedFilters_);
+    other.filterCache_.clear();
+    other.sharedFilters_.clear();
+}
+
+Mixture & Mixture::operator=(const Mixture & other)
+{
+    if (this != &other) {
+        models_ = other.models_;
+        featureExtractor_ = other.featureExtractor_;
+        filterCache_.clear();
+        sharedFilters_.clear();
+    }
+    return *this;
 }
 
 Mixture & Mixture::operator=(Mixture && other)
 {
-    models_ = std::move(other.models_);
-    featureExtractor_ = other.featureExtractor_;
-    filterCache_.clear();
-    cached_ = 0;
-    other.filterCache_.clear();
-    other.cached_ = 0;
+    if (this != &other) {
+        unique_lock<mutex> lock(filterCacheMutex_, defer_lock), otherLock(other.filterCacheMutex_, defer_lock);
+        std::lock(lock, otherLock);
+        models_ = std::move(other.models_);
+        featureExtractor_ = other.featureExtractor_;
+        filterCache_ = std::move(other.filterCache_);
+        sharedFilters_ = std::move(other.sharedFilters_);
+        other.filterCache_.clear();
+        other.sharedFilters_.clear();
+        mappedFile_ = std::move(other.mappedFile_);
+    }
     return *this;
 }
 
@@ -89,7 +113,8 @@ void Mixture::addModel(const Model & model)
     if (!model.empty() && model.nbFeatures() != featureExtractor_->numFeatures())
         throw IncompatibleException("Tried to mix models with a different number of features.");
     models_.push_back(model);
-    cached_ = 0;
+    filterCache_.clear();
+    sharedFilters_.clear();
 }
 
 void Mixture::addModel(Model && model)
@@ -97,7 +122,8 @@ void Mixture::addModel(Model && model)
     if (!model.empty() && model.nbFeatures() != featureExtractor_->numFeatures())
         throw IncompatibleException("Tried to mix models with a different number of features.");
     models_.push_back(std::move(model));
-    cached_ = 0;
+    filterCache_.clear();
+    sharedFilters_.clear();
 }
 
 Size Mixture::minSize() const
@@ -128,6 +154,46 @@ Size Mixture::maxSize() const
     return size;
 }
 
+bool Mixture::rootOnly() const
+{
+    for (size_t i = 0; i < models_.size(); ++i)
+        if (models_[i].parts_.size() != 1 || models_[i].empty())
+            return false;
+    
+    return !models_.empty();
+}
+
+vector<FeatureScalar> Mixture::biases() const
+{
+    vector<FeatureScalar> biases(models_.size());
+    
+    for (size_t i = 0; i < models_.size(); ++i)
+        biases[i] = models_[i].bias_;
+    
+    return biases;
+}
+
+int Mixture::numFilters() const
+{
+    int nbFilters = 0;
+    
+    for (size_t i = 0; i < models_.size(); ++i)
+        nbFilters += models_[i].parts_.size();
+    
+    return nbFilters;
+}
+
+int Mixture::numFilterCells() const
+{
+    int nbCells = 0;
+    
+    for (size_t i = 0; i < models_.size(); ++i)
+        for (size_t j = 0; j < models_[i].parts_.size(); ++j)
+            nbCells += models_[i].parts_[j].filter.rows() * models_[i].parts_[j].filter.cols();
+    
+    return nbCells;
+}
+
 shared_ptr<FeatureExtractor> Mixture::featureExtractor() const
 {
     return this->featureExtractor_;
@@ -147,11 +213,44 @@ void Mixture::convolve(const FeaturePyramid & pyramid, vector<ScalarMatrix> & sc
         return;
     }
     
-    const int nbModels = models_.size();
-    const int nbLevels = pyramid.levels().size();
+    // Take the maximum over the root filters directly if there are no parts
+    if (rootOnly()) {
+        const Size padding = this->maxSize() / 2 + 1;
+        const int nbFFTLevels = Patchwork::NumFFTLevels(pyramid, padding, numFilters(), numFilterCells());
+        
+        vector< vector<ScalarMatrix> > maxScores(1);
+        vector< vector<Indices> > maxArgmaxes(1);
+        
+        if (nbFFTLevels > 0) {
+            const Patchwork patchwork(pyramid, padding, nbFFTLevels);
+            const vector<Patchwork::Filter> & filters = transformedFilters(patchwork.planeSize());
+            
+            patchwork.convolveMax(filters, vector<int>(1, models_.size()), biases(), maxScores, maxArgmaxes);
+            
+            if (maxScores.empty()) {
+                scores.clear();
+                argmaxes.clear();
+                
+                if (positions)
+                    positions->clear();
+                
+                return;
+            }
+        }
+        
+        scores.swap(maxScores[0]);
+        argmaxes.swap(maxArgmaxes[0]);
+        maximizeDirect(pyramid, nbFFTLevels, scores, argmaxes);
+        
+        // There are no parts to be positioned
+        if (positions)
+            positions->assign(models_.size(), vector< vector<Model::Positions> >());
+        
+        return;
+    }
     
     // Convolve with all the models
-    vector< vector< ScalarMatrix> > tmp(nbModels);
+    vector< vector< ScalarMatrix> > tmp(models_.size());
     convolve(pyramid, tmp, positions);
     
     // In case of error
@@ -165,6 +264,38 @@ void Mixture::convolve(const FeaturePyramid & pyramid, vector<ScalarMatrix> & sc
         return;
     }
     
+    maximize(pyramid, tmp, scores, argmaxes);
+}
+
+void Mixture::convolve(const FeaturePyramid & pyramid, vector< vector<ScalarMatrix> > & convolutions,
+                       vector<ScalarMatrix> & scores, vector<Indices> & argmaxes) const
+{
+    if (empty() || pyramid.empty() || convolutions.empty()) {
+        scores.clear();
+        argmaxes.clear();
+        return;
+    }
+    
+    // Compute the scores of all the models
+    vector< vector< ScalarMatrix> > tmp(models_.size());
+    convolve(pyramid, convolutions, tmp);
+    
+    // In case of error
+    if (tmp.empty()) {
+        scores.clear();
+        argmaxes.clear();
+        return;
+    }
+    
+    maximize(pyramid, tmp, scores, argmaxes);
+}
+
+void Mixture::maximize(const FeaturePyramid & pyramid, const vector< vector<ScalarMatrix> > & tmp,
+                       vector<ScalarMatrix> & scores, vector<Indices> & argmaxes) const
+{
+    const int nbModels = models_.size();
+    const int nbLevels = pyramid.levels().size();
+    
     // Resize the scores and argmaxes
     scores.resize(nbLevels);
     argmaxes.resize(nbLevels);
@@ -205,29 +336,36 @@ void Mixture::convolve(const FeaturePyramid & pyramid,
             positions->clear();
     }
     
-    const int nbModels = models_.size();
+    // Determine the levels which are small enough to be convolved directly
+    const Size padding = this->maxSize() / 2 + 1;
+    const int nbFFTLevels = Patchwork::NumFFTLevels(pyramid, padding, numFilters(), numFilterCells());
     
-    scores.resize(nbModels);
-    
-    if (positions)
-        positions->resize(nbModels);
+    vector< vector<ScalarMatrix> > convolutions(numFilters());
     
-    // Transform the filters if needed
-#pragma omp critical
-    if (cached_ != Patchwork::NumInits() || filterCache_.empty())
-    {
-        cached_ = 0;
-        cacheFilters();
+    if (nbFFTLevels > 0) {
+        // Create a patchwork
+        const Patchwork patchwork(pyramid, padding, nbFFTLevels);
+        
+        // Transform the filters if needed
+        const vector<Patchwork::Filter> & filters = transformedFilters(patchwork.planeSize());
+        
+        // Convolve the patchwork with the filters
+        patchwork.convolve(filters, convolutions);
     }
     
-    while (!cached_);
-    
-    // Create a patchwork
-    const Patchwork patchwork(pyramid, this->maxSize() / 2 + 1);
+    // Convolve the remaining levels directly
+    if (!convolutions.empty())
+        convolveDirect(pyramid, nbFFTLevels, convolutions);
     
-    // Convolve the patchwork with the filters
-    vector< vector<ScalarMatrix> > convolutions(filterCache_.size());
-    patchwork.convolve(filterCache_, convolutions);
+    convolve(pyramid, convolutions, scores, positions);
+}
+
+void Mixture::convolve(const FeaturePyramid & pyramid,
+                       vector< vector<ScalarMatrix> > & convolutions,
+                       vector< vector<ScalarMatrix> > & scores,
+                       vector< vector< vector<Model::Positions> > > * positions) const
+{
+    const int nbModels = models_.size();
     
     // In case of error
     if (convolutions.empty()) {
@@ -239,6 +377,11 @@ void Mixture::convolve(const FeaturePyramid & pyramid,
         return;
     }
     
+    scores.resize(nbModels);
+    
+    if (positions)
+        positions->resize(nbModels);
+    
     // Save the offsets of each model in the filter list
     vector<int> offsets(nbModels);
     
@@ -260,7 +403,7 @@ void Mixture::convolve(const FeaturePyramid & pyramid,
     }
 }
 
-void Mixture::cacheFilters() const
+void Mixture::cacheFilters(const Patchwork::PlaneSize & planeSize) const
 {
     // Count the number of filters
     int nbFilters = 0;
@@ -268,19 +411,446 @@ void Mixture::cacheFilters() const
     for (size_t i = 0; i < models_.size(); ++i)
         nbFilters += models_[i].parts_.size();
     
-    // Transform all the filters
-    filterCache_.resize(nbFilters);
+    // Obtain the transformed filters from the shared cache, which transforms them if
+    // no other mixture has done so yet, and refer to them
+    vector<Patchwork::Filter> filters(nbFilters);
+    vector< shared_ptr<const Patchwork::Filter> > sharedFilters(nbFilters);
     
     for (size_t i = 0, j = 0; i < models_.size(); ++i) {
         int k;
 #pragma omp parallel for private(k)
-        for (k = 0; k < models_[i].parts_.size(); ++k)
-            Patchwork::TransformFilter(models_[i].parts_[k].filter, filterCache_[j + k]);
+        for (k = 0; k < models_[i].parts_.size(); ++k) {
+            sharedFilters[j + k] = Patchwork::SharedTransformedFilter(models_[i].parts_[k].filter, planeSize);
+            const Patchwork::Plane & plane = sharedFilters[j + k]->first;
+            if (!plane.empty())
+                filters[j + k] = Patchwork::Filter(Patchwork::Plane(const_cast<Patchwork::Scalar *>(plane.raw()),
+                                                                    plane.rows(), plane.cols(), plane.channels()),
+                                                   sharedFilters[j + k]->second);
+        }
         
         j += models_[i].parts_.size();
     }
     
-    cached_ = Patchwork::NumInits();
+    // Filters cached in the meantime by another thread are kept, since they may already be in use
+    lock_guard<mutex> lock(filterCacheMutex_);
+    if (filterCache_.insert(make_pair(planeSize, std::move(filters))).second)
+        sharedFilters_[planeSize] = std::move(sharedFilters);
+    
+    // Release the filters transformed for plane sizes which no patchwork can have anymore, since
+    // Patchwork has released the plans for them (filters read from a file are kept)
+    for (map<Patchwork::PlaneSize, vector< shared_ptr<const Patchwork::Filter> > >::iterator it = sharedFilters_.begin(); it != sharedFilters_.end(); )
+        if (it->first != planeSize && !Patchwork::HasPlans(it->first)) {
+            filterCache_.erase(it->first);
+            sharedFilters_.erase(it++);
+        }
+        else
+            ++it;
+}
+
+const vector<Patchwork::Filter> & Mixture::transformedFilters(const Patchwork::PlaneSize & planeSize) const
+{
+    {
+        lock_guard<mutex> lock(filterCacheMutex_);
+        map<Patchwork::PlaneSize, vector<Patchwork::Filter> >::const_iterator filters = filterCache_.find(planeSize);
+        if (filters != filterCache_.end())
+            return filters->second;
+    }
+    
+    // Transform the filters without holding the lock, so that detections using
+    // other plane sizes are not blocked in the meantime
+    cacheFilters(planeSize);
+    
+    // Elements of a std::map are never relocated, so the reference stays valid after unlocking
+    lock_guard<mutex> lock(filterCacheMutex_);
+    return filterCache_.find(planeSize)->second;
+}
+
+void Mixture::convolveDirect(const FeaturePyramid & pyramid, int firstLevel,
+                             vector< vector<ScalarMatrix> > & convolutions) const
+{
+    const int nbLevels = pyramid.levels().size();
+    const int nbDirectLevels = nbLevels - firstLevel;
+    
+    // Gather the filters of all models
+    vector<const FeatureMatrix *> filters;
+    
+    for (size_t i = 0; i < models_.size(); ++i)
+        for (size_t j = 0; j < models_[i].parts_.size(); ++j)
+            filters.push_back(&models_[i].parts_[j].filter);
+    
+    const int nbFilters = filters.size();
+    
+    convolutions.resize(nbFilters);
+    
+    for (int i = 0; i < nbFilters; ++i)
+        convolutions[i].resize(nbLevels);
+    
+    if (nbDirectLevels <= 0)
+        return;
+    
+    int i;
+#pragma omp parallel for private(i)
+    for (i = 0; i < nbFilters * nbDirectLevels; ++i) {
+        const int f = i / nbDirectLevels;
+        const int l = firstLevel + i % nbDirectLevels;
+        Patchwork::ConvolveDirect(pyramid.levels()[l], *filters[f], convolutions[f][l]);
+    }
+}
+
+void Mixture::maximizeDirect(const FeaturePyramid & pyramid, int firstLevel,
+                             vector<ScalarMatrix> & scores, vector<Indices> & argmaxes) const
+{
+    const int nbModels = models_.size();
+    const int nbLevels = pyramid.levels().size();
+    
+    scores.resize(nbLevels);
+    argmaxes.resize(nbLevels);
+    
+    int i;
+#pragma omp parallel for private(i)
+    for (i = firstLevel; i < nbLevels; ++i) {
+        // The first model is convolved into the scores directly, so that their memory is reused
+        Patchwork::ConvolveDirect(pyramid.levels()[i], models_[0].parts_[0].filter, scores[i]);
+        scores[i].array() += models_[0].bias_;
+        argmaxes[i].setZero(scores[i].rows(), scores[i].cols());
+        
+        // Among equal scores, the first model wins, just like in Patchwork::convolveMax()
+        ScalarMatrix convolution;
+        
+        for (int j = 1; j < nbModels; ++j) {
+            Patchwork::ConvolveDirect(pyramid.levels()[i], models_[j].parts_[0].filter, convolution);
+            convolution.array() += models_[j].bias_;
+            
+            for (int y = 0; y < scores[i].rows(); ++y)
+                for (int x = 0; x < scores[i].cols(); ++x)
+                    if (convolution(y, x) > scores[i](y, x)) {
+                        scores[i](y, x) = convolution(y, x);
+                        argmaxes[i](y, x) = j;
+                    }
+        }
+    }
+}
+
+namespace
+{
+
+// Blocks of the binary format, each one padded to a multiple of BinaryAlignment
+const char BinaryMagic[8] = { 'A', 'R', 'T', 'O', 'S', 'M', 'I', 'X' };
+const uint32_t BinaryByteOrderMark = 0x01020304;
+const size_t BinaryAlignment = 64;
+
+struct BinaryHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t scalarBits;
+    uint32_t numModels;
+    uint32_t numSpectrumSets;
+    uint32_t featureExtractorLength;
+    char reserved[32];
+};
+
+struct BinaryModelHeader
+{
+    uint32_t numParts;
+    FeatureScalar bias;
+    char reserved[56];
+};
+
+struct BinaryPartHeader
+{
+    int32_t rows, cols, channels;
+    int32_t offset[2];
+    FeatureScalar deformation[4];
+    char reserved[28];
+};
+
+struct BinarySpectrumSetHeader
+{
+    int32_t rows, cols, features;
+    int32_t numFilters;
+    char reserved[48];
+};
+
+struct BinarySpectrumHeader
+{
+    int32_t filterRows, filterCols;
+    char reserved[56];
+};
+
+static_assert(sizeof(BinaryHeader) == BinaryAlignment && sizeof(BinaryModelHeader) == BinaryAlignment
+              && sizeof(BinaryPartHeader) == BinaryAlignment && sizeof(BinarySpectrumSetHeader) == BinaryAlignment
+              && sizeof(BinarySpectrumHeader) == BinaryAlignment,
+              "Blocks of the binary mixture format must have a size of 64 bytes.");
+
+// Writes a block of data followed by zeros up to the next multiple of BinaryAlignment
+void writeBlock(ostream & os, const void * data, size_t bytes)
+{
+    static const char zeros[BinaryAlignment] = { 0 };
+    os.write(reinterpret_cast<const char *>(data), bytes);
+    if (bytes % BinaryAlignment != 0)
+        os.write(zeros, BinaryAlignment - bytes % BinaryAlignment);
+}
+
+// Consumes padded blocks of a memory-mapped binary file
+class BinaryReader
+{
+public:
+    
+    BinaryReader(char * data, size_t size) : data_(data), size_(size), pos_(0) {}
+    
+    char * next(size_t bytes)
+    {
+        const size_t paddedBytes = (bytes + BinaryAlignment - 1) & ~(BinaryAlignment - 1);
+        if (bytes > size_ || paddedBytes > size_ - pos_)
+            throw DeserializationException("Unexpected end of binary mixture file.");
+        char * block = data_ + pos_;
+        pos_ += paddedBytes;
+        return block;
+    }
+    
+    // Checks if the rest of the data can hold count blocks of the given size, without allocating anything
+    bool fits(size_t count, size_t blockSize) const
+    {
+        return (count <= (size_ - pos_) / blockSize);
+    }
+    
+    template<typename T>
+    T header()
+    {
+        T block;
+        memcpy(&block, next(sizeof(T)), sizeof(T));
+        return block;
+    }
+    
+private:
+    
+    char * data_;
+    size_t size_;
+    size_t pos_;
+};
+
+// Checks if a buffer starts with a binary mixture header
+bool isBinaryMixture(const char * data, size_t size)
+{
+    return (data != 0 && size >= sizeof(BinaryHeader) && memcmp(data, BinaryMagic, sizeof(BinaryMagic)) == 0);
+}
+
+}
+
+bool Mixture::readFromFile(const string & filename, bool mapMemory)
+{
+    shared_ptr<MappedFile> file = make_shared<MappedFile>(filename);
+    if (file->valid() && isBinaryMixture(file->data(), file->size()))
+    {
+        readBinary(file, mapMemory);
+        return true;
+    }
+    file.reset();
+    
+    ifstream in(filename.c_str(), ios::binary);
+    if (!in.is_open())
+        return false;
+    in >> *this;
+    return true;
+}
+
+bool Mixture::writeToFile(const string & filename, bool binary, bool includeSpectra) const
+{
+    // Overwriting the mapped file would invalidate the filters in use
+    if (mappedFile_ && real_path(mappedFile_->filename()) == real_path(filename))
+        return false;
+    
+    ofstream out(filename.c_str(), ios::binary | ios::trunc);
+    if (!out.is_open())
+        return false;
+    
+    if (binary)
+        writeBinary(out, includeSpectra);
+    else
+        out << *this;
+    return out.good();
+}
+
+void Mixture::writeBinary(ostream & os, bool includeSpectra) const
+{
+    // Serialize the feature extractor the same way as in the text format
+    ostringstream feStream;
+    feStream << featureExtractor_->type() << endl << *featureExtractor_;
+    const string feString = feStream.str();
+    
+    // Collect the complete sets of transformed filters
+    const int nbFilters = numFilters();
+    vector< pair<Patchwork::PlaneSize, const vector<Patchwork::Filter> *> > spectra;
+    unique_lock<mutex> lock(filterCacheMutex_, defer_lock);
+    if (includeSpectra) {
+        lock.lock();
+        for (map<Patchwork::PlaneSize, vector<Patchwork::Filter> >::const_iterator it = filterCache_.begin(); it != filterCache_.end(); ++it) {
+            bool complete = (it->second.size() == static_cast<size_t>(nbFilters));
+            for (size_t i = 0; complete && i < it->second.size(); ++i)
+                complete = !it->second[i].first.empty();
+            if (complete)
+                spectra.push_back(make_pair(it->first, &(it->second)));
+        }
+    }
+    
+    // Header
+    BinaryHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BinaryMagic, sizeof(BinaryMagic));
+    header.version = BinaryFormatVersion;
+    header.byteOrder = BinaryByteOrderMark;
+    header.scalarBits = sizeof(FeatureScalar) * 8;
+    header.numModels = models_.size();
+    header.numSpectrumSets = spectra.size();
+    header.featureExtractorLength = feString.size();
+    writeBlock(os, &header, sizeof(header));
+    writeBlock(os, feString.data(), feString.size());
+    
+    // Models
+    for (size_t i = 0; i < models_.size(); ++i) {
+        BinaryModelHeader modelHeader;
+        memset(&modelHeader, 0, sizeof(modelHeader));
+        modelHeader.numParts = models_[i].parts_.size();
+        modelHeader.bias = models_[i].bias_;
+        writeBlock(os, &modelHeader, sizeof(modelHeader));
+        
+        for (size_t j = 0; j < models_[i].parts_.size(); ++j) {
+            const Model::Part & part = models_[i].parts_[j];
+            BinaryPartHeader partHeader;
+            memset(&partHeader, 0, sizeof(partHeader));
+            partHeader.rows = part.filter.rows();
+            partHeader.cols = part.filter.cols();
+            partHeader.channels = part.filter.channels();
+            partHeader.offset[0] = part.offset(0);
+            partHeader.offset[1] = part.offset(1);
+            for (int k = 0; k < 4; ++k)
+                partHeader.deformation[k] = part.deformation(k);
+            writeBlock(os, &partHeader, sizeof(partHeader));
+            writeBlock(os, part.filter.raw(), part.filter.numEl() * sizeof(FeatureScalar));
+        }
+    }
+    
+    // Transformed filters
+    for (size_t i = 0; i < spectra.size(); ++i) {
+        BinarySpectrumSetHeader setHeader;
+        memset(&setHeader, 0, sizeof(setHeader));
+        setHeader.rows = spectra[i].first.rows;
+        setHeader.cols = spectra[i].first.cols;
+        setHeader.features = spectra[i].first.features;
+        setHeader.numFilters = nbFilters;
+        writeBlock(os, &setHeader, sizeof(setHeader));
+        
+        for (size_t j = 0; j < spectra[i].second->size(); ++j) {
+            const Patchwork::Filter & filter = (*spectra[i].second)[j];
+            BinarySpectrumHeader filterHeader;
+            memset(&filterHeader, 0, sizeof(filterHeader));
+            filterHeader.filterRows = filter.second.first;
+            filterHeader.filterCols = filter.second.second;
+            writeBlock(os, &filterHeader, sizeof(filterHeader));
+            writeBlock(os, filter.first.raw(), filter.first.numEl() * sizeof(Patchwork::Scalar));
+        }
+    }
+}
+
+void Mixture::readBinary(const shared_ptr<MappedFile> & file, bool inPlace)
+{
+    *this = Mixture();
+    BinaryReader reader(file->data(), file->size());
+    
+    // Check the header
+    const BinaryHeader header = reader.header<BinaryHeader>();
+    if (header.byteOrder != BinaryByteOrderMark)
+        throw DeserializationException("The binary mixture file has been written on a machine with a different byte order.");
+    if (header.version != BinaryFormatVersion)
+        throw DeserializationException("Unsupported version of binary mixture file.");
+    if (header.scalarBits != sizeof(FeatureScalar) * 8)
+        throw DeserializationException("The binary mixture file uses a different floating point format.");
+    if (header.numModels == 0)
+        throw DeserializationException("The given stream could not be deserialized into a mixture.");
+    
+    // Create the feature extractor
+    shared_ptr<FeatureExtractor> featureExtractor;
+    {
+        istringstream feStream(string(reader.next(header.featureExtractorLength), header.featureExtractorLength));
+        string type;
+        getline(feStream, type);
+        featureExtractor = FeatureExtractor::create(trim(type));
+        feStream >> *featureExtractor;
+    }
+    
+    // Deserialize models (every model consists of at least a model header and the header of its root)
+    if (!reader.fits(header.numModels, sizeof(BinaryModelHeader) + sizeof(BinaryPartHeader)))
+        throw DeserializationException("Invalid number of models in binary mixture file.");
+    vector<Model> models(header.numModels);
+    for (uint32_t i = 0; i < header.numModels; ++i) {
+        const BinaryModelHeader modelHeader = reader.header<BinaryModelHeader>();
+        if (modelHeader.numParts == 0 || !reader.fits(modelHeader.numParts, sizeof(BinaryPartHeader)))
+            throw DeserializationException("Invalid number of parts in binary mixture file.");
+        
+        models[i].bias_ = modelHeader.bias;
+        models[i].parts_.resize(modelHeader.numParts);
+        for (uint32_t j = 0; j < modelHeader.numParts; ++j) {
+            const BinaryPartHeader partHeader = reader.header<BinaryPartHeader>();
+            if (partHeader.rows <= 0 || partHeader.cols <= 0 || partHeader.channels <= 0
+                    || !reader.fits(static_cast<size_t>(partHeader.rows) * partHeader.cols, partHeader.channels * sizeof(FeatureScalar)))
+                throw DeserializationException("Invalid filter size in binary mixture file.");
+            
+            Model::Part & part = models[i].parts_[j];
+            part.offset = Model::Position(partHeader.offset[0], partHeader.offset[1]);
+            for (int k = 0; k < 4; ++k)
+                part.deformation(k) = partHeader.deformation[k];
+            
+            const size_t numEl = static_cast<size_t>(partHeader.rows) * partHeader.cols * partHeader.channels;
+            FeatureMatrix filter(reinterpret_cast<FeatureScalar *>(reader.next(numEl * sizeof(FeatureScalar))),
+                                 partHeader.rows, partHeader.cols, partHeader.channels);
+            if (inPlace)
+                part.filter = std::move(filter);
+            else
+                part.filter = filter;
+        }
+        
+        // Always set the deformation of the root to zero
+        models[i].parts_[0].deformation.setZero();
+    }
+    
+    // Deserialize transformed filters
+    map<Patchwork::PlaneSize, vector<Patchwork::Filter> > spectra;
+    for (uint32_t i = 0; i < header.numSpectrumSets; ++i) {
+        const BinarySpectrumSetHeader setHeader = reader.header<BinarySpectrumSetHeader>();
+        if (setHeader.rows <= 0 || setHeader.cols <= 0 || setHeader.features != featureExtractor->numFeatures()
+                || setHeader.numFilters <= 0 || !reader.fits(setHeader.numFilters, sizeof(BinarySpectrumHeader)))
+            throw DeserializationException("Invalid filter spectra in binary mixture file.");
+        
+        const Patchwork::PlaneSize planeSize(setHeader.rows, setHeader.cols, setHeader.features);
+        const int halfCols = setHeader.cols / 2 + 1;
+        if (!reader.fits(static_cast<size_t>(setHeader.numFilters) * setHeader.rows, static_cast<size_t>(halfCols) * setHeader.features * sizeof(Patchwork::Scalar)))
+            throw DeserializationException("Invalid filter spectra in binary mixture file.");
+        vector<Patchwork::Filter> & filters = spectra[planeSize];
+        filters.resize(setHeader.numFilters);
+        for (int j = 0; j < setHeader.numFilters; ++j) {
+            const BinarySpectrumHeader filterHeader = reader.header<BinarySpectrumHeader>();
+            const size_t numEl = static_cast<size_t>(setHeader.rows) * halfCols * setHeader.features;
+            Patchwork::Plane plane(reinterpret_cast<Patchwork::Scalar *>(reader.next(numEl * sizeof(Patchwork::Scalar))),
+                                   setHeader.rows, halfCols, setHeader.features);
+            if (inPlace)
+                filters[j].first = std::move(plane);
+            else
+                filters[j].first = plane;
+            filters[j].second = pair<int, int>(filterHeader.filterRows, filterHeader.filterCols);
+        }
+    }
+    
+    // Finish
+    Mixture mixture(std::move(models), featureExtractor);
+    for (map<Patchwork::PlaneSize, vector<Patchwork::Filter> >::const_iterator it = spectra.begin(); it != spectra.end(); ++it)
+        if (it->second.size() != static_cast<size_t>(mixture.numFilters()))
+            throw DeserializationException("The number of filter spectra in the binary mixture file does not match the number of filters.");
+    *this = std::move(mixture);
+    filterCache_ = std::move(spectra);
+    if (inPlace)
+        mappedFile_ = file;
 }
 
 ostream & ARTOS::operator<<(ostream & os, const Mixture & mixture)
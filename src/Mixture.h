@@ -23,6 +23,10 @@
 
 #include "Model.h"
 #include "Patchwork.h"
+#include "MappedFile.h"
+
+#include <cstdint>
+#include <iosfwd>
 
 namespace ARTOS
 {
@@ -37,7 +41,7 @@ public:
     /**
     * Type of a matrix of indices.
     */
-    typedef Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> Indices;
+    typedef Patchwork::Indices Indices;
     
     /**
     * Constructs an empty mixture. An empty mixture has no model.
@@ -102,7 +106,7 @@ public:
     *
     * @param[in] other Another mixture to be copied.
     */
-    Mixture & operator=(const Mixture & other) = default;
+    Mixture & operator=(const Mixture & other);
     
     /**
     * Move assignment operator.
@@ -147,6 +151,30 @@ public:
     */
     Size maxSize() const;
     
+    /**
+    * Returns true if all models of the mixture consist of a root filter only, which is the case
+    * for models learned by ModelLearner. The scores of such mixtures are computed by a faster
+    * method, which takes the maximum over the models directly while transforming the convolutions
+    * back from the frequency domain.
+    */
+    bool rootOnly() const;
+    
+    /**
+    * Returns the biases of all models (in the order of the models).
+    */
+    std::vector<FeatureScalar> biases() const;
+    
+    /**
+    * Returns the number of filters of all models (roots and parts).
+    */
+    int numFilters() const;
+    
+    /**
+    * Returns the total number of cells of the filters of all models, which is a measure
+    * for the cost of convolving them in the spatial domain.
+    */
+    int numFilterCells() const;
+    
     /**
     * Returns a shared pointer to the FeatureExtractor used to create the models in this mixture.
     */
@@ -172,9 +200,153 @@ public:
                  const;
     
     /**
-    * Cache the transformed version of the models' filters.
+    * Returns the scores of the convolutions + distance transforms of the models with a
+    * pyramid of features, given the convolutions of their filters with that pyramid.
+    * This allows convolving the filters of multiple mixtures with the same Patchwork at once.
+    *
+    * @param[in] pyramid Pyramid of features.
+    *
+    * @param[in,out] convolutions Convolutions of the filters returned by transformedFilters()
+    * with each pyramid level (`filters x levels`). Their contents will be consumed.
+    *
+    * @param[out] scores Scores for each pyramid level.
+    *
+    * @param[out] argmaxes Indices of the best model (mixture component) for each pyramid
+    * level.
+    */
+    void convolve(const FeaturePyramid & pyramid, std::vector< std::vector<ScalarMatrix> > & convolutions,
+                  std::vector<ScalarMatrix> & scores, std::vector<Indices> & argmaxes) const;
+    
+    /**
+    * Cache the transformed version of the models' filters for a given patchwork plane size.
+    *
+    * Transformed filters cached for plane sizes whose FFTW plans have been released by Patchwork
+    * (see Patchwork::HasPlans()) are removed from the cache, so that it does not grow indefinitely.
+    *
+    * This function may be called concurrently from several threads, as long as the
+    * mixture is not modified at the same time.
+    *
+    * @param[in] planeSize The size of the planes of the patchworks the filters will be convolved with.
     */
-    void cacheFilters() const;
+    void cacheFilters(const Patchwork::PlaneSize & planeSize) const;
+    
+    /**
+    * Returns the transformed filters of all models (in the order of the models and their parts)
+    * for a given patchwork plane size. The filters are cached first if necessary.
+    * The returned reference stays valid until the mixture is modified or no patchwork with the given
+    * plane size exists anymore and the plans for it have been released by Patchwork.
+    *
+    * This function may be called concurrently from several threads, as long as the
+    * mixture is not modified at the same time.
+    *
+    * @param[in] planeSize The size of the planes of the patchworks the filters will be convolved with.
+    */
+    const std::vector<Patchwork::Filter> & transformedFilters(const Patchwork::PlaneSize & planeSize) const;
+    
+    /**
+    * Convolves the filters of all models with the smaller levels of a pyramid in the spatial domain,
+    * complementing a Patchwork which has been created for the remaining levels only.
+    *
+    * @param[in] pyramid Pyramid of features.
+    *
+    * @param[in] firstLevel Index of the first pyramid level to be convolved.
+    *
+    * @param[in,out] convolutions Convolutions of the filters (in the order of transformedFilters())
+    * with each pyramid level (`filters x levels`). Will be resized to the number of filters and
+    * pyramid levels, keeping the convolutions with the levels before @p firstLevel.
+    */
+    void convolveDirect(const FeaturePyramid & pyramid, int firstLevel,
+                        std::vector< std::vector<ScalarMatrix> > & convolutions) const;
+    
+    /**
+    * Computes the scores of a root-only mixture (see rootOnly()) for the smaller levels of a pyramid
+    * in the spatial domain, complementing Patchwork::convolveMax() for the remaining levels.
+    *
+    * @param[in] pyramid Pyramid of features.
+    *
+    * @param[in] firstLevel Index of the first pyramid level to compute the scores for.
+    *
+    * @param[in,out] scores Scores for each pyramid level. Will be resized to the number of
+    * pyramid levels, keeping the scores for the levels before @p firstLevel.
+    *
+    * @param[in,out] argmaxes Indices of the best model for each pyramid level, handled like @p scores.
+    */
+    void maximizeDirect(const FeaturePyramid & pyramid, int firstLevel,
+                        std::vector<ScalarMatrix> & scores, std::vector<Indices> & argmaxes) const;
+    
+    /**
+    * Reads a mixture from a file, which may either be in the text format of operator>>() or in the
+    * binary format written by writeBinary(). The format is detected automatically.
+    *
+    * Binary files are mapped into memory and, if @p mapMemory is true, the filters and filter spectra
+    * stored in the file are used in place instead of being copied. Copies of the mixture or of its models
+    * do not depend on the mapping.
+    *
+    * @param[in] filename The path to the file.
+    *
+    * @param[in] mapMemory If set to false, the contents of binary files will be copied and the file will
+    * be unmapped before this function returns.
+    *
+    * @return Returns true if the file could be read, false if it could not be opened.
+    *
+    * @throws DeserializationException The file is in an unrecognized format or damaged.
+    *
+    * @throws UnknownFeatureExtractorException The feature extractor type specified in the model file is unknown.
+    *
+    * @throws UnknownParameterException One or more parameters listed in the file are not known
+    * by the given feature extractor.
+    *
+    * @throws std::invalid_argument A value found in the file for a parameter of the feature extractor
+    * is not allowed for the corresponding parameter.
+    */
+    bool readFromFile(const std::string & filename, bool mapMemory = true);
+    
+    /**
+    * Writes this mixture to a file.
+    *
+    * @param[in] filename The path to the file, which must not be the file this mixture has been mapped from.
+    *
+    * @param[in] binary If set to true, the binary format described at writeBinary() will be used instead of
+    * the text format of operator<<().
+    *
+    * @param[in] includeSpectra If set to true, binary files will also contain the transformed filters
+    * for all plane sizes they have been cached for (see cacheFilters()).
+    *
+    * @return Returns true if the file has been written successfully.
+    */
+    bool writeToFile(const std::string & filename, bool binary = false, bool includeSpectra = false) const;
+    
+    /**
+    * Serializes this mixture to a stream in a binary format, which can be used in place after mapping
+    * it into memory by readFromFile().
+    *
+    * The format consists of blocks, each of which is padded with zeros to a multiple of 64 bytes, so that
+    * all blocks and, thus, all filters are aligned to 64 bytes relative to the beginning of the file:
+    *
+    * 1. A header with the magic string `ARTOSMIX`, the format version (BinaryFormatVersion), a byte order
+    *    mark (`0x01020304`), the number of bits of a scalar, the number of models, the number of sets of
+    *    filter spectra and the length of the feature extractor block (all as 32-bit integers).
+    * 2. The type and parameters of the feature extractor as text, as in the text format.
+    * 3. For each model: A block with the number of parts and the bias, followed by a block for each part
+    *    with the size of the filter (rows, columns, channels), the offset and the deformation coefficients
+    *    and a block with the coefficients of the filter in the memory layout of FeatureMatrix.
+    * 4. For each set of filter spectra: A block with the plane size (rows, columns, features) and the number
+    *    of filters, followed by a block with the size of the filter and a block with the transformed filter
+    *    in the layout used by Patchwork for each filter of all models (in the order of transformedFilters()).
+    *
+    * No conversion of endianess is performed, but files with a different byte order will be rejected.
+    *
+    * @param[in] os The stream where the serialization should be written to.
+    *
+    * @param[in] includeSpectra If set to true, the transformed filters for all plane sizes they have
+    * been cached for (see cacheFilters()) will be serialized too.
+    */
+    void writeBinary(std::ostream & os, bool includeSpectra = false) const;
+    
+    /**
+    * Version of the binary format written by writeBinary().
+    */
+    static const uint32_t BinaryFormatVersion = 1;
     
 private:
 
@@ -195,13 +367,63 @@ private:
                   std::vector< std::vector< std::vector<Model::Positions> > > * positions = 0)
                  const;
     
+    /**
+    * Returns the scores of the convolutions + distance transforms of the models with a
+    * pyramid of features, given the convolutions of their filters with that pyramid.
+    *
+    * @param[in] pyramid Pyramid of features.
+    *
+    * @param[in,out] convolutions Convolutions of each filter with each pyramid level
+    * (`filters x levels`). Their contents will be consumed.
+    *
+    * @param[out] scores Scores of each model for each pyramid level
+    * (`models x levels`).
+    *
+    * @param[out] positions Positions of each part of each model for each pyramid level
+    * (`models x parts x levels`).
+    */
+    void convolve(const FeaturePyramid & pyramid,
+                  std::vector< std::vector<ScalarMatrix> > & convolutions,
+                  std::vector< std::vector<ScalarMatrix> > & scores,
+                  std::vector< std::vector< std::vector<Model::Positions> > > * positions = 0)
+                 const;
+    
+    /**
+    * Takes the maximum over the scores of all models for each position in a pyramid.
+    *
+    * @param[in] pyramid Pyramid of features.
+    *
+    * @param[in] tmp Scores of each model for each pyramid level (`models x levels`).
+    *
+    * @param[out] scores Maximum scores for each pyramid level.
+    *
+    * @param[out] argmaxes Indices of the best model for each pyramid level.
+    */
+    void maximize(const FeaturePyramid & pyramid,
+                  const std::vector< std::vector<ScalarMatrix> > & tmp,
+                  std::vector<ScalarMatrix> & scores, std::vector<Indices> & argmaxes) const;
+    
+    /**
+    * Deserializes a mixture from a memory-mapped file in the format written by writeBinary().
+    *
+    * @param[in] file The mapped file.
+    *
+    * @param[in] inPlace If set to true, the filters and spectra will refer to the mapped memory,
+    * otherwise they will be copied.
+    */
+    void readBinary(const std::shared_ptr<MappedFile> & file, bool inPlace);
+    
+    std::shared_ptr<MappedFile> mappedFile_; /**< The binary file the filters and spectra refer to if they are used in place. */
+    
     std::vector<Model> models_; /**< The mixture components. */
     
     std::shared_ptr<FeatureExtractor> featureExtractor_; /**< The feature extractor which has been used to create the models in the mixture. */
     
     // Used to speed up the convolutions
-    mutable std::vector<Patchwork::Filter> filterCache_; /**< Cache of transformed filters. */
-    volatile mutable int cached_; /**< Value of Patchwork::NumInits() as when the filters have been cached the last time. */
+    mutable std::map<Patchwork::PlaneSize, std::vector<Patchwork::Filter> > filterCache_; /**< Cache of transformed filters for each plane size. */
+    mutable std::map< Patchwork::PlaneSize, std::vector< std::shared_ptr<const Patchwork::Filter> > > sharedFilters_; /**< Shared transformed filters referred to by filterCache_ for each plane size they have been transformed for. */
+    mutable std::mutex filterCacheMutex_; /**< Guards filterCache_ and sharedFilters_ against concurrent access by const methods. */
+
 
 };
 
@@ -151,17 +151,29 @@ void Model::convolve(const FeaturePyramid & pyramid, vector< vector<ScalarMatrix
             (*positions)[i].resize(nbLevels);
     }
     
-    // Temporary data needed by the distance transforms
-    vector<Scalar> tmp(pyramid.levels()[0].rows() * pyramid.levels()[0].cols());
+    // The distance transforms of all parts at all part levels (the root is interval higher
+    // in the pyramid) are independent of each other
+    const int nbPartLevels = max(nbLevels - interval, 0);
+    int k;
+#pragma omp parallel for private(k)
+    for (k = 0; k < nbParts * nbPartLevels; ++k) {
+        const int i = k / nbPartLevels;
+        const int j = k % nbPartLevels;
+        
+        // Temporary data needed by the distance transform, kept by each thread for reuse
+        static thread_local vector<Scalar> tmp;
+        tmp.resize(convolutions[i + 1][j].size());
+        
+        DT2D(convolutions[i + 1][j], parts_[i + 1], tmp.data(),
+             positions ? &(*positions)[i][j] : 0);
+    }
     
-    // For each part
-    for (int i = 0; i < nbParts; ++i) {
-        // For each part level (the root is interval higher in the pyramid)
-        for (int j = 0; j < nbLevels - interval; ++j) {
-            DT2D(convolutions[i + 1][j], parts_[i + 1], &tmp[0],
-                 positions ? &(*positions)[i][j] : 0);
-            
-            // Add the distance transforms of the part one octave below
+    // For each part level, add the distance transforms of the parts one octave below, in the
+    // order of the parts
+    int j;
+#pragma omp parallel for private(j)
+    for (j = 0; j < nbPartLevels; ++j) {
+        for (int i = 0; i < nbParts; ++i) {
             for (int y = 0; y < convolutions[0][j + interval].rows(); ++y) {
                 for (int x = 0; x < convolutions[0][j + interval].cols(); ++x) {
                     // The position of the root one octave below
@@ -267,13 +279,30 @@ void Model::DT2D(ScalarMatrix & matrix, const Model::Part & part, Scalar * tmp,
     const int rows = matrix.rows();
     const int cols = matrix.cols();
     
+    // Only the even columns are transformed by the second pass, since the root is one octave
+    // above the parts
+    const int halfCols = (cols + 1) / 2;
+    
+    // Number of columns transformed at once by the second pass
+    const int blockCols = 16;
+    
     if (positions)
         positions->resize(rows, cols);
     
-    // Temporary vectors
-    vector<Scalar> z(max(rows, cols) + 1);
-    vector<int> v(max(rows, cols) + 1);
-    vector<Scalar> t(max(rows, cols));
+    // Temporary vectors, kept by each thread so that they are only reallocated when they grow
+    static thread_local vector<Scalar> z, t, colsIn, colsOut;
+    static thread_local vector<int> v, argmaxesX, argmaxesY;
+    z.resize(max(rows, cols) + 1);
+    v.resize(max(rows, cols) + 1);
+    t.resize(max(rows, cols));
+    colsIn.resize(blockCols * rows);
+    colsOut.resize(blockCols * rows);
+    
+    // The argmaxes of both passes are stored contiguously and only combined at the end
+    if (positions) {
+        argmaxesX.resize(rows * cols);
+        argmaxesY.resize(blockCols * rows);
+    }
     
     t[0] = numeric_limits<Scalar>::infinity();
     
@@ -283,29 +312,45 @@ void Model::DT2D(ScalarMatrix & matrix, const Model::Part & part, Scalar * tmp,
     // Filter the rows in tmp
     for (int y = 0; y < rows; ++y)
         DT1D(matrix.row(y).data(), cols, part.deformation(0), part.deformation(1), &z[0], &v[0],
-             tmp + y * cols, positions ? positions->row(y).data()->data() : 0, part.offset(0),
-             &t[0], 1, 1, 2);
+             tmp + y * cols, positions ? &argmaxesX[y * cols] : 0, part.offset(0), &t[0]);
     
     for (int y = 1; y < rows; ++y)
         t[y] = 1 / (part.deformation(2) * y);
     
-    // Filter the columns back to the original matrix
-    for (int x = 0; x < cols; x += 2)
-        DT1D(tmp + x, rows, part.deformation(2), part.deformation(3), &z[0], &v[0],
-             matrix.data() + x, positions ? ((positions->data() + x)->data() + 1) : 0,
-             part.offset(1), &t[0], cols, cols, cols * 2);
-    
-    // Re-index the best x positions now that the best y changed
-    if (positions) {
-        Eigen::Map<Eigen::MatrixXi> tmp2(reinterpret_cast<int *>(tmp), rows, cols);
+    // Filter the columns back to the original matrix. Blocks of columns are transposed into
+    // a contiguous buffer first, so that each row of tmp is read only once per block.
+    for (int x0 = 0; x0 < halfCols; x0 += blockCols) {
+        const int n = min(blockCols, halfCols - x0);
         
-        for (int y = 0; y < rows; ++y)
-            for (int x = 0; x < cols; x += 2)
-                tmp2(y, x) = (*positions)(y, x)(0);
+        for (int y = 0; y < rows; ++y) {
+            const Scalar * src = tmp + y * cols + x0 * 2;
+            
+            for (int b = 0; b < n; ++b)
+                colsIn[b * rows + y] = src[b * 2];
+        }
         
-        for (int y = 0; y < rows; ++y)
-            for (int x = 0; x < cols; x += 2)
-                (*positions)(y, x)(0) = tmp2((*positions)(y, x)(1), x);
+        for (int b = 0; b < n; ++b)
+            DT1D(&colsIn[b * rows], rows, part.deformation(2), part.deformation(3), &z[0], &v[0],
+                 &colsOut[b * rows], positions ? &argmaxesY[b * rows] : 0, part.offset(1), &t[0]);
+        
+        for (int y = 0; y < rows; ++y) {
+            Scalar * dst = matrix.data() + y * cols + x0 * 2;
+            
+            for (int b = 0; b < n; ++b)
+                dst[b * 2] = colsOut[b * rows + y];
+        }
+        
+        // Re-index the best x positions now that the best y changed
+        if (positions) {
+            for (int b = 0; b < n; ++b) {
+                const int x = (x0 + b) * 2;
+                
+                for (int y = 0; y < rows; ++y) {
+                    const int y2 = argmaxesY[b * rows + y];
+                    (*positions)(y, x) = Position(argmaxesX[y2 * cols + x], y2);
+                }
+            }
+        }
     }
 }
 
@@ -218,6 +218,8 @@ private:
     * @param[in] part Part from which to read the deformation cost and offset.
     * @param tmp Temporary buffer of length at least the size of the matrix.
     * @param[out] positions Optimal position of each part for each root location.
+    * @note Since the root is one octave above the parts, only the even columns are transformed
+    * by the second pass.
     */
     static void DT2D(ScalarMatrix & matrix, const Model::Part & part, Scalar * tmp,
                      Positions * positions = 0);
@@ -19,33 +19,378 @@
 //--------------------------------------------------------------------------------------------------
 
 #include "Patchwork.h"
+#include "MappedFile.h"
+#include "sysutils.h"
 
 #include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
 #include <numeric>
+#include <sstream>
+#include <thread>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__)) && !defined(ARTOS_NO_SIMD)
+#define ARTOS_PATCHWORK_SIMD
+#include <immintrin.h>
+#endif
 
 using namespace ARTOS;
 using namespace std;
 
-int Patchwork::MaxRows_(0);
-int Patchwork::MaxCols_(0);
-int Patchwork::HalfCols_(0);
-int Patchwork::NumFeat_(0);
+// Computes the sums over all features of the products of the cells of a filter and a plane, for a run of
+// consecutive cells. Both are given in split layout, i.e. the real parts of all features of a cell are
+// followed by their imaginary parts.
+typedef void (*MultiplyAccumulateKernel)(const FeatureScalar * filter, const FeatureScalar * plane,
+                                         int numFeatures, int numCells, Patchwork::Scalar * sums);
+
+static void multiplyAccumulate(const FeatureScalar * filter, const FeatureScalar * plane,
+                               int numFeatures, int numCells, Patchwork::Scalar * sums)
+{
+    for (int l = 0; l < numCells; ++l, filter += 2 * numFeatures, plane += 2 * numFeatures) {
+        FeatureScalar re = 0, im = 0;
+        
+        for (int c = 0; c < numFeatures; ++c) {
+            re += filter[c] * plane[c] - filter[numFeatures + c] * plane[numFeatures + c];
+            im += filter[c] * plane[numFeatures + c] + filter[numFeatures + c] * plane[c];
+        }
+        
+        sums[l] = Patchwork::Scalar(re, im);
+    }
+}
+
+#ifdef ARTOS_PATCHWORK_SIMD
+
+__attribute__((target("sse2")))
+static inline float horizontalSum_SSE2(__m128 x)
+{
+    x = _mm_add_ps(x, _mm_movehl_ps(x, x));
+    x = _mm_add_ss(x, _mm_shuffle_ps(x, x, 1));
+    return _mm_cvtss_f32(x);
+}
+
+__attribute__((target("sse2")))
+static void multiplyAccumulate_SSE2(const FeatureScalar * filter, const FeatureScalar * plane,
+                                    int numFeatures, int numCells, Patchwork::Scalar * sums)
+{
+    const int numVectorized = numFeatures & ~3;
+    
+    for (int l = 0; l < numCells; ++l, filter += 2 * numFeatures, plane += 2 * numFeatures) {
+        const FeatureScalar * fi = filter + numFeatures;
+        const FeatureScalar * pi = plane + numFeatures;
+        __m128 re = _mm_setzero_ps(), im = _mm_setzero_ps();
+        int c;
+        
+        for (c = 0; c < numVectorized; c += 4) {
+            const __m128 a = _mm_loadu_ps(filter + c), b = _mm_loadu_ps(fi + c);
+            const __m128 x = _mm_loadu_ps(plane + c), y = _mm_loadu_ps(pi + c);
+            re = _mm_add_ps(re, _mm_sub_ps(_mm_mul_ps(a, x), _mm_mul_ps(b, y)));
+            im = _mm_add_ps(im, _mm_add_ps(_mm_mul_ps(a, y), _mm_mul_ps(b, x)));
+        }
+        
+        FeatureScalar sumRe = horizontalSum_SSE2(re), sumIm = horizontalSum_SSE2(im);
+        for (; c < numFeatures; ++c) {
+            sumRe += filter[c] * plane[c] - fi[c] * pi[c];
+            sumIm += filter[c] * pi[c] + fi[c] * plane[c];
+        }
+        
+        sums[l] = Patchwork::Scalar(sumRe, sumIm);
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void multiplyAccumulate_AVX2(const FeatureScalar * filter, const FeatureScalar * plane,
+                                    int numFeatures, int numCells, Patchwork::Scalar * sums)
+{
+    const int numVectorized = numFeatures & ~7;
+    
+    for (int l = 0; l < numCells; ++l, filter += 2 * numFeatures, plane += 2 * numFeatures) {
+        const FeatureScalar * fi = filter + numFeatures;
+        const FeatureScalar * pi = plane + numFeatures;
+        __m256 re = _mm256_setzero_ps(), im = _mm256_setzero_ps();
+        int c;
+        
+        for (c = 0; c < numVectorized; c += 8) {
+            const __m256 a = _mm256_loadu_ps(filter + c), b = _mm256_loadu_ps(fi + c);
+            const __m256 x = _mm256_loadu_ps(plane + c), y = _mm256_loadu_ps(pi + c);
+            re = _mm256_fnmadd_ps(b, y, _mm256_fmadd_ps(a, x, re));
+            im = _mm256_fmadd_ps(b, x, _mm256_fmadd_ps(a, y, im));
+        }
+        
+        // Sum up the real and the imaginary parts at once
+        const __m256 h = _mm256_hadd_ps(re, im);
+        const __m128 q = _mm_add_ps(_mm256_castps256_ps128(h), _mm256_extractf128_ps(h, 1));
+        FeatureScalar sumRe = _mm_cvtss_f32(_mm_add_ss(q, _mm_shuffle_ps(q, q, 1)));
+        FeatureScalar sumIm = _mm_cvtss_f32(_mm_add_ss(_mm_shuffle_ps(q, q, 2), _mm_shuffle_ps(q, q, 3)));
+        for (; c < numFeatures; ++c) {
+            sumRe += filter[c] * plane[c] - fi[c] * pi[c];
+            sumIm += filter[c] * pi[c] + fi[c] * plane[c];
+        }
+        
+        sums[l] = Patchwork::Scalar(sumRe, sumIm);
+    }
+}
+
+#endif
+
+// Selects the multiply-accumulate kernel best suited for the CPU we're running on
+static MultiplyAccumulateKernel selectMultiplyAccumulateKernel()
+{
+#ifdef ARTOS_PATCHWORK_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return multiplyAccumulate_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return multiplyAccumulate_SSE2;
+#endif
+    return multiplyAccumulate;
+}
+
+// Computes the dot product of two vectors of features
+typedef FeatureScalar (*DotKernel)(const FeatureScalar * a, const FeatureScalar * b, int n);
+
+static FeatureScalar dot(const FeatureScalar * a, const FeatureScalar * b, int n)
+{
+    FeatureScalar sum = 0;
+    
+    for (int i = 0; i < n; ++i)
+        sum += a[i] * b[i];
+    
+    return sum;
+}
+
+#ifdef ARTOS_PATCHWORK_SIMD
+
+__attribute__((target("sse2")))
+static FeatureScalar dot_SSE2(const FeatureScalar * a, const FeatureScalar * b, int n)
+{
+    __m128 sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps();
+    int i;
+    
+    for (i = 0; i + 8 <= n; i += 8) {
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    
+    FeatureScalar sum = horizontalSum_SSE2(_mm_add_ps(sum0, sum1));
+    for (; i < n; ++i)
+        sum += a[i] * b[i];
+    
+    return sum;
+}
+
+__attribute__((target("avx2,fma")))
+static FeatureScalar dot_AVX2(const FeatureScalar * a, const FeatureScalar * b, int n)
+{
+    __m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps();
+    int i;
+    
+    for (i = 0; i + 16 <= n; i += 16) {
+        sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum0);
+        sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), sum1);
+    }
+    if (i + 8 <= n) {
+        sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum0);
+        i += 8;
+    }
+    
+    const __m256 s = _mm256_add_ps(sum0, sum1);
+    FeatureScalar sum = horizontalSum_SSE2(_mm_add_ps(_mm256_castps256_ps128(s), _mm256_extractf128_ps(s, 1)));
+    for (; i < n; ++i)
+        sum += a[i] * b[i];
+    
+    return sum;
+}
+
+#endif
+
+// Selects the dot product kernel best suited for the CPU we're running on
+static DotKernel selectDotKernel()
+{
+#ifdef ARTOS_PATCHWORK_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return dot_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return dot_SSE2;
+#endif
+    return dot;
+}
+
+// Gathers the planar spectra of all features into the cells of a plane in split layout
+static void toSplitLayout(const PlanarFeatureMatrix & spectra, Patchwork::Plane & plane)
+{
+    const int numFeatures = plane.channels();
+    const int numCells = plane.numCells();
+    const Patchwork::Scalar * spectrum = reinterpret_cast<const Patchwork::Scalar *>(spectra.raw());
+    FeatureScalar * split = reinterpret_cast<FeatureScalar *>(plane.raw());
+    
+    // Process blocks of cells, so that the rows of all spectra being read stay in cache
+    const int blockSize = 64;
+    for (int first = 0; first < numCells; first += blockSize) {
+        const int last = min(first + blockSize, numCells);
+        for (int c = 0; c < numFeatures; ++c) {
+            const Patchwork::Scalar * src = spectrum + c * numCells;
+            for (int i = first; i < last; ++i) {
+                split[i * 2 * numFeatures + c] = src[i].real();
+                split[i * 2 * numFeatures + numFeatures + c] = src[i].imag();
+            }
+        }
+    }
+}
+
+// Returns a thread-local buffer for the planar transform of a plane of the given size
+static PlanarFeatureMatrix & planarBuffer(const Patchwork::PlaneSize & planeSize)
+{
+    // Each channel holds maxRows x (maxCols / 2 + 1) complex numbers after the in-place transform
+    static thread_local PlanarFeatureMatrix buffer;
+    buffer.resize(planeSize.rows, (planeSize.cols / 2 + 1) * 2, planeSize.features);
+    return buffer;
+}
+
+// FFTW plans for planes of a specific size
+struct Patchwork::Plans
+{
+    fftwf_plan forwards;
+    fftwf_plan inverse;
+    
+    Plans() : forwards(0), inverse(0) {};
+    
+    ~Plans()
+    {
+        // Plans are destroyed when the last patchwork using them is destroyed, which may happen
+        // concurrently with planning, so this must never be reached while holding PlanCacheMutex_
+        lock_guard<mutex> lock(PlanCacheMutex_);
+        if (forwards != 0)
+            fftwf_destroy_plan(forwards);
+        if (inverse != 0)
+            fftwf_destroy_plan(inverse);
+    };
+};
+
+// A transformed filter shared by SharedTransformedFilter(), together with the coefficients it has been
+// computed from. Both may refer to a mapped spectrum file.
+struct Patchwork::SharedSpectrum
+{
+    Filter filter;
+    FeatureMatrix coefficients;
+    shared_ptr<MappedFile> file;
+};
+
+mutex Patchwork::PlanCacheMutex_; // defined before PlanCache_, since the cached plans lock it on destruction
+map<Patchwork::PlaneSize, shared_ptr<const Patchwork::Plans> > Patchwork::PlanCache_;
+map<Patchwork::PlaneSize, uint64_t> Patchwork::PlanLastUse_;
+map<Patchwork::PlaneSize, weak_ptr<const Patchwork::Plans> > Patchwork::EvictedPlans_;
+uint64_t Patchwork::PlanUseCounter_(0);
+size_t Patchwork::MaxPlaneSizes_(16);
 int Patchwork::NumInits_(0);
+string Patchwork::WisdomFile_("wisdom.fftw");
+map<Patchwork::SpectrumKey, weak_ptr<const Patchwork::SharedSpectrum> > Patchwork::SpectrumCache_;
+mutex Patchwork::SpectrumCacheMutex_;
+string Patchwork::SpectrumCacheDirectory_;
+size_t Patchwork::SpectrumCacheSweepSize_(64);
+
+namespace
+{
+
+// Spectrum files consist of this header, followed by the coefficients of the filter and its
+// transformed version in the split layout used by Patchwork, each padded to a multiple of 64 bytes
+// so that the transformed filter is as aligned as the memory of feature matrices.
+const char SpectrumFileMagic[8] = { 'A', 'R', 'T', 'O', 'S', 'S', 'P', 'C' };
+const uint32_t SpectrumFileVersion = 1;
+const uint32_t SpectrumFileByteOrderMark = 0x01020304;
+const size_t SpectrumFileBlockSize = 64;
 
-fftwf_plan Patchwork::Forwards_(0);
-fftwf_plan Patchwork::Inverse_(0);
+struct SpectrumFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t scalarBits;
+    int32_t planeRows, planeCols, features;
+    int32_t filterRows, filterCols;
+    uint32_t reserved;
+    uint64_t hash;
+    char padding[8];
+};
+static_assert(sizeof(SpectrumFileHeader) == SpectrumFileBlockSize, "Unexpected size of spectrum file header.");
+
+size_t paddedSize(size_t bytes)
+{
+    return (bytes + SpectrumFileBlockSize - 1) / SpectrumFileBlockSize * SpectrumFileBlockSize;
+}
+
+// FNV-1a hash of the size and the coefficients of a filter
+uint64_t hashFilter(const FeatureMatrix & filter)
+{
+    const int32_t dims[3] = { static_cast<int32_t>(filter.rows()), static_cast<int32_t>(filter.cols()),
+                              static_cast<int32_t>(filter.channels()) };
+    uint64_t hash = 14695981039346656037ULL;
+    const unsigned char * bytes = reinterpret_cast<const unsigned char *>(dims);
+    for (size_t i = 0; i < sizeof(dims); ++i)
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    bytes = reinterpret_cast<const unsigned char *>(filter.raw());
+    for (size_t i = 0, n = filter.numEl() * sizeof(FeatureScalar); i < n; ++i)
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    return hash;
+}
+
+bool sameFilter(const FeatureMatrix & a, const FeatureMatrix & b)
+{
+    return (a.rows() == b.rows() && a.cols() == b.cols() && a.channels() == b.channels()
+            && memcmp(a.raw(), b.raw(), a.numEl() * sizeof(FeatureScalar)) == 0);
+}
+
+}
 
 Patchwork::Patchwork() : padding_(0), interval_(0)
 {
 }
 
-Patchwork::Patchwork(const FeaturePyramid & pyramid, const Size & padding) : padding_(padding), interval_(pyramid.interval())
+Patchwork::Patchwork(const FeaturePyramid & pyramid, const Size & padding, int numLevels)
+: padding_(padding), interval_(pyramid.interval())
 {
-    if (pyramid.featureExtractor()->numFeatures() != NumFeat_)
+    assign(pyramid, padding, numLevels);
+}
+
+void Patchwork::assign(const FeaturePyramid & pyramid, const Size & padding, int numLevels)
+{
+    padding_ = padding;
+    interval_ = pyramid.interval();
+    rectangles_.clear();
+    planeSize_ = PlaneSize();
+    plans_.reset();
+    
+    const int nbLevels = (numLevels >= 0) ? min(numLevels, static_cast<int>(pyramid.levels().size()))
+                                          : static_cast<int>(pyramid.levels().size());
+    if (nbLevels == 0) {
+        planes_.clear();
         return;
+    }
+    
+    // Choose the smallest plane size the largest level fits into
+    Size maxLevelSize(0, 0);
+    for (int i = 0; i < nbLevels; ++i)
+        maxLevelSize = max(maxLevelSize, Size(pyramid.levels()[i].cols(), pyramid.levels()[i].rows()));
+    if (!FindPlaneSize(maxLevelSize.height + padding_.height, maxLevelSize.width + padding_.width,
+                       pyramid.featureExtractor()->numFeatures(), planeSize_)) {
+        planes_.clear();
+        return;
+    }
+    plans_ = GetPlans(planeSize_);
+    if (!plans_) {
+        planes_.clear();
+        return;
+    }
+    
+    const int maxRows = planeSize_.rows;
+    const int maxCols = planeSize_.cols;
+    const int halfCols = maxCols / 2 + 1;
+    const int numFeatures = planeSize_.features;
     
-    const int nbLevels = pyramid.levels().size();
     rectangles_.resize(nbLevels);
     
     // Add padding to the bottom/right sides of levels since convolutions with Fourier wrap around
@@ -56,34 +401,38 @@ Patchwork::Patchwork(const FeaturePyramid & pyramid, const Size & padding) : pad
     }
     
     // Build the patchwork planes
-    const int nbPlanes = BLF(rectangles_, MaxCols_, MaxRows_);
+    const int nbPlanes = BLF(rectangles_, maxCols, maxRows);
     
     // Constructs an empty patchwork in case of error
-    if (nbPlanes <= 0)
+    if (nbPlanes <= 0) {
+        planes_.clear();
         return;
+    }
     
+    // Planes are only reallocated if they grow
     planes_.resize(nbPlanes);
     for (int i = 0; i < nbPlanes; ++i)
-        planes_[i] = Plane(MaxRows_, HalfCols_, Plane::Cell::Zero(NumFeat_));
-    
-    // Fill the planes with the levels from the pyramid
-    for (int i = 0; i < nbLevels; ++i)
-    {
-        Eigen::Map<ScalarMatrix>
-            plane(reinterpret_cast<FeatureScalar*>(planes_[rectangles_[i].plane()].raw()),
-                  MaxRows_, HalfCols_ * 2 * NumFeat_);
-        
-        plane.block(rectangles_[i].y(), rectangles_[i].x() * NumFeat_,
-                    rectangles_[i].height() - padding_.height, (rectangles_[i].width() - padding_.width) * NumFeat_) =
-            pyramid.levels()[i].data();
-    }
+        planes_[i].resize(maxRows, halfCols, numFeatures);
     
-    // Transform the planes
+    // Fill the planes with the levels from the pyramid in planar layout and transform them
     int i;
 #pragma omp parallel for private(i)
-    for (i = 0; i < nbPlanes; ++i)
-        fftwf_execute_dft_r2c(Forwards_, reinterpret_cast<float *>(planes_[i].raw()),
-                              reinterpret_cast<fftwf_complex *>(planes_[i].raw()));
+    for (i = 0; i < nbPlanes; ++i) {
+        PlanarFeatureMatrix & planar = planarBuffer(planeSize_);
+        planar.setZero();
+        
+        for (int j = 0; j < nbLevels; ++j)
+            if (rectangles_[j].plane() == i)
+                planar.setBlock(rectangles_[j].y(), rectangles_[j].x(), pyramid.levels()[j]);
+        
+        fftwf_execute_dft_r2c(plans_->forwards, planar.raw(), reinterpret_cast<fftwf_complex *>(planar.raw()));
+        toSplitLayout(planar, planes_[i]);
+    }
+}
+
+const Patchwork::PlaneSize & Patchwork::planeSize() const
+{
+    return this->planeSize_;
 }
 
 const Size & Patchwork::padding() const
@@ -101,56 +450,44 @@ bool Patchwork::empty() const
     return planes_.empty();
 }
 
+// Returns pointers to the elements of a vector of filters
+static vector<const Patchwork::Filter *> filterPointers(const vector<Patchwork::Filter> & filters)
+{
+    vector<const Patchwork::Filter *> pointers(filters.size());
+    
+    for (size_t i = 0; i < filters.size(); ++i)
+        pointers[i] = &filters[i];
+    
+    return pointers;
+}
+
 void Patchwork::convolve(const vector<Filter> & filters,
-                         vector<vector<ScalarMatrix> > & convolutions) const
+                         vector<vector<ScalarMatrix> > & convolutions,
+                         Products * products) const
 {
-    int i, j, k, l;
+    convolve(filterPointers(filters), convolutions, products);
+}
+
+void Patchwork::convolve(const vector<const Filter *> & filters,
+                         vector<vector<ScalarMatrix> > & convolutions,
+                         Products * products) const
+{
+    int i, j;
     const int nbFilters = filters.size();
     const int nbPlanes = planes_.size();
     const int nbLevels = rectangles_.size();
     
-    // Early return if the patchwork or the filters are empty
-    if (empty() || !nbFilters)
+    // Pointwise multiply the transformed filters with the patchwork's planes
+    Products tmp;
+    Products & sums = products ? *products : tmp;
+    if (!multiply(filters, sums))
     {
         convolutions.clear();
         return;
     }
     
-    // Pointwise multiply the transformed filters with the patchwork's planes
-    // The performace measurements reported in the paper were done without reallocating the sums
-    // each time by making them static
-    // Even though it was faster (~10%) I removed it as it was not clean/thread safe
-    vector<vector<Plane::ScalarMatrix> > sums(nbFilters);
-    for (i = 0; i < nbFilters; ++i)
-    {
-        sums[i].resize(nbPlanes);
-        for (j = 0; j < nbPlanes; ++j)
-            sums[i][j].resize(MaxRows_, HalfCols_);
-    }
-    
-    // The following assumptions are not dangerous in the sense that the program will only work
-    // slower if they do not hold
-    const int cacheSize = 32768; // Assume L1 cache of 32K
-    const int fragmentsSize = (nbPlanes + 1) * NumFeat_ * sizeof(Scalar); // Assume nbPlanes < nbFilters
-    const int step = max(1, min(cacheSize / fragmentsSize,
-#ifdef _OPENMP
-                         MaxRows_ * HalfCols_ / omp_get_max_threads()));
-#else
-                         MaxRows_ * HalfCols_));
-#endif
-    
-#pragma omp parallel for private(i,j,k,l)
-    for (i = 0; i <= MaxRows_ * HalfCols_ - step; i += step)
-        for (j = 0; j < nbFilters; ++j)
-            for (k = 0; k < nbPlanes; ++k)
-                for (l = 0; l < step; ++l)
-                    sums[j][k](i + l) =
-                        filters[j].first.cell(i + l).cwiseProduct(planes_[k].cell(i + l)).sum();
-    
-    for (i = MaxRows_ * HalfCols_ - ((MaxRows_ * HalfCols_) % step); i < MaxRows_ * HalfCols_; ++i)
-        for (j = 0; j < nbFilters; ++j)
-            for (k = 0; k < nbPlanes; ++k)
-                sums[j][k](i) = filters[j].first.cell(i).cwiseProduct(planes_[k].cell(i)).sum();
+    const int maxRows = planeSize_.rows;
+    const int halfCols = planeSize_.cols / 2 + 1;
     
     // Transform back the results and store them in convolutions
     convolutions.resize(nbFilters);
@@ -164,9 +501,9 @@ void Patchwork::convolve(const vector<Filter> & filters,
         const int p = i % nbPlanes; // Plane index
         
         Eigen::Map<ScalarMatrix> output(reinterpret_cast<FeatureScalar*>(sums[f][p].data()),
-                                 MaxRows_, HalfCols_ * 2);
+                                 maxRows, halfCols * 2);
         
-        fftwf_execute_dft_c2r(Inverse_, reinterpret_cast<fftwf_complex *>(sums[f][p].data()),
+        fftwf_execute_dft_c2r(plans_->inverse, reinterpret_cast<fftwf_complex *>(sums[f][p].data()),
                               output.data());
         
         for (j = 0; j < nbLevels; ++j)
@@ -184,104 +521,605 @@ void Patchwork::convolve(const vector<Filter> & filters,
     }
 }
 
+void Patchwork::convolveMax(const vector<Filter> & filters, const vector<int> & groupSizes,
+                            const vector<FeatureScalar> & biases,
+                            vector<vector<ScalarMatrix> > & scores,
+                            vector<vector<Indices> > & argmaxes,
+                            Products * products) const
+{
+    convolveMax(filterPointers(filters), groupSizes, biases, scores, argmaxes, products);
+}
+
+void Patchwork::convolveMax(const vector<const Filter *> & filters, const vector<int> & groupSizes,
+                            const vector<FeatureScalar> & biases,
+                            vector<vector<ScalarMatrix> > & scores,
+                            vector<vector<Indices> > & argmaxes,
+                            Products * products) const
+{
+    int i, j;
+    const int nbGroups = groupSizes.size();
+    const int nbPlanes = planes_.size();
+    const int nbLevels = rectangles_.size();
+    
+    // Determine the first filter of each group
+    vector<int> offsets(nbGroups + 1, 0);
+    for (i = 0; i < nbGroups; ++i)
+        offsets[i + 1] = offsets[i] + groupSizes[i];
+    
+    // Pointwise multiply the transformed filters with the patchwork's planes
+    Products tmp;
+    Products & sums = products ? *products : tmp;
+    if (offsets[nbGroups] != static_cast<int>(filters.size()) || biases.size() != filters.size()
+            || !multiply(filters, sums))
+    {
+        scores.clear();
+        argmaxes.clear();
+        return;
+    }
+    
+    const int maxRows = planeSize_.rows;
+    const int halfCols = planeSize_.cols / 2 + 1;
+    
+    // Existing score matrices of the right size are reused
+    scores.resize(nbGroups);
+    argmaxes.resize(nbGroups);
+    for (i = 0; i < nbGroups; ++i) {
+        scores[i].resize(nbLevels);
+        argmaxes[i].resize(nbLevels);
+    }
+    
+    // Transform back the results of the filters of each group one after another and keep only the
+    // maximum, so that each task writes to the levels on one plane of one group only
+#pragma omp parallel for private(i,j)
+    for (i = 0; i < nbGroups * nbPlanes; ++i)
+    {
+        const int g = i / nbPlanes; // Group index
+        const int p = i % nbPlanes; // Plane index
+        
+        for (int f = offsets[g]; f < offsets[g + 1]; ++f)
+        {
+            Eigen::Map<ScalarMatrix> output(reinterpret_cast<FeatureScalar*>(sums[f][p].data()),
+                                     maxRows, halfCols * 2);
+            
+            fftwf_execute_dft_c2r(plans_->inverse, reinterpret_cast<fftwf_complex *>(sums[f][p].data()),
+                                  output.data());
+            
+            const FeatureScalar bias = biases[f];
+            const int index = f - offsets[g];
+            
+            for (j = 0; j < nbLevels; ++j)
+                if (rectangles_[j].plane() == p)
+                {
+                    const int rows = rectangles_[j].height() - padding_.height;
+                    const int cols = rectangles_[j].width() - padding_.width;
+                    if (rows <= 0 || cols <= 0)
+                        continue;
+                    
+                    const int x0 = rectangles_[j].x();
+                    const int y0 = rectangles_[j].y();
+                    ScalarMatrix & levelScores = scores[g][j];
+                    Indices & levelArgmaxes = argmaxes[g][j];
+                    
+                    if (index == 0)
+                    {
+                        levelScores = output.block(y0, x0, rows, cols).array() + bias;
+                        levelArgmaxes.setZero(rows, cols);
+                    }
+                    else
+                        for (int y = 0; y < rows; ++y)
+                        {
+                            const FeatureScalar * response = output.data() + (y0 + y) * output.cols() + x0;
+                            FeatureScalar * score = levelScores.data() + y * cols;
+                            int * argmax = levelArgmaxes.data() + y * cols;
+                            for (int x = 0; x < cols; ++x)
+                            {
+                                const FeatureScalar value = response[x] + bias;
+                                if (value > score[x])
+                                {
+                                    score[x] = value;
+                                    argmax[x] = index;
+                                }
+                            }
+                        }
+                }
+        }
+    }
+}
+
+void Patchwork::ConvolveDirect(const FeatureMatrix & level, const FeatureMatrix & filter, ScalarMatrix & result)
+{
+    static const DotKernel dotKernel = selectDotKernel();
+    
+    const int rows = level.rows();
+    const int cols = level.cols();
+    const int numFeatures = level.channels();
+    
+    if (level.empty() || filter.empty() || filter.channels() != numFeatures) {
+        result.resize(0, 0);
+        return;
+    }
+    
+    // Since the cells of a row are stored consecutively with all their features, the response of
+    // each row of the filter is a single dot product with a run of consecutive cells of a level row.
+    // All rows of the level needed for a row of results stay in the cache while processing that row.
+    result.setZero(rows, cols);
+    for (int y = 0; y < rows; ++y) {
+        const int filterRows = min(static_cast<int>(filter.rows()), rows - y);
+        for (int i = 0; i < filterRows; ++i) {
+            const FeatureScalar * levelRow = level.raw() + (y + i) * cols * numFeatures;
+            const FeatureScalar * filterRow = filter.raw() + i * filter.cols() * numFeatures;
+            for (int x = 0; x < cols; ++x)
+                result(y, x) += dotKernel(levelRow + x * numFeatures, filterRow,
+                                          min(static_cast<int>(filter.cols()), cols - x) * numFeatures);
+        }
+    }
+}
+
+int Patchwork::NumFFTLevels(const FeaturePyramid & pyramid, const Size & padding, int numFilters, int numFilterCells)
+{
+    const int nbLevels = pyramid.levels().size();
+    if (nbLevels == 0 || numFilters <= 0)
+        return nbLevels;
+    
+    const int numFeatures = pyramid.levels()[0].channels();
+    
+    // The planes must be large enough for the largest level
+    const double planeCells = static_cast<double>(pyramid.levels()[0].rows() + padding.height)
+                              * (pyramid.levels()[0].cols() + padding.width);
+    
+    // Approximate number of multiply-add operations per cell of a plane: a real FFT of n values
+    // takes about 1.25 n log2(n) of them and is needed for each feature and each filter. The
+    // complex products with the filters are computed for half of the spectrum only.
+    const double fftCostPerCell = 1.25 * log2(max(planeCells, 2.0)) * (numFeatures + numFilters)
+                                  + 2.0 * numFeatures * numFilters;
+    
+    // Direct convolution is preferable for the smallest levels, where padding dominates the size
+    // of the levels in the planes
+    int numFFTLevels = nbLevels;
+    for (; numFFTLevels > 0; --numFFTLevels) {
+        const FeatureMatrix & level = pyramid.levels()[numFFTLevels - 1];
+        const double directCost = static_cast<double>(level.rows()) * level.cols() * numFilterCells * numFeatures;
+        const double fftCost = static_cast<double>(level.rows() + padding.height) * (level.cols() + padding.width)
+                               * fftCostPerCell;
+        if (directCost > fftCost)
+            break;
+    }
+    return numFFTLevels;
+}
+
+bool Patchwork::multiply(const vector<const Filter *> & filters, Products & sums) const
+{
+    int i, j, k;
+    const int nbFilters = filters.size();
+    const int nbPlanes = planes_.size();
+    
+    // Early return if the patchwork or the filters are empty
+    if (empty() || !nbFilters)
+        return false;
+    
+    const int maxRows = planeSize_.rows;
+    const int halfCols = planeSize_.cols / 2 + 1;
+    const int numFeatures = planeSize_.features;
+    
+    // The filters must have been transformed for the size of our planes
+    for (i = 0; i < nbFilters; ++i)
+        if (filters[i]->first.rows() != maxRows || filters[i]->first.cols() != halfCols || filters[i]->first.channels() != numFeatures)
+            return false;
+    
+    static const MultiplyAccumulateKernel multiplyAccumulateKernel = selectMultiplyAccumulateKernel();
+    
+    // Pointwise multiply the transformed filters with the patchwork's planes
+    // The performace measurements reported in the paper were done without reallocating the sums
+    // each time by making them static
+    // Even though it was faster (~10%) I removed it as it was not clean/thread safe
+    // Callers may keep the sums instead, which are only reallocated if their size changes
+    sums.resize(nbFilters);
+    for (i = 0; i < nbFilters; ++i)
+    {
+        sums[i].resize(nbPlanes);
+        for (j = 0; j < nbPlanes; ++j)
+            sums[i][j].resize(maxRows, halfCols);
+    }
+    
+    // The following assumptions are not dangerous in the sense that the program will only work
+    // slower if they do not hold
+    // The spectrum is processed in tiles, so that the tiles of all planes stay in the cache while
+    // all filters are applied to them
+    const int nbCells = maxRows * halfCols;
+    const int cacheSize = 262144; // Assume L2 cache of 256K
+    const int fragmentsSize = (nbPlanes + 1) * numFeatures * sizeof(Scalar); // Assume nbPlanes < nbFilters
+    const int step = max(1, min(cacheSize / fragmentsSize,
+#ifdef _OPENMP
+                         (nbCells + omp_get_max_threads() - 1) / omp_get_max_threads()));
+#else
+                         nbCells));
+#endif
+    
+#pragma omp parallel for private(i,j,k)
+    for (i = 0; i < nbCells; i += step) {
+        const int nbTileCells = min(step, nbCells - i);
+        
+        for (j = 0; j < nbFilters; ++j) {
+            const FeatureScalar * filter = reinterpret_cast<const FeatureScalar *>(filters[j]->first.raw() + i * numFeatures);
+            
+            for (k = 0; k < nbPlanes; ++k)
+                multiplyAccumulateKernel(filter, reinterpret_cast<const FeatureScalar *>(planes_[k].raw() + i * numFeatures),
+                                         numFeatures, nbTileCells, sums[j][k].data() + i);
+        }
+    }
+    
+    return true;
+}
+
 bool Patchwork::Init(int maxRows, int maxCols, int numFeatures)
 {
     // It is an error if maxRows or maxCols are too small
-    if ((maxRows < 2) || (maxCols < 2))
+    if ((maxRows < 2) || (maxCols < 2) || (numFeatures < 1))
         return false;
     
+    const PlaneSize planeSize(maxRows, maxCols, numFeatures);
+    vector< shared_ptr<const Plans> > evicted; // destroyed after releasing the lock
+    lock_guard<mutex> lock(PlanCacheMutex_);
+    if (PlanCache_.find(planeSize) != PlanCache_.end())
+        return true;
+    
     // Temporary matrices
-    FeatureMatrix tmp(maxRows, maxCols + 2, numFeatures); // +2 columns required by fftw as padding
+    const int halfCols = maxCols / 2 + 1;
+    PlanarFeatureMatrix tmp(maxRows, halfCols * 2, numFeatures); // padding required by fftw for in-place transforms
     
     int dims[2] = {maxRows, maxCols};
+    int realDims[2] = {maxRows, halfCols * 2};
+    int complexDims[2] = {maxRows, halfCols};
     
     // Use fftwf_import_wisdom_from_file and not fftwf_import_wisdom_from_filename as old versions
     // of fftw seem to not include it
-    FILE * file = fopen("wisdom.fftw", "r");
+    FILE * file = (!WisdomFile_.empty()) ? fopen(WisdomFile_.c_str(), "r") : 0;
     
     if (file) {
         fftwf_import_wisdom_from_file(file);
         fclose(file);
     }
     
-    const fftwf_plan forwards =
-        fftwf_plan_many_dft_r2c(2, dims, numFeatures, tmp.raw(), 0,
-                                numFeatures, 1,
-                                reinterpret_cast<fftwf_complex *>(tmp.raw()), 0,
-                                numFeatures, 1, FFTW_PATIENT);
+    shared_ptr<Plans> plans = make_shared<Plans>();
+    
+    // Transform each feature plane contiguously
+    plans->forwards =
+        fftwf_plan_many_dft_r2c(2, dims, numFeatures, tmp.raw(), realDims,
+                                1, maxRows * halfCols * 2,
+                                reinterpret_cast<fftwf_complex *>(tmp.raw()), complexDims,
+                                1, maxRows * halfCols, FFTW_PATIENT);
     
-    const fftwf_plan inverse =
+    plans->inverse =
         fftwf_plan_dft_c2r_2d(dims[0], dims[1], reinterpret_cast<fftwf_complex *>(tmp.raw()),
                               tmp.raw(), FFTW_PATIENT);
     
-    file = fopen("wisdom.fftw", "w");
+    file = (!WisdomFile_.empty()) ? fopen(WisdomFile_.c_str(), "w") : 0;
     
     if (file) {
         fftwf_export_wisdom_to_file(file);
         fclose(file);
     }
     
-    // If successful, set static variables
-    if (forwards && inverse) {
-        MaxRows_ = maxRows;
-        MaxCols_ = maxCols;
-        HalfCols_ = maxCols / 2 + 1;
-        NumFeat_ = numFeatures;
+    // If successful, add the plans to the cache
+    if (plans->forwards && plans->inverse) {
+        PlanCache_[planeSize] = plans;
+        PlanLastUse_[planeSize] = ++PlanUseCounter_;
+        EvictedPlans_.erase(planeSize);
         NumInits_++;
-        if (Forwards_ != 0)
-            fftwf_destroy_plan(Forwards_);
-        Forwards_ = forwards;
-        if (Inverse_ != 0)
-            fftwf_destroy_plan(Inverse_);
-        Inverse_ = inverse;
+        
+        // Remove the plans for the least recently used plane sizes if there are too many
+        while (MaxPlaneSizes_ > 0 && PlanCache_.size() > MaxPlaneSizes_) {
+            map<PlaneSize, uint64_t>::const_iterator lru = PlanLastUse_.begin();
+            for (map<PlaneSize, uint64_t>::const_iterator it = PlanLastUse_.begin(); it != PlanLastUse_.end(); ++it)
+                if (it->second < lru->second)
+                    lru = it;
+            map<PlaneSize, shared_ptr<const Plans> >::iterator entry = PlanCache_.find(lru->first);
+            EvictedPlans_[lru->first] = entry->second;
+            evicted.push_back(entry->second);
+            PlanCache_.erase(entry);
+            PlanLastUse_.erase(lru);
+        }
+        
+        // Forget evicted plans which are not used by any patchwork anymore
+        for (map<PlaneSize, weak_ptr<const Plans> >::iterator it = EvictedPlans_.begin(); it != EvictedPlans_.end(); )
+            if (it->second.expired())
+                EvictedPlans_.erase(it++);
+            else
+                ++it;
+        
         return true;
     }
     
+    evicted.push_back(plans); // the failed plans must not be destroyed while holding the lock
     return false;
 }
 
+bool Patchwork::FindPlaneSize(int rows, int cols, int numFeatures, PlaneSize & planeSize)
+{
+    lock_guard<mutex> lock(PlanCacheMutex_);
+    bool found = false;
+    
+    for (map<PlaneSize, shared_ptr<const Plans> >::const_iterator it = PlanCache_.begin(); it != PlanCache_.end(); ++it)
+        if (it->first.features == numFeatures && it->first.rows >= rows && it->first.cols >= cols
+                && (!found || it->first.rows * it->first.cols < planeSize.rows * planeSize.cols)) {
+            planeSize = it->first;
+            found = true;
+        }
+    
+    return found;
+}
+
+vector<Patchwork::PlaneSize> Patchwork::PlaneSizes()
+{
+    lock_guard<mutex> lock(PlanCacheMutex_);
+    vector<PlaneSize> planeSizes;
+    planeSizes.reserve(PlanCache_.size());
+    
+    for (map<PlaneSize, shared_ptr<const Plans> >::const_iterator it = PlanCache_.begin(); it != PlanCache_.end(); ++it)
+        planeSizes.push_back(it->first);
+    
+    return planeSizes;
+}
+
+// Returns the largest cached plane size (by area) or an empty plane size
+static Patchwork::PlaneSize LargestPlaneSize(const vector<Patchwork::PlaneSize> & planeSizes)
+{
+    Patchwork::PlaneSize largest;
+    for (vector<Patchwork::PlaneSize>::const_iterator it = planeSizes.begin(); it != planeSizes.end(); ++it)
+        if (it->rows * it->cols > largest.rows * largest.cols)
+            largest = *it;
+    return largest;
+}
+
 int Patchwork::MaxRows()
 {
-    return MaxRows_;
+    return LargestPlaneSize(PlaneSizes()).rows;
 }
 
 int Patchwork::MaxCols()
 {
-    return MaxCols_;
+    return LargestPlaneSize(PlaneSizes()).cols;
 }
 
 int Patchwork::NumFeatures()
 {
-    return NumFeat_;
+    return LargestPlaneSize(PlaneSizes()).features;
+}
+
+bool Patchwork::HasPlans(const PlaneSize & planeSize)
+{
+    lock_guard<mutex> lock(PlanCacheMutex_);
+    if (PlanCache_.find(planeSize) != PlanCache_.end())
+        return true;
+    map<PlaneSize, weak_ptr<const Plans> >::const_iterator evicted = EvictedPlans_.find(planeSize);
+    return (evicted != EvictedPlans_.end() && !evicted->second.expired());
 }
 
 int Patchwork::NumInits()
 {
+    lock_guard<mutex> lock(PlanCacheMutex_);
     return NumInits_;
 }
 
-void Patchwork::TransformFilter(const FeatureMatrix & filter, Filter & result)
+void Patchwork::SetMaxPlaneSizes(size_t maxPlaneSizes)
+{
+    lock_guard<mutex> lock(PlanCacheMutex_);
+    MaxPlaneSizes_ = maxPlaneSizes;
+}
+
+size_t Patchwork::MaxPlaneSizes()
+{
+    lock_guard<mutex> lock(PlanCacheMutex_);
+    return MaxPlaneSizes_;
+}
+
+void Patchwork::SetWisdomFile(const string & filename)
+{
+    lock_guard<mutex> lock(PlanCacheMutex_);
+    WisdomFile_ = filename;
+}
+
+string Patchwork::WisdomFile()
+{
+    lock_guard<mutex> lock(PlanCacheMutex_);
+    return WisdomFile_;
+}
+
+shared_ptr<const Patchwork::Plans> Patchwork::GetPlans(const PlaneSize & planeSize)
+{
+    lock_guard<mutex> lock(PlanCacheMutex_);
+    map<PlaneSize, shared_ptr<const Plans> >::const_iterator it = PlanCache_.find(planeSize);
+    if (it == PlanCache_.end())
+        return shared_ptr<const Plans>();
+    PlanLastUse_[planeSize] = ++PlanUseCounter_;
+    return it->second;
+}
+
+void Patchwork::TransformFilter(const FeatureMatrix & filter, Filter & result, const PlaneSize & planeSize)
 {
+    const int maxRows = planeSize.rows;
+    const int maxCols = planeSize.cols;
+    const int halfCols = maxCols / 2 + 1;
+    const int numFeatures = planeSize.features;
+    
     // Early return if no filter given or if Init was not called or if the filter is too large
-    if (filter.empty() || !MaxRows_ || filter.rows() > MaxRows_ || filter.cols() > MaxCols_ || filter.channels() != NumFeat_)
+    shared_ptr<const Plans> plans = GetPlans(planeSize);
+    if (filter.empty() || !plans || filter.rows() > maxRows || filter.cols() > maxCols || filter.channels() != numFeatures)
     {
         result = Filter();
         return;
     }
     
-    // Copy the filter to a plane
-    result.first = Plane(MaxRows_, HalfCols_, Plane::Cell::Zero(NumFeat_));
+    // Copy the flipped filter to a planar buffer
+    result.first.resize(maxRows, halfCols, numFeatures);
     result.second = pair<int, int>(filter.rows(), filter.cols());
     
-    FeatureMatrix plane(reinterpret_cast<FeatureScalar*>(result.first.raw()),
-                        MaxRows_, HalfCols_ * 2, NumFeat_);
+    PlanarFeatureMatrix & plane = planarBuffer(planeSize);
+    plane.setZero();
     
     for (int y = 0; y < filter.rows(); ++y)
         for (int x = 0; x < filter.cols(); ++x)
-            plane((MaxRows_ - y) % MaxRows_, (MaxCols_ - x) % MaxCols_)
-                    = filter(y, x) / static_cast<FeatureScalar>(MaxRows_ * MaxCols_);
+            for (int c = 0; c < numFeatures; ++c)
+                plane((maxRows - y) % maxRows, (maxCols - x) % maxCols, c)
+                        = filter(y, x, c) / static_cast<FeatureScalar>(maxRows * maxCols);
     
     // Transform that plane 
-    fftwf_execute_dft_r2c(Forwards_, reinterpret_cast<float *>(plane.raw()),
-                          reinterpret_cast<fftwf_complex *>(result.first.raw()));
+    fftwf_execute_dft_r2c(plans->forwards, plane.raw(), reinterpret_cast<fftwf_complex *>(plane.raw()));
+    toSplitLayout(plane, result.first);
+}
+
+shared_ptr<const Patchwork::Filter> Patchwork::SharedTransformedFilter(const FeatureMatrix & filter,
+                                                                      const PlaneSize & planeSize)
+{
+    // Filters which can't be transformed are not shared
+    if (filter.empty() || !GetPlans(planeSize))
+        return make_shared<const Filter>();
+    
+    const uint64_t hash = hashFilter(filter);
+    const SpectrumKey key(planeSize, hash);
+    string directory;
+    
+    {
+        lock_guard<mutex> lock(SpectrumCacheMutex_);
+        map<SpectrumKey, weak_ptr<const SharedSpectrum> >::const_iterator it = SpectrumCache_.find(key);
+        if (it != SpectrumCache_.end()) {
+            shared_ptr<const SharedSpectrum> spectrum = it->second.lock();
+            if (spectrum && sameFilter(spectrum->coefficients, filter))
+                return shared_ptr<const Filter>(spectrum, &spectrum->filter);
+        }
+        directory = SpectrumCacheDirectory_;
+    }
+    
+    // Look for a spectrum file or transform the filter without holding the lock
+    string filename;
+    shared_ptr<SharedSpectrum> spectrum;
+    if (!directory.empty()) {
+        ostringstream basename;
+        basename << "spectrum_" << hex;
+        basename.width(16);
+        basename.fill('0');
+        basename << hash << dec << '_' << planeSize.rows << 'x' << planeSize.cols << 'x' << planeSize.features << ".bin";
+        filename = join_path(2, directory.c_str(), basename.str().c_str());
+        spectrum = ReadSpectrumFile(filename, filter, planeSize);
+    }
+    
+    if (!spectrum) {
+        spectrum = make_shared<SharedSpectrum>();
+        TransformFilter(filter, spectrum->filter, planeSize);
+        if (spectrum->filter.first.empty())
+            return make_shared<const Filter>();
+        spectrum->coefficients = filter;
+        if (!filename.empty())
+            WriteSpectrumFile(filename, *spectrum, planeSize, hash);
+    }
+    
+    // Keep the spectrum registered by another thread in the meantime, if any
+    lock_guard<mutex> lock(SpectrumCacheMutex_);
+    weak_ptr<const SharedSpectrum> & entry = SpectrumCache_[key];
+    shared_ptr<const SharedSpectrum> registered = entry.lock();
+    if (!registered || !sameFilter(registered->coefficients, filter)) {
+        registered = spectrum;
+        entry = registered;
+    }
+    
+    // Remove entries of spectra which are not used anymore
+    if (SpectrumCache_.size() >= SpectrumCacheSweepSize_) {
+        for (map<SpectrumKey, weak_ptr<const SharedSpectrum> >::iterator it = SpectrumCache_.begin(); it != SpectrumCache_.end();)
+            if (it->second.expired())
+                SpectrumCache_.erase(it++);
+            else
+                ++it;
+        SpectrumCacheSweepSize_ = max(static_cast<size_t>(64), 2 * SpectrumCache_.size());
+    }
+    
+    return shared_ptr<const Filter>(registered, &registered->filter);
+}
+
+void Patchwork::SetSpectrumCacheDirectory(const string & directory)
+{
+    lock_guard<mutex> lock(SpectrumCacheMutex_);
+    SpectrumCacheDirectory_ = directory;
+}
+
+string Patchwork::SpectrumCacheDirectory()
+{
+    lock_guard<mutex> lock(SpectrumCacheMutex_);
+    return SpectrumCacheDirectory_;
+}
+
+shared_ptr<Patchwork::SharedSpectrum> Patchwork::ReadSpectrumFile(const string & filename, const FeatureMatrix & filter,
+                                                                 const PlaneSize & planeSize)
+{
+    if (!is_file(filename))
+        return shared_ptr<SharedSpectrum>();
+    
+    shared_ptr<MappedFile> file = make_shared<MappedFile>(filename);
+    if (!file->valid() || file->size() < sizeof(SpectrumFileHeader))
+        return shared_ptr<SharedSpectrum>();
+    
+    // Check if the file matches the filter and the plane size
+    SpectrumFileHeader header;
+    memcpy(&header, file->data(), sizeof(header));
+    const int halfCols = planeSize.cols / 2 + 1;
+    const size_t coefficientsSize = paddedSize(filter.numEl() * sizeof(FeatureScalar));
+    const size_t numSpectrumEl = static_cast<size_t>(planeSize.rows) * halfCols * planeSize.features;
+    if (memcmp(header.magic, SpectrumFileMagic, sizeof(SpectrumFileMagic)) != 0
+            || header.version != SpectrumFileVersion || header.byteOrder != SpectrumFileByteOrderMark
+            || header.scalarBits != sizeof(FeatureScalar) * 8
+            || header.planeRows != planeSize.rows || header.planeCols != planeSize.cols || header.features != planeSize.features
+            || header.filterRows != filter.rows() || header.filterCols != filter.cols()
+            || file->size() < sizeof(header) + coefficientsSize + numSpectrumEl * sizeof(Scalar))
+        return shared_ptr<SharedSpectrum>();
+    
+    // The spectrum refers to the mapped memory
+    shared_ptr<SharedSpectrum> spectrum = make_shared<SharedSpectrum>();
+    char * data = file->data() + sizeof(header);
+    spectrum->coefficients = FeatureMatrix(reinterpret_cast<FeatureScalar *>(data), filter.rows(), filter.cols(), filter.channels());
+    if (!sameFilter(spectrum->coefficients, filter))
+        return shared_ptr<SharedSpectrum>();
+    spectrum->filter.first = Plane(reinterpret_cast<Scalar *>(data + coefficientsSize), planeSize.rows, halfCols, planeSize.features);
+    spectrum->filter.second = pair<int, int>(filter.rows(), filter.cols());
+    spectrum->file = file;
+    return spectrum;
+}
+
+void Patchwork::WriteSpectrumFile(const string & filename, const SharedSpectrum & spectrum,
+                                  const PlaneSize & planeSize, uint64_t hash)
+{
+    SpectrumFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SpectrumFileMagic, sizeof(SpectrumFileMagic));
+    header.version = SpectrumFileVersion;
+    header.byteOrder = SpectrumFileByteOrderMark;
+    header.scalarBits = sizeof(FeatureScalar) * 8;
+    header.planeRows = planeSize.rows;
+    header.planeCols = planeSize.cols;
+    header.features = planeSize.features;
+    header.filterRows = spectrum.filter.second.first;
+    header.filterCols = spectrum.filter.second.second;
+    header.hash = hash;
+    
+    // Write to a temporary file first, so that other processes never map an incomplete file
+    ostringstream tmpFilename;
+    tmpFilename << filename << ".tmp" << hex << std::hash<thread::id>()(this_thread::get_id())
+                << chrono::steady_clock::now().time_since_epoch().count();
+    
+    const char zeros[SpectrumFileBlockSize] = { 0 };
+    const size_t coefficientsBytes = spectrum.coefficients.numEl() * sizeof(FeatureScalar);
+    const size_t spectrumBytes = spectrum.filter.first.numEl() * sizeof(Scalar);
+    
+    bool written;
+    {
+        ofstream file(tmpFilename.str().c_str(), ios::out | ios::binary | ios::trunc);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(spectrum.coefficients.raw()), coefficientsBytes);
+        file.write(zeros, paddedSize(coefficientsBytes) - coefficientsBytes);
+        file.write(reinterpret_cast<const char *>(spectrum.filter.first.raw()), spectrumBytes);
+        file.write(zeros, paddedSize(spectrumBytes) - spectrumBytes);
+        written = file.good();
+    }
+    
+    // Discard the temporary file if it could not be written or moved into place
+    if (!written || rename(tmpFilename.str().c_str(), filename.c_str()) != 0)
+        remove(tmpFilename.str().c_str());
 }
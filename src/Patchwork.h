@@ -21,6 +21,11 @@
 #ifndef ARTOS_PATCHWORK_H
 #define ARTOS_PATCHWORK_H
 
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
 #include "FeaturePyramid.h"
 #include "blf.h"
 
@@ -33,12 +38,42 @@ namespace ARTOS
 
 /**
 * The Patchwork class computes full convolutions much faster than the HOGPyramid class.
+*
+* The FFTW plans required for planes of a specific size are created by Init() and cached, so that
+* plans for several sizes can be used concurrently. Each patchwork uses the smallest cached plane
+* size its pyramid fits into. The number of cached plane sizes is limited (see SetMaxPlaneSizes()),
+* so that the plans for the least recently used sizes are released if too many sizes are initialized.
 */
 class Patchwork
 {
 
 public:
 
+    /**
+    * Size of the planes of a patchwork, which determines the FFTW plans used for it.
+    */
+    struct PlaneSize
+    {
+        int rows;       /**< Number of rows of a plane. */
+        int cols;       /**< Number of columns of a plane. */
+        int features;   /**< Number of features per cell. */
+        
+        PlaneSize() : rows(0), cols(0), features(0) {};
+        PlaneSize(int r, int c, int f) : rows(r), cols(c), features(f) {};
+        
+        bool operator==(const PlaneSize & other) const
+        { return (this->rows == other.rows && this->cols == other.cols && this->features == other.features); };
+        
+        bool operator!=(const PlaneSize & other) const { return !(*this == other); };
+        
+        bool operator<(const PlaneSize & other) const
+        {
+            return (this->features < other.features)
+                   || (this->features == other.features && (this->rows < other.rows
+                   || (this->rows == other.rows && this->cols < other.cols)));
+        };
+    };
+
     /**
     * Type of a complex scalar value.
     */
@@ -51,9 +86,23 @@ public:
     
     /**
     * Type of a patchwork filter (plane + original filter size).
+    *
+    * The cells of transformed planes and filters are stored in split layout: The real parts of the
+    * transforms of all features of a cell are followed by their imaginary parts.
     */
     typedef std::pair<Plane, std::pair<int, int> > Filter;
     
+    /**
+    * Type of the buffers receiving the pointwise products of transformed filters and planes
+    * (`filters x planes`), which may be kept by the caller to be reused by subsequent convolutions.
+    */
+    typedef std::vector< std::vector<Plane::ScalarMatrix> > Products;
+    
+    /**
+    * Type of a matrix of indices.
+    */
+    typedef Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> Indices;
+    
     /**
     * Constructs an empty patchwork. An empty patchwork has no plane.
     */
@@ -67,10 +116,26 @@ public:
     * @param[in] padding Padding to add between levels from the pyramid in each direction.
     * The padding should be at least half as large as the largest filter.
     *
-    * @note If the pyramid (including padding) is larger than the last maxRows and maxCols passed to the Init method
-    * or it has more features than specified there, the Patchwork will be empty.
+    * @param[in] numLevels The number of levels from the beginning of the pyramid to be put into the patchwork.
+    * The remaining (smaller) levels may be convolved using ConvolveDirect() instead. A negative value
+    * means all levels.
+    *
+    * @note If the pyramid (including padding) is larger than any plane size passed to the Init method
+    * with the same number of features, the Patchwork will be empty.
+    */
+    Patchwork(const FeaturePyramid & pyramid, const Size & padding, int numLevels = -1);
+    
+    /**
+    * Replaces the contents of this patchwork with another pyramid, reusing the memory of the
+    * planes if their size does not change. See the constructor for a description of the parameters.
     */
-    Patchwork(const FeaturePyramid & pyramid, const Size & padding);
+    void assign(const FeaturePyramid & pyramid, const Size & padding, int numLevels = -1);
+    
+    /**
+    * @return Returns the size of the planes of this patchwork. Filters must have been transformed
+    * for this size using TransformFilter() to be convolved with this patchwork.
+    */
+    const PlaneSize & planeSize() const;
     
     /**
     * @return Returns the amount of zero padding added between levels from the pyramid
@@ -91,15 +156,74 @@ public:
     /**
     * Computes the convolutions of the patchwork with filters (useful to compute the SVM margins).
     *
-    * @param[in] filters The filters.
+    * @param[in] filters The filters, transformed for the plane size of this patchwork.
+    *
+    * @param[out] convolutions The convolutions (filters x levels). Will be empty if the patchwork is
+    * empty or one of the filters has been transformed for another plane size.
     *
-    * @param[out] convolutions The convolutions (filters x levels).
+    * @param products Optionally, buffers for the frequency-domain products, which will be reused
+    * if they have the right size. Otherwise, they will be allocated temporarily.
     */
     void convolve(const std::vector<Filter> & filters,
-                  std::vector< std::vector<ScalarMatrix> > & convolutions) const;
+                  std::vector< std::vector<ScalarMatrix> > & convolutions,
+                  Products * products = 0) const;
+    
+    /**
+    * Computes the convolutions of the patchwork with filters given by pointers, so that the filters
+    * of several sources can be combined without copying them. See the overload above for details.
+    */
+    void convolve(const std::vector<const Filter *> & filters,
+                  std::vector< std::vector<ScalarMatrix> > & convolutions,
+                  Products * products = 0) const;
     
     /**
-    * Initializes the FFTW library.
+    * Computes the maximum over the convolutions of the patchwork with each of several groups of filters,
+    * after adding a bias to the convolution of each filter. The maximum is taken while transforming the
+    * convolutions back from the frequency domain, so that they don't have to be stored.
+    *
+    * This is useful for mixtures of root-only models, whose scores are just the convolutions of their
+    * root filters plus their biases.
+    *
+    * @param[in] filters The filters, transformed for the plane size of this patchwork. The filters of each
+    * group must be stored consecutively.
+    *
+    * @param[in] groupSizes The number of filters in each group.
+    *
+    * @param[in] biases The bias added to the convolution of each filter.
+    *
+    * @param[out] scores The maximum scores (groups x levels). Will be empty if the patchwork is
+    * empty or one of the filters has been transformed for another plane size.
+    *
+    * @param[out] argmaxes The index of the filter with the maximum score within its group (groups x levels).
+    * Among equal scores, the first filter wins.
+    *
+    * @param products Optionally, buffers for the frequency-domain products, which will be reused
+    * if they have the right size. Otherwise, they will be allocated temporarily.
+    */
+    void convolveMax(const std::vector<Filter> & filters, const std::vector<int> & groupSizes,
+                     const std::vector<FeatureScalar> & biases,
+                     std::vector< std::vector<ScalarMatrix> > & scores,
+                     std::vector< std::vector<Indices> > & argmaxes,
+                     Products * products = 0) const;
+    
+    /**
+    * Computes the maximum over the convolutions of the patchwork with each of several groups of filters
+    * given by pointers, so that the filters of several sources can be combined without copying them.
+    * See the overload above for details.
+    */
+    void convolveMax(const std::vector<const Filter *> & filters, const std::vector<int> & groupSizes,
+                     const std::vector<FeatureScalar> & biases,
+                     std::vector< std::vector<ScalarMatrix> > & scores,
+                     std::vector< std::vector<Indices> > & argmaxes,
+                     Products * products = 0) const;
+    
+    /**
+    * Initializes the FFTW library for planes of a given size.
+    *
+    * Plans created before for other sizes are kept, so that calling this method for all expected
+    * sizes in advance avoids planning during detection. Nothing will be done if plans for the given
+    * size have already been created. If more than MaxPlaneSizes() sizes have been initialized, the
+    * plans for the least recently used size are removed from the cache.
     *
     * @param[in] maxRows Maximum number of rows of a pyramid level (including padding).
     *
@@ -114,26 +238,88 @@ public:
     static bool Init(int maxRows, int maxCols, int numFeatures);
     
     /**
-    * @return Returns the current maximum number of rows of a pyramid level (including padding).
+    * Searches the smallest plane size which plans have been created for and which is large enough
+    * for pyramid levels of a given size.
+    *
+    * @param[in] rows Number of rows of the largest pyramid level (including padding).
+    *
+    * @param[in] cols Number of columns of the largest pyramid level (including padding).
+    *
+    * @param[in] numFeatures Number of features per cell.
+    *
+    * @param[out] planeSize Receives the plane size found.
+    *
+    * @returns Returns true if a suitable plane size has been found, otherwise false.
+    */
+    static bool FindPlaneSize(int rows, int cols, int numFeatures, PlaneSize & planeSize);
+    
+    /**
+    * @return Returns all plane sizes which plans have been created for.
+    */
+    static std::vector<PlaneSize> PlaneSizes();
+    
+    /**
+    * @return Returns the number of rows of the largest plane size which plans are currently cached for
+    * (i. e. the maximum number of rows of a pyramid level including padding) or 0 if there is none.
     */
     static int MaxRows();
     
     /**
-    * @return Returns the current maximum number of columns of a pyramid level (including padding).
+    * @return Returns the number of columns of the largest plane size which plans are currently cached for
+    * (i. e. the maximum number of columns of a pyramid level including padding) or 0 if there is none.
     */
     static int MaxCols();
     
     /**
-    * @return Returns the current number of features per cell.
+    * @return Returns the number of features per cell of the largest plane size which plans are currently
+    * cached for or 0 if there is none.
     */
     static int NumFeatures();
     
     /**
-    * @return Returns the current number of calls to Init() made so far. This can be used to check
-    * if any cached filters are still up to date.
+    * Checks if plans for a given plane size are available, either because they are cached or because
+    * they are still used by a patchwork after having been removed from the cache.
+    *
+    * @param[in] planeSize The plane size.
+    *
+    * @return Returns true if patchworks of the given plane size may exist.
+    */
+    static bool HasPlans(const PlaneSize & planeSize);
+    
+    /**
+    * @return Returns the current number of plane sizes initialized by Init() so far.
     */
     static int NumInits();
     
+    /**
+    * Changes the maximum number of plane sizes which plans are cached for. Plans for the least
+    * recently used sizes will be removed from the cache if this number is exceeded, but remain valid
+    * as long as they are used by a patchwork.
+    *
+    * @param[in] maxPlaneSizes The maximum number of cached plane sizes. 0 means no limit.
+    * Defaults to 16.
+    */
+    static void SetMaxPlaneSizes(std::size_t maxPlaneSizes);
+    
+    /**
+    * @return Returns the maximum number of plane sizes which plans are cached for (0 = unlimited).
+    */
+    static std::size_t MaxPlaneSizes();
+    
+    /**
+    * Changes the file which FFTW wisdom is read from before and written to after planning.
+    *
+    * @param[in] filename Path to the wisdom file. If empty, wisdom will neither be read nor written.
+    * Defaults to "wisdom.fftw" in the current working directory.
+    */
+    static void SetWisdomFile(const std::string & filename);
+    
+    /**
+    * @return Returns the path of the file used to store FFTW wisdom or an empty string if wisdom
+    * is not stored.
+    */
+    static std::string WisdomFile();
+    
     /**
     * Returns a transformed version of a filter to be used by the @c convolve method.
     *
@@ -141,27 +327,122 @@ public:
     *
     * @param[out] result Transformed filter.
     *
-    * @note If Init has not been called yet or if the filter is larger than the last maxRows and
-    * maxCols passed to the Init method, the result will be empty.
+    * @param[in] planeSize The plane size of the patchworks the filter will be convolved with.
+    *
+    * @note If Init has not been called for the given plane size yet or if the filter is larger than
+    * that size, the result will be empty.
+    */
+    static void TransformFilter(const FeatureMatrix & filter, Filter & result, const PlaneSize & planeSize);
+    
+    /**
+    * Returns a transformed version of a filter like TransformFilter(), but shares it with all callers
+    * requesting a filter with the same coefficients for the same plane size, so that each filter is
+    * transformed only once even if it is used by several mixtures or detectors.
+    *
+    * Transformed filters are kept in memory as long as any caller holds a reference to them. If a directory
+    * has been set using SetSpectrumCacheDirectory(), they are also stored in files there, which are mapped
+    * into memory instead of transforming the filter again, even by other processes or after a restart.
+    *
+    * @param[in] filter Filter to transform.
+    *
+    * @param[in] planeSize The plane size of the patchworks the filter will be convolved with.
+    *
+    * @return Returns a pointer to the immutable transformed filter. It will be empty under the same
+    * conditions as the result of TransformFilter().
+    */
+    static std::shared_ptr<const Filter> SharedTransformedFilter(const FeatureMatrix & filter, const PlaneSize & planeSize);
+    
+    /**
+    * Changes the directory where transformed filters are stored by SharedTransformedFilter().
+    *
+    * Files in that directory may be shared by multiple processes, but must not be modified while in use.
+    * They are only valid for the version of the library which has created them.
+    *
+    * @param[in] directory Path to an existing directory. If empty, transformed filters will only be
+    * shared in memory. Defaults to an empty string.
+    */
+    static void SetSpectrumCacheDirectory(const std::string & directory);
+    
+    /**
+    * @return Returns the directory where transformed filters are stored by SharedTransformedFilter()
+    * or an empty string if they are not stored on disk.
+    */
+    static std::string SpectrumCacheDirectory();
+    
+    /**
+    * Convolves a single pyramid level with a filter in the spatial domain.
+    *
+    * This is faster than going through the frequency domain for small levels, where the padding
+    * required by the Fourier transform would dominate, and for small filters.
+    *
+    * @param[in] level The pyramid level.
+    *
+    * @param[in] filter The filter (not transformed). Must have as many features per cell as the level.
+    *
+    * @param[out] result The convolution, which has the size of the level. Cells beyond the bottom and
+    * right border of the level are treated as zero. Will be empty if the level or the filter is empty
+    * or their numbers of features differ.
+    */
+    static void ConvolveDirect(const FeatureMatrix & level, const FeatureMatrix & filter, ScalarMatrix & result);
+    
+    /**
+    * Estimates how many levels of a pyramid should be convolved in the frequency domain, based on
+    * the approximate number of operations required by a patchwork and by ConvolveDirect().
+    *
+    * Since levels are getting smaller towards the end of the pyramid, the result refers to a number
+    * of levels from the beginning of the pyramid, while the remaining levels should be convolved directly.
+    *
+    * @param[in] pyramid The pyramid of features.
+    *
+    * @param[in] padding The padding which would be used for a patchwork.
+    *
+    * @param[in] numFilters The number of filters to be convolved with each level.
+    *
+    * @param[in] numFilterCells The total number of cells of all those filters.
+    *
+    * @return Returns the number of levels to be passed to the constructor of a patchwork.
     */
-    static void TransformFilter(const FeatureMatrix & filter, Filter & result);
+    static int NumFFTLevels(const FeaturePyramid & pyramid, const Size & padding, int numFilters, int numFilterCells);
 
 
 private:
     
+    struct Plans;
+    
     Size padding_;
     int interval_;
     std::vector<PatchworkRectangle> rectangles_;
     std::vector<Plane> planes_;
+    PlaneSize planeSize_;
+    std::shared_ptr<const Plans> plans_;
     
-    static int MaxRows_;
-    static int MaxCols_;
-    static int HalfCols_;
-    static int NumFeat_;
+    static std::mutex PlanCacheMutex_; // the FFTW planner is not thread-safe, so this also guards any planning
+    static std::map<PlaneSize, std::shared_ptr<const Plans> > PlanCache_;
+    static std::map<PlaneSize, std::uint64_t> PlanLastUse_; // value of PlanUseCounter_ at the last use of cached plans
+    static std::map<PlaneSize, std::weak_ptr<const Plans> > EvictedPlans_; // plans removed from the cache, which may still be in use
+    static std::uint64_t PlanUseCounter_;
+    static std::size_t MaxPlaneSizes_;
     static int NumInits_;
+    static std::string WisdomFile_;
+    
+    static std::shared_ptr<const Plans> GetPlans(const PlaneSize & planeSize);
+    
+    struct SharedSpectrum;
+    typedef std::pair<PlaneSize, std::uint64_t> SpectrumKey; // plane size and hash of the filter coefficients
+    
+    static std::map<SpectrumKey, std::weak_ptr<const SharedSpectrum> > SpectrumCache_;
+    static std::mutex SpectrumCacheMutex_;
+    static std::string SpectrumCacheDirectory_;
+    static std::size_t SpectrumCacheSweepSize_; // size of SpectrumCache_ triggering the removal of expired entries
+    
+    static std::shared_ptr<SharedSpectrum> ReadSpectrumFile(const std::string & filename, const FeatureMatrix & filter,
+                                                            const PlaneSize & planeSize);
+    static void WriteSpectrumFile(const std::string & filename, const SharedSpectrum & spectrum,
+                                  const PlaneSize & planeSize, std::uint64_t hash);
     
-    static fftwf_plan Forwards_;
-    static fftwf_plan Inverse_;
+    // Pointwise multiplies the transformed filters with the planes (filters x planes)
+    // Returns false if one of the filters has been transformed for another plane size
+    bool multiply(const std::vector<const Filter *> & filters, Products & sums) const;
 };
 
 }
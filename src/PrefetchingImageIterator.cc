@@ -0,0 +1,160 @@
+#include "PrefetchingImageIterator.h"
+#include <algorithm>
+#include <utility>
+using namespace ARTOS;
+using namespace std;
+
+PrefetchingImageIterator::PrefetchingImageIterator(ImageIterator & source, const unsigned int limit,
+                                                   const unsigned int numThreads, const unsigned int maxImages,
+                                                   const size_t maxBytes)
+: ImageIterator(source.getRepoDirectory()), m_source(source), m_limit(limit),
+  m_numThreads(max(numThreads, 1u)), m_maxImages(max(maxImages, 1u)), m_maxBytes(maxBytes),
+  m_queueBytes(0), m_fetched(0), m_exhausted(false), m_stop(false)
+{
+    this->m_pos = source.pos();
+    this->start();
+}
+
+PrefetchingImageIterator::~PrefetchingImageIterator()
+{
+    this->stop();
+}
+
+PrefetchingImageIterator & PrefetchingImageIterator::operator++()
+{
+    unique_lock<mutex> lock(this->m_mutex);
+    Slot * front = this->waitForFront(lock);
+    if (front != NULL)
+    {
+        this->m_queueBytes -= front->bytes;
+        this->m_queue.pop_front();
+        this->m_pos++;
+        this->m_spaceAvailable.notify_one();
+    }
+    return *this;
+}
+
+SynsetImage PrefetchingImageIterator::operator*()
+{
+    unique_lock<mutex> lock(this->m_mutex);
+    Slot * front = this->waitForFront(lock);
+    return (front != NULL) ? front->simg : SynsetImage();
+}
+
+const JPEGImage & PrefetchingImageIterator::image()
+{
+    static const JPEGImage emptyImage;
+    unique_lock<mutex> lock(this->m_mutex);
+    Slot * front = this->waitForFront(lock);
+    if (front == NULL)
+        return emptyImage;
+#ifdef NO_CACHE_POSITIVES
+    return front->img;
+#else
+    return front->simg.getImage();
+#endif
+}
+
+void PrefetchingImageIterator::rewind()
+{
+    this->stop();
+    this->m_source.rewind();
+    this->m_pos = this->m_source.pos();
+    this->start();
+}
+
+bool PrefetchingImageIterator::ready() const
+{
+    unique_lock<mutex> lock(this->m_mutex);
+    this->m_imageAvailable.wait(lock, [this]() { return !this->m_queue.empty() || this->m_exhausted; });
+    return !this->m_queue.empty();
+}
+
+void PrefetchingImageIterator::start()
+{
+    this->m_queueBytes = 0;
+    this->m_fetched = 0;
+    this->m_exhausted = false;
+    this->m_stop = false;
+    for (unsigned int i = 0; i < this->m_numThreads; i++)
+        this->m_workers.push_back(thread(&PrefetchingImageIterator::fetch, this));
+}
+
+void PrefetchingImageIterator::stop()
+{
+    {
+        lock_guard<mutex> lock(this->m_mutex);
+        this->m_stop = true;
+    }
+    this->m_spaceAvailable.notify_all();
+    for (vector<thread>::iterator t = this->m_workers.begin(); t != this->m_workers.end(); t++)
+        t->join();
+    this->m_workers.clear();
+    this->m_queue.clear();
+    this->m_queueBytes = 0;
+}
+
+void PrefetchingImageIterator::fetch()
+{
+    while (true)
+    {
+        // Reserve a slot at the end of the queue and read the next image from the wrapped iterator.
+        // The source lock is held until the iterator has been advanced, so that the order of the
+        // slots matches the order of the images.
+        unique_lock<mutex> sourceLock(this->m_sourceMutex);
+        Slot * slot;
+        {
+            unique_lock<mutex> lock(this->m_mutex);
+            this->m_spaceAvailable.wait(lock, [this]() {
+                return this->m_stop || this->m_exhausted || this->m_queue.empty()
+                        || (this->m_queue.size() < this->m_maxImages && this->m_queueBytes < this->m_maxBytes);
+            });
+            if (this->m_stop || this->m_exhausted)
+                return;
+            if (!this->m_source.ready() || (this->m_limit > 0 && this->m_fetched >= this->m_limit))
+            {
+                this->m_exhausted = true;
+                this->m_imageAvailable.notify_all();
+                return;
+            }
+            this->m_queue.push_back(Slot());
+            slot = &this->m_queue.back();
+            slot->bytes = 0;
+            slot->ready = false;
+            this->m_fetched++;
+            this->m_imageAvailable.notify_all();
+        }
+        SynsetImage simg = *this->m_source;
+        ++this->m_source;
+        sourceLock.unlock();
+
+        // Decode image without holding any lock (references to elements of a deque remain valid
+        // when other elements are added to or removed from its ends)
+#ifdef NO_CACHE_POSITIVES
+        JPEGImage img = simg.getImage();
+#else
+        const JPEGImage & img = simg.getImage();
+#endif
+        const size_t bytes = static_cast<size_t>(img.width()) * img.height() * img.depth();
+
+        {
+            lock_guard<mutex> lock(this->m_mutex);
+#ifdef NO_CACHE_POSITIVES
+            slot->img = move(img);
+#endif
+            slot->simg = move(simg);
+            slot->bytes = bytes;
+            slot->ready = true;
+            this->m_queueBytes += bytes;
+        }
+        this->m_imageAvailable.notify_all();
+    }
+}
+
+PrefetchingImageIterator::Slot * PrefetchingImageIterator::waitForFront(unique_lock<mutex> & lock)
+{
+    this->m_imageAvailable.wait(lock, [this]() {
+        return (!this->m_queue.empty() && this->m_queue.front().ready) || (this->m_queue.empty() && this->m_exhausted);
+    });
+    return (!this->m_queue.empty()) ? &this->m_queue.front() : NULL;
+}
@@ -0,0 +1,193 @@
+#ifndef ARTOS_PREFETCHINGIMAGEITERATOR_H
+#define ARTOS_PREFETCHINGIMAGEITERATOR_H
+
+#include <cstddef>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include "JPEGImage.h"
+#include "SynsetIterators.h"
+
+namespace ARTOS
+{
+
+/**
+* Wraps another ImageIterator and reads and decodes the images following the current position
+* on background threads, so that I/O and JPEG decoding overlap with the processing of the
+* current image by the caller.
+*
+* Prefetched images are kept in a bounded queue, whose size is limited by a maximum number of
+* images and by a memory budget for the decoded pixel data. The wrapped iterator must not be
+* used by anyone else while it is wrapped. Iteration starts at the current position of the
+* wrapped iterator, which can be reset by calling rewind() on it before constructing the wrapper.
+*
+* Can be used the following way, for example:
+*
+*     imgIt.rewind();
+*     for (PrefetchingImageIterator it(imgIt, 100); it.ready() && (int) it < 100; ++it)
+*         process(it.image());
+*
+* @note With the ImageNet image repository backend, the wrapped iterator decodes images while being
+* dereferenced, which can only happen on one thread at a time. In that case, images are decoded
+* sequentially, but still concurrently with the processing done by the caller.
+*/
+class PrefetchingImageIterator : public ImageIterator
+{
+
+public:
+
+    static const unsigned int DEFAULT_NUM_THREADS = 2; /**< Default number of decoding threads. */
+    static const unsigned int DEFAULT_MAX_IMAGES = 8; /**< Default maximum number of prefetched images. */
+    static const std::size_t DEFAULT_MAX_BYTES = 256 << 20; /**< Default memory budget for prefetched images in bytes. */
+
+    /**
+    * Starts prefetching images from another iterator.
+    *
+    * @param[in] source The iterator to read images from. It will not be owned by the new instance,
+    * but must remain valid as long as the new instance exists.
+    *
+    * @param[in] limit Maximum number of images to be read from @p source. 0 means no limit.
+    * Setting this to the number of images actually needed avoids decoding images in vain.
+    *
+    * @param[in] numThreads Number of threads used for reading and decoding images.
+    *
+    * @param[in] maxImages Maximum number of images which may be prefetched at the same time.
+    *
+    * @param[in] maxBytes Maximum memory in bytes occupied by the pixel data of the prefetched images.
+    * At least one image will be prefetched, even if it exceeds this budget.
+    */
+    PrefetchingImageIterator(ImageIterator & source, const unsigned int limit = 0,
+                             const unsigned int numThreads = DEFAULT_NUM_THREADS,
+                             const unsigned int maxImages = DEFAULT_MAX_IMAGES,
+                             const std::size_t maxBytes = DEFAULT_MAX_BYTES);
+
+    /**
+    * Stops prefetching and waits for the decoding threads to finish.
+    */
+    virtual ~PrefetchingImageIterator();
+
+    /**
+    * Moves the iterator to the next image and discards the current one.
+    *
+    * @return The iterator itself after applying the operation.
+    */
+    virtual PrefetchingImageIterator & operator++();
+
+    /**
+    * Returns a copy of the SynsetImage object at the current position, waiting for it to be decoded if necessary.
+    *
+    * @return SynsetImage instance
+    */
+    virtual SynsetImage operator*();
+
+    /**
+    * Returns the decoded image at the current position without copying it, waiting for it to be decoded if necessary.
+    *
+    * @return Reference to the image, which remains valid until the iterator is moved. The image may be
+    * empty if it could not be loaded or if the iterator is not ready().
+    */
+    const JPEGImage & image();
+
+    /**
+    * Discards all prefetched images, rewinds the wrapped iterator and starts prefetching from the beginning.
+    */
+    virtual void rewind();
+
+    /**
+    * Determines if there is an image at the current position. This may block until the
+    * wrapped iterator has been advanced by one of the decoding threads.
+    *
+    * @return Returns true if the next dereferencing will be successful on this iterator.
+    */
+    virtual bool ready() const;
+
+    /**
+    * @return Returns the current iterator position, i. e. the position of the wrapped iterator
+    * at which the current image has been read.
+    */
+    virtual unsigned int pos() const { return this->m_pos; };
+
+    /**
+    * Allows the use of `(unsigned int) it` instead of `it.pos()`.
+    *
+    * @return Returns the current iterator position.
+    */
+    virtual operator unsigned int() const { return this->m_pos; };
+
+    /**
+    * Allows the use of `(int) it` instead of `it.pos()`.
+    *
+    * @return Returns the current iterator position.
+    */
+    virtual operator int() const { return this->m_pos; };
+
+    /**
+    * @return Returns the path to the repository directory of the wrapped iterator.
+    */
+    virtual std::string getRepoDirectory() const { return this->m_source.getRepoDirectory(); };
+
+
+protected:
+
+    /**
+    * An image in the prefetching queue.
+    */
+    typedef struct {
+        SynsetImage simg; /**< The image obtained from the wrapped iterator. */
+#ifdef NO_CACHE_POSITIVES
+        JPEGImage img; /**< The decoded image, since SynsetImage does not keep it in this case. */
+#endif
+        std::size_t bytes; /**< Size of the pixel data of the decoded image. */
+        bool ready; /**< Specifies whether the image has already been decoded. */
+    } Slot;
+
+    ImageIterator & m_source; /**< The wrapped iterator. */
+    unsigned int m_limit; /**< Maximum number of images to be read from the wrapped iterator (0 = unlimited). */
+    unsigned int m_numThreads; /**< Number of decoding threads. */
+    unsigned int m_maxImages; /**< Maximum number of images in the queue. */
+    std::size_t m_maxBytes; /**< Memory budget for the decoded images in the queue. */
+
+    std::deque<Slot> m_queue; /**< Prefetched images, including those still being decoded. */
+    std::size_t m_queueBytes; /**< Size of the pixel data of all decoded images in the queue. */
+    unsigned int m_fetched; /**< Number of images read from the wrapped iterator since the last rewind. */
+    bool m_exhausted; /**< Set when no more images will be read from the wrapped iterator. */
+    bool m_stop; /**< Signals the decoding threads to terminate. */
+    std::vector<std::thread> m_workers; /**< The decoding threads. */
+
+    std::mutex m_sourceMutex; /**< Serializes the access of the decoding threads to the wrapped iterator. */
+    mutable std::mutex m_mutex; /**< Protects the queue and the state flags. */
+    mutable std::condition_variable m_imageAvailable; /**< Signaled when an image has been added to the queue or decoded. */
+    std::condition_variable m_spaceAvailable; /**< Signaled when an image has been removed from the queue. */
+
+    /**
+    * Starts the decoding threads.
+    */
+    void start();
+
+    /**
+    * Signals the decoding threads to terminate, waits for them to finish and clears the queue.
+    */
+    void stop();
+
+    /**
+    * Main function of the decoding threads: Reads images from the wrapped iterator and decodes them
+    * until it is exhausted or the threads are stopped.
+    */
+    void fetch();
+
+    /**
+    * Waits until the image at the front of the queue has been decoded.
+    *
+    * @param[in] lock A lock on m_mutex, which has to be held by the calling thread.
+    *
+    * @return Pointer to the first slot of the queue or NULL if there are no more images.
+    */
+    Slot * waitForFront(std::unique_lock<std::mutex> & lock);
+
+};
+
+}
+
+#endif
@@ -10,6 +10,8 @@
 #include "portable_endian.h"
 #include "FeaturePyramid.h"
 #include "JPEGImage.h"
+#include "Patchwork.h"
+#include "PrefetchingImageIterator.h"
 using namespace ARTOS;
 using namespace std;
 
@@ -252,11 +254,12 @@ void StationaryBackground::learnMean(ImageIterator & imgIt, const unsigned int n
     int i;
     vector<FeatureMatrix>::const_iterator levelIt;
     unsigned long long numSamples = 0;
-    for (imgIt.rewind(); imgIt.ready() && (numImages == 0 || (unsigned int) imgIt < numImages); ++imgIt)
+    imgIt.rewind();
+    for (PrefetchingImageIterator it(imgIt, numImages); it.ready() && (numImages == 0 || (unsigned int) it < numImages); ++it)
     {
-        if (progressCB != NULL && numImages > 0 && !progressCB((unsigned int) imgIt, numImages, cbData))
+        if (progressCB != NULL && numImages > 0 && !progressCB((unsigned int) it, numImages, cbData))
             break;
-        JPEGImage img = (*imgIt).getImage();
+        const JPEGImage & img = it.image();
         if (!img.empty())
         {
             FeaturePyramid pyra(img, this->m_featureExtractor);
@@ -288,12 +291,14 @@ void StationaryBackground::learnCovariance(ImageIterator & imgIt, const unsigned
     typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> DoubleCovMatrix;
     typedef Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> MatrixXf;
     typedef Eigen::Matrix<complex<float>, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> MatrixXcf;
-    int i, j, l, o, cx, cy, p1, p2;
+    int i, j, o, cx, cy, p1, p2;
     unsigned int minLevelSize = maxOffset * 2;
-    vector<FeatureMatrix>::iterator levelIt;
+    vector<FeatureMatrix>::const_iterator levelIt;
+    PlanarFeatureMatrix planarLevel;
     
     // Load wisdom for FFTW
-    FILE * wisdom_file = fopen("wisdom.fftw", "r");
+    const string wisdom_filename = Patchwork::WisdomFile();
+    FILE * wisdom_file = (!wisdom_filename.empty()) ? fopen(wisdom_filename.c_str(), "r") : NULL;
     if (wisdom_file)
     {
         fftwf_import_wisdom_from_file(wisdom_file);
@@ -309,19 +314,15 @@ void StationaryBackground::learnCovariance(ImageIterator & imgIt, const unsigned
     cov.setConstant(DoubleCovMatrix::Zero(numFeat, numFeat));
     Eigen::Matrix<unsigned long long, Eigen::Dynamic, 1> numSamples(cov.size());
     numSamples.setZero();
-    for (imgIt.rewind(); imgIt.ready() && (numImages == 0 || (unsigned int) imgIt < numImages); ++imgIt)
+    imgIt.rewind();
+    for (PrefetchingImageIterator it(imgIt, numImages); it.ready() && (numImages == 0 || (unsigned int) it < numImages); ++it)
     {
-        if (progressCB != NULL && numImages > 0 && !progressCB((unsigned int) imgIt, numImages, cbData))
+        if (progressCB != NULL && numImages > 0 && !progressCB((unsigned int) it, numImages, cbData))
             break;
-        JPEGImage img = (*imgIt).getImage();
+        const JPEGImage & img = it.image();
         if (!img.empty())
         {
             FeaturePyramid pyra(img, this->m_featureExtractor);
-            // Subtract mean from all features
-            #pragma omp parallel for private(l, i)
-            for (l = 0; l < pyra.levels().size(); l++)
-                for (i = 0; i < pyra.levels()[l].numCells(); i++)
-                    pyra.levels()[l].cell(i).head(numFeat) -= this->mean;
             // Loop over various scales and compute covariances
             for (levelIt = pyra.levels().begin(); levelIt != pyra.levels().end(); levelIt++)
             {
@@ -330,22 +331,26 @@ void StationaryBackground::learnCovariance(ImageIterator & imgIt, const unsigned
                 MatrixXcf freq(levelIt->rows() * numFeat, levelIt->cols() / 2 + 1);
                 MatrixXcf powerSpectrum(levelIt->rows(), freq.cols());
                 MatrixXf correlations(levelIt->rows(), levelIt->cols());
-                // Plan fourier transforms
+                // Plan fourier transforms of the contiguous feature planes of the level
+                // (before filling them, since FFTW may overwrite the input during planning)
                 fftwf_plan ft_forwards, ft_inverse;
                 {
                     int size[2] = {static_cast<int>(levelIt->rows()), static_cast<int>(levelIt->cols())};
-                    FeatureMatrix tmp(*levelIt); // backup data of the level
+                    planarLevel.resize(levelIt->rows(), levelIt->cols(), numFeat);
                     ft_forwards = fftwf_plan_many_dft_r2c(
                         2, size, numFeat,
-                        levelIt->raw(), NULL, levelIt->channels(), 1,
+                        planarLevel.raw(), NULL, 1, size[0] * size[1],
                         reinterpret_cast<fftwf_complex*>(freq.data()), NULL, 1, size[0] * (size[1] / 2 + 1), FFTW_ESTIMATE
                     );
                     ft_inverse = fftwf_plan_dft_c2r_2d(
                         size[0], size[1],
                         reinterpret_cast<fftwf_complex*>(powerSpectrum.data()), correlations.data(), FFTW_MEASURE
                     );
-                    *levelIt = tmp; // restore level, since FFTW may have changed it
                 }
+                // Convert the relevant features to planar layout and subtract the mean
+                planarLevel.assign(*levelIt, 0, numFeat);
+                for (i = 0; i < numFeat; i++)
+                    planarLevel.channel(i).array() -= this->mean(i);
                 //Compute covariances for each pair of levels using the power spectrum
                 fftwf_execute(ft_forwards);
                 cy = correlations.rows() / 2;
@@ -397,7 +402,7 @@ void StationaryBackground::learnCovariance(ImageIterator & imgIt, const unsigned
         }
     
     // Save FFTW wisdom
-    wisdom_file = fopen("wisdom.fftw", "w");
+    wisdom_file = (!wisdom_filename.empty()) ? fopen(wisdom_filename.c_str(), "w") : NULL;
     if (wisdom_file)
     {
         fftwf_export_wisdom_to_file(wisdom_file);
@@ -428,11 +433,12 @@ void StationaryBackground::learnCovariance_accurate(ImageIterator & imgIt, const
     cov.setConstant(DoubleCovMatrix::Zero(numFeat, numFeat));
     Eigen::Matrix<unsigned long long, Eigen::Dynamic, 1> numSamples(cov.size());
     numSamples.setZero();
-    for (imgIt.rewind(); imgIt.ready() && (numImages == 0 || (unsigned int) imgIt < numImages); ++imgIt)
+    imgIt.rewind();
+    for (PrefetchingImageIterator it(imgIt, numImages); it.ready() && (numImages == 0 || (unsigned int) it < numImages); ++it)
     {
-        if (progressCB != NULL && numImages > 0 && !progressCB((unsigned int) imgIt, numImages, cbData))
+        if (progressCB != NULL && numImages > 0 && !progressCB((unsigned int) it, numImages, cbData))
             break;
-        JPEGImage img = (*imgIt).getImage();
+        const JPEGImage & img = it.image();
         if (!img.empty())
         {
             FeaturePyramid pyra(img, this->m_featureExtractor);
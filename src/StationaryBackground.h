@@ -159,7 +159,8 @@ public:
     * Use writeToFile() to save the learned statistics afterwards.
     *
     * @param[in] imgIt An ImageIterator providing images to learn background statistics from.
-    * The iterator will be rewound at the beginning of the process.
+    * The iterator will be rewound at the beginning of the process and read ahead on background threads
+    * using a PrefetchingImageIterator.
     *
     * @param[in] numImages Maximum number of images to learn from. If set to 0, all images provided by the
     * iterator will be used (may take really, really long!).
@@ -194,7 +195,8 @@ public:
     * or learned using learnMean() in advance.
     *
     * @param[in] imgIt An ImageIterator providing images to learn background statistics from.
-    * The iterator will be rewound at the beginning of the process.
+    * The iterator will be rewound at the beginning of the process and read ahead on background threads
+    * using a PrefetchingImageIterator.
     *
     * @param[in] numImages Maximum number of images to learn from. If set to 0, all images provided by the
     * iterator will be used (may take really, really long!).
@@ -226,7 +228,8 @@ public:
     * or learned using learnMean() in advance.
     *
     * @param[in] imgIt An ImageIterator providing images to learn background statistics from.
-    * The iterator will be rewound at the beginning of the process.
+    * The iterator will be rewound at the beginning of the process and read ahead on background threads
+    * using a PrefetchingImageIterator.
     *
     * @param[in] numImages Maximum number of images to learn from. If set to 0, all images provided by the
     * iterator will be used (may take really, really long!).
@@ -49,7 +49,7 @@ struct PositionComparator
 
 int BLF(vector<PatchworkRectangle> & rectangles, unsigned int maxWidth, unsigned int maxHeight)
 {
-    // Order the rectangles by decreasing area. If a rectangle is bigger than MaxRows x MaxCols
+    // Order the rectangles by decreasing area. If a rectangle is bigger than maxWidth x maxHeight
     // return -1
     vector<int> ordering(rectangles.size());
     
@@ -10,6 +10,7 @@
 #include "ImageNetModelLearner.h"
 #include "ImageRepository.h"
 #include "StationaryBackground.h"
+#include "PrefetchingImageIterator.h"
 #include "Scene.h"
 #include "sysutils.h"
 using namespace std;
@@ -31,7 +32,11 @@ bool is_valid_learner_handle(const unsigned int learner);
 map< unsigned int, vector<Sample*> > eval_positive_samples;
 map< unsigned int, vector<JPEGImage> > eval_negative_samples;
 
-int detect_jpeg(const unsigned int detector, const JPEGImage & img, FlatDetection * detection_buf, unsigned int * detection_buf_size);
+int detect_jpeg(const unsigned int detector, const ImageView & img, FlatDetection * detection_buf, unsigned int * detection_buf_size,
+                const DetectionOptions & options = DetectionOptions());
+DetectionOptions make_detection_options(const FlatBoundingBox * rois, const unsigned int num_rois,
+                                        const unsigned int min_width, const unsigned int min_height,
+                                        const unsigned int max_width, const unsigned int max_height);
 void write_results_to_buffer(const vector<Detection> & detections, FlatDetection * detection_buf, unsigned int * detection_buf_size);
 
 
@@ -105,22 +110,126 @@ int num_feature_extractors_in_detector(const unsigned int detector)
         return -1;
 }
 
+int prepare_detector(const unsigned int detector, const unsigned int img_width, const unsigned int img_height)
+{
+    if (is_valid_detector_handle(detector))
+        return detectors[detector - 1]->prepare(img_width, img_height);
+    else
+        return ARTOS_RES_INVALID_HANDLE;
+}
+
+void set_fftw_wisdom_file(const char * wisdom_file)
+{
+    Patchwork::SetWisdomFile((wisdom_file != NULL) ? wisdom_file : "");
+}
+
+void set_filter_spectrum_cache_dir(const char * directory)
+{
+    Patchwork::SetSpectrumCacheDirectory((directory != NULL) ? directory : "");
+}
+
 int detect_file_jpeg(const unsigned int detector,
                              const char * imagefile,
                              FlatDetection * detection_buf, unsigned int * detection_buf_size)
 {
-    return detect_jpeg(detector, JPEGImage(imagefile), detection_buf, detection_buf_size);
+    return detect_file_jpeg_ex(detector, imagefile, detection_buf, detection_buf_size);
+}
+
+int detect_file_jpeg_ex(const unsigned int detector,
+                        const char * imagefile,
+                        FlatDetection * detection_buf, unsigned int * detection_buf_size,
+                        const FlatBoundingBox * rois, const unsigned int num_rois,
+                        const unsigned int min_width, const unsigned int min_height,
+                        const unsigned int max_width, const unsigned int max_height)
+{
+    return detect_jpeg(detector, JPEGImage::ReadWithOctaves(imagefile), detection_buf, detection_buf_size,
+                       make_detection_options(rois, num_rois, min_width, min_height, max_width, max_height));
 }
 
 int detect_raw(const unsigned int detector,
                        const unsigned char * img_data, const unsigned int img_width, const unsigned int img_height, const bool grayscale,
                        FlatDetection * detection_buf, unsigned int * detection_buf_size)
 {
-    return detect_jpeg(detector, JPEGImage(img_width, img_height, (grayscale) ? 1 : 3, img_data), detection_buf, detection_buf_size);
+    return detect_raw_strided(detector, img_data, img_width, img_height, grayscale, 0, detection_buf, detection_buf_size);
+}
+
+int detect_raw_ex(const unsigned int detector,
+                  const unsigned char * img_data, const unsigned int img_width, const unsigned int img_height, const bool grayscale,
+                  FlatDetection * detection_buf, unsigned int * detection_buf_size,
+                  const FlatBoundingBox * rois, const unsigned int num_rois,
+                  const unsigned int min_width, const unsigned int min_height,
+                  const unsigned int max_width, const unsigned int max_height)
+{
+    return detect_raw_strided(detector, img_data, img_width, img_height, grayscale, 0, detection_buf, detection_buf_size,
+                              rois, num_rois, min_width, min_height, max_width, max_height);
+}
+
+int detect_raw_strided(const unsigned int detector,
+                       const unsigned char * img_data, const unsigned int img_width, const unsigned int img_height, const bool grayscale,
+                       const unsigned int img_stride,
+                       FlatDetection * detection_buf, unsigned int * detection_buf_size,
+                       const FlatBoundingBox * rois, const unsigned int num_rois,
+                       const unsigned int min_width, const unsigned int min_height,
+                       const unsigned int max_width, const unsigned int max_height)
+{
+    return detect_jpeg(detector, ImageView(img_data, img_width, img_height, (grayscale) ? 1 : 3, img_stride), detection_buf, detection_buf_size,
+                       make_detection_options(rois, num_rois, min_width, min_height, max_width, max_height));
+}
+
+DetectionOptions make_detection_options(const FlatBoundingBox * rois, const unsigned int num_rois,
+                                        const unsigned int min_width, const unsigned int min_height,
+                                        const unsigned int max_width, const unsigned int max_height)
+{
+    DetectionOptions options;
+    options.minObjectSize = Size(min_width, min_height);
+    options.maxObjectSize = Size(max_width, max_height);
+    if (rois != NULL)
+        for (unsigned int i = 0; i < num_rois; i++)
+            options.regions.push_back(Rectangle(rois[i].left, rois[i].top, rois[i].width, rois[i].height));
+    return options;
 }
 
 
-int detect_jpeg(const unsigned int detector, const JPEGImage & img, FlatDetection * detection_buf, unsigned int * detection_buf_size)
+int detect_files_jpeg(const unsigned int detector,
+                      const char ** imagefiles, const unsigned int num_imagefiles,
+                      FlatDetection * detection_buf, unsigned int * detection_buf_sizes,
+                      int * results, const unsigned int num_threads)
+{
+    if (!is_valid_detector_handle(detector))
+        return ARTOS_RES_INVALID_HANDLE;
+    
+    vector< vector<Detection> > detections;
+    vector<int> imageResults;
+    int numFailed;
+    try
+    {
+        numFailed = detectors[detector - 1]->detectBatch(
+            num_imagefiles,
+            [imagefiles](size_t i) { return JPEGImage::ReadWithOctaves(imagefiles[i]); },
+            detections, &imageResults, num_threads
+        );
+    }
+    catch (const exception &)
+    {
+        return ARTOS_RES_INTERNAL_ERROR;
+    }
+    if (numFailed < 0)
+        return numFailed;
+    
+    for (unsigned int i = 0; i < num_imagefiles; i++)
+    {
+        unsigned int bufSize = detection_buf_sizes[i];
+        sort(detections[i].begin(), detections[i].end());
+        write_results_to_buffer(detections[i], detection_buf, detection_buf_sizes + i);
+        detection_buf += bufSize;
+        if (results != NULL)
+            results[i] = imageResults[i];
+    }
+    return numFailed;
+}
+
+int detect_jpeg(const unsigned int detector, const ImageView & img, FlatDetection * detection_buf, unsigned int * detection_buf_size,
+                const DetectionOptions & options)
 {
     if (is_valid_detector_handle(detector))
     {
@@ -128,14 +237,18 @@ int detect_jpeg(const unsigned int detector, const JPEGImage & img, FlatDetectio
             return ARTOS_DETECT_RES_INVALID_IMG_DATA;
         vector<Detection> detections;
         int result;
-        if (*detection_buf_size == 1)
+        const bool restricted = (!options.regions.empty() || options.minObjectSize.max() > 0 || options.maxObjectSize.max() > 0);
+        if (*detection_buf_size == 1 && !restricted)
         {
             Detection detection;
             result = detectors[detector - 1]->detectMax(img, detection);
             detections.push_back(move(detection));
         }
         else
-            result = detectors[detector - 1]->detect(img, detections);
+        {
+            DetectionWorkspace workspace;
+            result = detectors[detector - 1]->detect(img, detections, workspace, options);
+        }
         if (result == ARTOS_RES_OK)
         {
             sort(detections.begin(), detections.end());
@@ -345,7 +458,7 @@ int learn_files_jpeg(const char ** imagefiles, const unsigned int num_imagefiles
 }
 
 
-int learner_add_jpeg(const unsigned int learner, const JPEGImage & img, const FlatBoundingBox * bboxes, const unsigned int num_bboxes);
+int learner_add_jpeg(const unsigned int learner, JPEGImage && img, const FlatBoundingBox * bboxes, const unsigned int num_bboxes);
 bool progress_proxy(unsigned int current, unsigned int total, void * data);
 
 unsigned int create_learner(const char * bg_file, const char * repo_directory, const bool th_opt_loocv, const bool debug)
@@ -399,7 +512,14 @@ int learner_add_raw(const unsigned int learner,
                     const unsigned char * img_data, const unsigned int img_width, const unsigned int img_height, const bool grayscale,
                     const FlatBoundingBox * bboxes, const unsigned int num_bboxes)
 {
-    return learner_add_jpeg(learner, JPEGImage(img_width, img_height, (grayscale) ? 1 : 3, img_data), bboxes, num_bboxes);
+    return learner_add_raw_strided(learner, img_data, img_width, img_height, grayscale, 0, bboxes, num_bboxes);
+}
+
+int learner_add_raw_strided(const unsigned int learner,
+                            const unsigned char * img_data, const unsigned int img_width, const unsigned int img_height, const bool grayscale,
+                            const unsigned int img_stride, const FlatBoundingBox * bboxes, const unsigned int num_bboxes)
+{
+    return learner_add_jpeg(learner, JPEGImage(ImageView(img_data, img_width, img_height, (grayscale) ? 1 : 3, img_stride)), bboxes, num_bboxes);
 }
 
 int learner_run(const unsigned int learner, const unsigned int max_aspect_clusters, const unsigned int max_who_clusters, progress_cb_t progress_cb)
@@ -459,7 +579,7 @@ bool is_valid_learner_handle(const unsigned int learner)
     return (learner > 0 && learner <= learners.size() && learners[learner - 1] != NULL);
 }
 
-int learner_add_jpeg(const unsigned int learner, const JPEGImage & img, const FlatBoundingBox * bboxes, const unsigned int num_bboxes)
+int learner_add_jpeg(const unsigned int learner, JPEGImage && img, const FlatBoundingBox * bboxes, const unsigned int num_bboxes)
 {
     if (!is_valid_learner_handle(learner))
         return ARTOS_RES_INVALID_HANDLE;
@@ -469,7 +589,7 @@ int learner_add_jpeg(const unsigned int learner, const JPEGImage & img, const Fl
     if (bboxes != NULL)
         for (const FlatBoundingBox * flat_bbox = bboxes; flat_bbox < bboxes + num_bboxes; flat_bbox++)
             _bboxes.push_back(Rectangle(flat_bbox->left, flat_bbox->top, flat_bbox->width, flat_bbox->height));
-    learners[learner - 1]->addPositiveSample(img, _bboxes);
+    learners[learner - 1]->addPositiveSample(move(img), _bboxes);
     return ARTOS_RES_OK;
 }
 
@@ -547,10 +667,11 @@ int evaluator_add_samples_from_synset(const unsigned int detector, const char *
 
     // Extract positive samples
     vector<Sample*> & positives = eval_positive_samples[detector];
-    for (SynsetImageIterator imgIt = synset.getImageIterator(false); imgIt.ready(); ++imgIt)
+    SynsetImageIterator posIt = synset.getImageIterator(false);
+    for (PrefetchingImageIterator imgIt(posIt); imgIt.ready(); ++imgIt)
     {
         SynsetImage simg = *imgIt;
-        JPEGImage & img = simg.getImage();
+        const JPEGImage & img = imgIt.image();
         if (!img.empty())
         {
             Sample * s = new Sample();
@@ -573,13 +694,15 @@ int evaluator_add_samples_from_synset(const unsigned int detector, const char *
         {
             Synset negSynset = *synsetIt;
             if (negSynset.id != synset.id)
-                for (SynsetImageIterator imgIt = negSynset.getImageIterator(); imgIt.ready(); ++imgIt)
+            {
+                SynsetImageIterator negIt = negSynset.getImageIterator();
+                for (PrefetchingImageIterator imgIt(negIt); imgIt.ready(); ++imgIt)
                 {
-                    SynsetImage simg = *imgIt;
-                    JPEGImage & img = simg.getImage();
+                    const JPEGImage & img = imgIt.image();
                     if (!img.empty())
                         negatives.push_back(img);
                 }
+            }
         }
     }
     
@@ -1026,7 +1149,7 @@ int extract_features_file_jpeg(const char * imagefile,
                                unsigned char * feature_buf, unsigned int * feature_buf_size,
                                const unsigned int interval, const unsigned int min_size)
 {
-    return extract_features_jpeg(JPEGImage(imagefile), feature_buf, feature_buf_size, interval, min_size);
+    return extract_features_jpeg(JPEGImage::ReadWithOctaves(imagefile), feature_buf, feature_buf_size, interval, min_size);
 }
 
 
@@ -1041,7 +1164,7 @@ int extract_features_raw(const unsigned char * img_data, const unsigned int img_
 int save_features_file_jpeg(const char * imagefile, const char * out_file,
                             const unsigned int interval, const unsigned int min_size)
 {
-    return save_features_jpeg(JPEGImage(imagefile), out_file, interval, min_size);
+    return save_features_jpeg(JPEGImage::ReadWithOctaves(imagefile), out_file, interval, min_size);
 }
 
 
@@ -76,6 +76,16 @@ typedef struct {
     int bottom;
 } FlatDetection;
 
+/**
+* A simple bounding box around an object on an image.
+*/
+typedef struct {
+    unsigned int left;
+    unsigned int top;
+    unsigned int width;
+    unsigned int height;
+} FlatBoundingBox;
+
 /**
 * Creates a new detector instance.
 * @param[in] overlap Minimum overlap for non-maxima suppression.
@@ -148,6 +158,36 @@ int add_model_from_learner(const unsigned int detector, const char * classname,
 */
 int num_feature_extractors_in_detector(const unsigned int detector);
 
+/**
+* Prepares a detector instance for images of a given size by planning the FFTW transforms and transforming the filters
+* of all models in advance, so that this doesn't have to be done during the first detection on such images.
+* This may be called for each image size expected by an application after all models have been added.
+* @param[in] detector The handle of the detector instance obtained by create_detector().
+* @param[in] img_width The width of the images.
+* @param[in] img_height The height of the images.
+* @return Returns `ARTOS_RES_OK` on success or one of the following error codes on failure:
+*           - `ARTOS_RES_INVALID_HANDLE`
+*           - `ARTOS_DETECT_RES_NO_MODELS`
+*           - `ARTOS_DETECT_RES_INVALID_IMAGE` (image size too small)
+*           - `ARTOS_RES_INTERNAL_ERROR`
+*/
+int prepare_detector(const unsigned int detector, const unsigned int img_width, const unsigned int img_height);
+
+/**
+* Changes the file which FFTW wisdom is read from and written to. Defaults to "wisdom.fftw" in the current working directory.
+* @param[in] wisdom_file Path to the wisdom file. If NULL or empty, wisdom will neither be read nor written.
+*/
+void set_fftw_wisdom_file(const char * wisdom_file);
+
+/**
+* Changes the directory where the Fourier transforms of model filters are stored, so that they can be
+* mapped into memory by other detectors and processes instead of being computed again.
+* Transformed filters are always shared by all detectors of a process, even if no directory is set.
+* @param[in] directory Path to an existing directory. If NULL or empty, transformed filters will not be stored on disk.
+* Defaults to NULL.
+*/
+void set_filter_spectrum_cache_dir(const char * directory);
+
 /**
 * Detects objects in a JPEG image file which match one of the models added before using add_model() or add_models().
 * @param[in] detector The handle of the detector instance obtained by create_detector().
@@ -167,6 +207,36 @@ int detect_file_jpeg(const unsigned int detector,
                              const char * imagefile,
                              FlatDetection * detection_buf, unsigned int * detection_buf_size);
 
+/**
+* Detects objects in a JPEG image file which match one of the models added before using add_model() or add_models(),
+* restricted to regions of interest and a range of object sizes.
+* @param[in] detector The handle of the detector instance obtained by create_detector().
+* @param[in] imagefile The filename of the JPEG image.
+* @param[out] detection_buf A beforehand allocated buffer array of FlatDetection structs, that will be filled up with the
+*                           detection results ordered descending by their detection score.
+* @param[in,out] detection_buf_size The number of allocated array slots of `detection_buf`.
+*                                   In turn, the number of actually stored results will be written to this pointer's location.
+* @param[in] rois Optionally, an array of regions of interest. If given, only objects whose centre lies inside one of these
+*                 regions will be detected and features will only be computed for the regions and some context around them.
+* @param[in] num_rois The number of regions in the `rois` array.
+* @param[in] min_width Minimum width of detected objects in pixels. Pyramid levels where all models would be narrower are not computed.
+* @param[in] min_height Minimum height of detected objects in pixels. Pyramid levels where all models would be lower are not computed.
+* @param[in] max_width Maximum width of detected objects in pixels or 0 for no limit. Pyramid levels where all models would be wider are not computed.
+* @param[in] max_height Maximum height of detected objects in pixels or 0 for no limit. Pyramid levels where all models would be higher are not computed.
+* @return Returns `ARTOS_RES_OK` on success or one of the following error codes on failure:
+*           - `ARTOS_RES_INVALID_HANDLE`
+*           - `ARTOS_DETECT_RES_NO_MODELS`
+*           - `ARTOS_DETECT_RES_INVALID_IMG_DATA` (image couldn't be read)
+*           - `ARTOS_DETECT_RES_INVALID_IMAGE` (image couldn't be processed)
+*           - `ARTOS_RES_INTERNAL_ERROR`
+*/
+int detect_file_jpeg_ex(const unsigned int detector,
+                        const char * imagefile,
+                        FlatDetection * detection_buf, unsigned int * detection_buf_size,
+                        const FlatBoundingBox * rois = 0, const unsigned int num_rois = 0,
+                        const unsigned int min_width = 0, const unsigned int min_height = 0,
+                        const unsigned int max_width = 0, const unsigned int max_height = 0);
+
 /**
 * Detects objects in a pre-computed feature pyramid which match one of the models added before using add_model() or add_models().
 * @param[in] detector The handle of the detector instance obtained by create_detector().
@@ -213,6 +283,106 @@ int detect_raw(const unsigned int detector,
                        const unsigned char * img_data, const unsigned int img_width, const unsigned int img_height, const bool grayscale,
                        FlatDetection * detection_buf, unsigned int * detection_buf_size);
 
+/**
+* Detects objects in an RGB or grayscale image given by raw pixel data in a buffer,
+* which match one of the models added before using add_model() or add_models(),
+* restricted to regions of interest and a range of object sizes.
+* @param[in] detector The handle of the detector instance obtained by create_detector().
+* @param[in] img_data The pixel data of the image in row-major order. Row 0: R,G,B,R,G,B,...; Row 1: R,G,B,R,G,B,...; ...
+* @param[in] img_width The width of the image.
+* @param[in] img_height The height of the image.
+* @param[in] grayscale If set to true, a bit depth of 1 byte per pixel is assumed (intensity), otherwise bit depth is set to 3 (RGB).
+* @param[out] detection_buf A beforehand allocated buffer array of FlatDetection structs, that will be filled up with the
+*                           detection results ordered descending by their detection score.
+* @param[in,out] detection_buf_size The number of allocated array slots of `detection_buf`.
+*                                   In turn, the number of actually stored results will be written to this pointer's location.
+* @param[in] rois Optionally, an array of regions of interest. If given, only objects whose centre lies inside one of these
+*                 regions will be detected and features will only be computed for the regions and some context around them.
+* @param[in] num_rois The number of regions in the `rois` array.
+* @param[in] min_width Minimum width of detected objects in pixels. Pyramid levels where all models would be narrower are not computed.
+* @param[in] min_height Minimum height of detected objects in pixels. Pyramid levels where all models would be lower are not computed.
+* @param[in] max_width Maximum width of detected objects in pixels or 0 for no limit. Pyramid levels where all models would be wider are not computed.
+* @param[in] max_height Maximum height of detected objects in pixels or 0 for no limit. Pyramid levels where all models would be higher are not computed.
+* @return Returns `ARTOS_RES_OK` on success or one of the following error codes on failure:
+*           - `ARTOS_RES_INVALID_HANDLE`
+*           - `ARTOS_DETECT_RES_NO_MODELS`
+*           - `ARTOS_DETECT_RES_INVALID_IMG_DATA` (image couldn't be read)
+*           - `ARTOS_DETECT_RES_INVALID_IMAGE` (image couldn't be processed)
+*           - `ARTOS_RES_INTERNAL_ERROR`
+*/
+int detect_raw_ex(const unsigned int detector,
+                  const unsigned char * img_data, const unsigned int img_width, const unsigned int img_height, const bool grayscale,
+                  FlatDetection * detection_buf, unsigned int * detection_buf_size,
+                  const FlatBoundingBox * rois = 0, const unsigned int num_rois = 0,
+                  const unsigned int min_width = 0, const unsigned int min_height = 0,
+                  const unsigned int max_width = 0, const unsigned int max_height = 0);
+
+/**
+* Detects objects in an RGB or grayscale image given by raw pixel data in a buffer whose rows may be padded,
+* which match one of the models added before using add_model() or add_models().
+*
+* The pixel data is processed in place without being copied, so that padded frames of a video stream can be
+* passed directly. Apart from `img_stride`, the parameters are the same as for detect_raw_ex().
+*
+* @param[in] detector The handle of the detector instance obtained by create_detector().
+* @param[in] img_data The pixel data of the image in row-major order. Row 0: R,G,B,R,G,B,...; Row 1: R,G,B,R,G,B,...; ...
+* @param[in] img_width The width of the image.
+* @param[in] img_height The height of the image.
+* @param[in] grayscale If set to true, a bit depth of 1 byte per pixel is assumed (intensity), otherwise bit depth is set to 3 (RGB).
+* @param[in] img_stride The number of bytes between the beginnings of two consecutive rows in `img_data` or 0 if the rows
+*                       are stored contiguously. `img_data` must hold at least `img_stride * (img_height - 1)` bytes followed
+*                       by one complete row.
+* @param[out] detection_buf A beforehand allocated buffer array of FlatDetection structs, that will be filled up with the
+*                           detection results ordered descending by their detection score.
+* @param[in,out] detection_buf_size The number of allocated array slots of `detection_buf`.
+*                                   In turn, the number of actually stored results will be written to this pointer's location.
+* @param[in] rois Optionally, an array of regions of interest (see detect_raw_ex()).
+* @param[in] num_rois The number of regions in the `rois` array.
+* @param[in] min_width Minimum width of detected objects in pixels.
+* @param[in] min_height Minimum height of detected objects in pixels.
+* @param[in] max_width Maximum width of detected objects in pixels or 0 for no limit.
+* @param[in] max_height Maximum height of detected objects in pixels or 0 for no limit.
+* @return Returns `ARTOS_RES_OK` on success or one of the error codes returned by detect_raw() on failure.
+*/
+int detect_raw_strided(const unsigned int detector,
+                       const unsigned char * img_data, const unsigned int img_width, const unsigned int img_height, const bool grayscale,
+                       const unsigned int img_stride,
+                       FlatDetection * detection_buf, unsigned int * detection_buf_size,
+                       const FlatBoundingBox * rois = 0, const unsigned int num_rois = 0,
+                       const unsigned int min_width = 0, const unsigned int min_height = 0,
+                       const unsigned int max_width = 0, const unsigned int max_height = 0);
+
+/**
+* Detects objects in a batch of JPEG image files which match one of the models added before using add_model() or add_models().
+*
+* The images are read and processed by a pool of threads, each handling one image at a time, so that reading, feature extraction,
+* convolution and non-maximum suppression of different images overlap. This is much faster than calling detect_file_jpeg()
+* for each image when processing large amounts of images.
+*
+* @param[in] detector The handle of the detector instance obtained by create_detector().
+* @param[in] imagefiles Array with the filenames of the JPEG images.
+* @param[in] num_imagefiles Number of images in the `imagefiles` array.
+* @param[out] detection_buf A beforehand allocated buffer array of FlatDetection structs, which is divided into consecutive
+*                           sections for each image, whose sizes are given by `detection_buf_sizes`. Each section will be
+*                           filled up with the detection results for the respective image ordered descending by their score.
+* @param[in,out] detection_buf_sizes Array with `num_imagefiles` elements, specifying the number of slots of `detection_buf`
+*                                    allocated for each image. In turn, the number of actually stored results for each image
+*                                    will be written to this array.
+* @param[out] results Optionally, an array with `num_imagefiles` elements which will receive the result code of the detection
+*                     on each image (`ARTOS_RES_OK`, `ARTOS_DETECT_RES_INVALID_IMG_DATA`, `ARTOS_DETECT_RES_INVALID_IMAGE`
+*                     or `ARTOS_RES_INTERNAL_ERROR`).
+* @param[in] num_threads The number of images to be processed in parallel. If set to 0, the number of hardware threads will be used.
+* @return Returns the number of images on which detection failed (0 if all images could be processed) or one of the following
+*         error codes on failure:
+*           - `ARTOS_RES_INVALID_HANDLE`
+*           - `ARTOS_DETECT_RES_NO_MODELS`
+*           - `ARTOS_RES_INTERNAL_ERROR`
+*/
+int detect_files_jpeg(const unsigned int detector,
+                      const char ** imagefiles, const unsigned int num_imagefiles,
+                      FlatDetection * detection_buf, unsigned int * detection_buf_sizes,
+                      int * results = 0, const unsigned int num_threads = 0);
+
 /** @} */
 
 
@@ -223,16 +393,6 @@ int detect_raw(const unsigned int detector,
 /** @name Learning */
 /** @{ */
 
-/**
-* A simple bounding box around an object on an image.
-*/
-typedef struct {
-    unsigned int left;
-    unsigned int top;
-    unsigned int width;
-    unsigned int height;
-} FlatBoundingBox;
-
 typedef bool (*progress_cb_t)(unsigned int, unsigned int);
 typedef bool (*overall_progress_cb_t)(unsigned int, unsigned int, unsigned int, unsigned int);
 
@@ -408,6 +568,27 @@ int learner_add_raw(const unsigned int learner,
                     const unsigned char * img_data, const unsigned int img_width, const unsigned int img_height, const bool grayscale = false,
                     const FlatBoundingBox * bboxes = 0, const unsigned int num_bboxes = 1);
 
+/**
+* Adds an RGB or grayscale image given by raw pixel data in a buffer whose rows may be padded as positive sample to a learner instance.
+* Apart from `img_stride`, the parameters are the same as for learner_add_raw().
+* @param[in] learner The handle of the learner instance obtained by create_learner().
+* @param[in] img_data The pixel data of the image in row-major order. Row 0: R,G,B,R,G,B,...; Row 1: R,G,B,R,G,B,...; ...
+* @param[in] img_width The width of the image.
+* @param[in] img_height The height of the image.
+* @param[in] grayscale If set to true, a bit depth of 1 byte per pixel is assumed (intensity), otherwise bit depth is set to 3 (RGB).
+* @param[in] img_stride The number of bytes between the beginnings of two consecutive rows in `img_data` or 0 if the rows
+*                       are stored contiguously.
+* @param[in] bboxes Pointer to an array of FlatBoundingBox structs giving the bounding box(es)
+*                   around the objects of interest on the given image (see learner_add_raw()).
+* @param[in] num_bboxes Number of entries in the `bboxes` array. Is ignored, if `bboxes` is NULL.
+* @return Returns `ARTOS_RES_OK` on success or one of the following error codes on failure:
+*                   - `ARTOS_RES_INVALID_HANDLE`
+*                   - `ARTOS_LEARN_RES_INVALID_IMG_DATA`
+*/
+int learner_add_raw_strided(const unsigned int learner,
+                            const unsigned char * img_data, const unsigned int img_width, const unsigned int img_height, const bool grayscale,
+                            const unsigned int img_stride, const FlatBoundingBox * bboxes = 0, const unsigned int num_bboxes = 1);
+
 /**
 * Performs the actual learning step for a given learner instance.
 * For an overview of our model learning method, refer to the documentation of the ModelLearner class.
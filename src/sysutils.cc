@@ -166,6 +166,27 @@ bool is_dir(const string & path)
 #endif
 }
 
+bool file_stats(const string & path, uint64_t & size, uint64_t & mtime)
+{
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA attr;
+    if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &attr) || (attr.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+        return false;
+    size = (static_cast<uint64_t>(attr.nFileSizeHigh) << 32) | attr.nFileSizeLow;
+    // Convert from 100-nanosecond intervals since 1601-01-01 to seconds since 1970-01-01
+    uint64_t filetime = (static_cast<uint64_t>(attr.ftLastWriteTime.dwHighDateTime) << 32) | attr.ftLastWriteTime.dwLowDateTime;
+    mtime = filetime / 10000000ULL - 11644473600ULL;
+    return true;
+#else
+    struct stat st_buf;
+    if (stat(path.c_str(), &st_buf) != 0 || !S_ISREG(st_buf.st_mode))
+        return false;
+    size = st_buf.st_size;
+    mtime = st_buf.st_mtime;
+    return true;
+#endif
+}
+
 void scandir(const string & dir, vector<string> & files, const FileType ft, const string & extensionFilter)
 {
 #ifdef _WIN32
@@ -10,6 +10,7 @@
 
 #include <string>
 #include <vector>
+#include <stdint.h>
 
 /**
 * @return The current working directory.
@@ -107,6 +108,19 @@ bool is_file(const std::string & path);
 */
 bool is_dir(const std::string & path);
 
+/**
+* Determines the size and the time of the last modification of a file.
+*
+* @param[in] path A path on the filesystem.
+*
+* @param[out] size Will be set to the size of the file in bytes.
+*
+* @param[out] mtime Will be set to the time of the last modification of the file as UNIX timestamp.
+*
+* @return True if `path` points to an existing regular file whose attributes could be read, otherwise false.
+*/
+bool file_stats(const std::string & path, uint64_t & size, uint64_t & mtime);
+
 
 enum FileType { ftFile = 1, ftDirectory = 2, ftAny = ftFile | ftDirectory };
 
@@ -4,7 +4,8 @@
 #include <chrono>
 #include <vector>
 
-extern std::vector<std::chrono::high_resolution_clock::time_point> TimingStarts;
+// Each thread has its own stack of timers, so that timings of concurrent operations don't get mixed up
+extern thread_local std::vector<std::chrono::high_resolution_clock::time_point> TimingStarts;
 
 inline void start()
 {
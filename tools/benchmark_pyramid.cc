@@ -0,0 +1,149 @@
+/**
+* @file
+* Compares the detection time and the Average Precision of a model on data stored in a
+* given directory when using exact feature pyramids and approximated feature pyramids
+* (see FeaturePyramid::Approximation).
+*/
+
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdlib>
+#include "ModelEvaluator.h"
+#include "strutils.h"
+#include "sysutils.h"
+#include "timingtools.h"
+#include "Scene.h"
+
+using namespace ARTOS;
+using namespace std;
+
+
+int main(int argc, char * argv[])
+{
+    if (argc < 3)
+    {
+        cout << "Runs the detector with a given model against all samples in a given directory" << endl
+             << "once with exact feature pyramids and once for each method of feature pyramid" << endl
+             << "approximation and reports the time taken and the Average Precision achieved." << endl
+             << "The directory has to contain an XML annotations file for each image with the same name." << endl << endl
+             << "Usage: " << argv[0] << " <model-filename> <data-directory> <exact-levels>? <interval>?" << endl << endl
+             << "ARGUMENTS" << endl << endl
+             << "    model-filename         Name of the model file." << endl
+             << endl
+             << "    data-directory         Path to the directory with images and annotation files." << endl
+             << endl
+             << "    exact-levels           Number of levels per octave whose features are computed" << endl
+             << "                           exactly by the approximated pyramids. Default: 1" << endl
+             << endl
+             << "    interval               Number of levels per octave in the feature pyramid." << endl
+             << "                           Default: 10" << endl;
+        return 0;
+    }
+
+    if (!is_dir(argv[2]))
+    {
+        cerr << "Directory not found: " << argv[2] << endl;
+        return 2;
+    }
+
+    const int exactLevels = (argc > 3) ? atoi(argv[3]) : 1;
+    const int interval = (argc > 4) ? atoi(argv[4]) : 10;
+    if (exactLevels < 1 || interval < 1)
+    {
+        cerr << "Invalid number of levels." << endl;
+        return 1;
+    }
+
+    ModelEvaluator eval(argv[1], 0.5, 0.5, interval);
+    if (eval.getNumModels() == 0)
+    {
+        cerr << "Invalid model file." << endl;
+        return 1;
+    }
+
+    // Extract samples
+    vector<Sample*> samples;
+    unsigned int numObjects = 0;
+    {
+        vector<string> files;
+        scandir(argv[2], files, ftFile, "jpg");
+        string imgName;
+        double scale;
+        ARTOS::Rectangle bbox;
+        for (vector<string>::const_iterator filename = files.begin(); filename != files.end(); filename++)
+        {
+            imgName = strip_file_extension(*filename);
+            if (is_file(join_path(2, argv[2], (imgName + ".xml").c_str())))
+            {
+                JPEGImage img(join_path(2, argv[2], filename->c_str()));
+                if (!img.empty())
+                {
+                    Scene scene(join_path(2, argv[2], (imgName + ".xml").c_str()));
+                    if (scene.objects().size() > 0)
+                    {
+                        Sample * sample = new Sample();
+                        sample->m_img = img;
+                        scale = static_cast<double>(scene.width()) / img.width();
+                        for (vector<Object>::const_iterator object = scene.objects().begin(); object != scene.objects().end(); object++)
+                            if (!object->difficult())
+                            {
+                                bbox = object->bndbox();
+                                bbox.setX(round(bbox.x() * scale));
+                                bbox.setY(round(bbox.y() * scale));
+                                bbox.setWidth(round(bbox.width() * scale));
+                                bbox.setHeight(round(bbox.height() * scale));
+                                if (bbox.width() > 0 && bbox.height() > 0)
+                                {
+                                    sample->m_bboxes.push_back(bbox);
+                                    sample->modelAssoc.push_back(0);
+                                    numObjects++;
+                                }
+                            }
+                        samples.push_back(sample);
+                    }
+                    else
+                        cerr << "Could not parse annotations for " << imgName << endl;
+                }
+                else
+                    cerr << "Could not open " << *filename << endl;
+            }
+            else
+                cerr << "No XML file found for " << imgName << endl;
+        }
+    }
+    if (samples.size() == 0)
+    {
+        cerr << "No images found." << endl;
+        return 3;
+    }
+    cout << "Testing model against " << samples.size() << " images with " << numObjects << " objects." << endl << endl;
+
+    // Evaluate with each pyramid construction method
+    vector< pair<string, FeaturePyramid::Approximation> > methods = {
+        make_pair("Exact", FeaturePyramid::Approximation::NONE),
+        make_pair("Channels", FeaturePyramid::Approximation::CHANNELS),
+        make_pair("Features", FeaturePyramid::Approximation::FEATURES)
+    };
+    cout << setw(10) << left << "Pyramid" << setw(12) << right << "Time [ms]" << setw(14) << "ms / Image" << setw(10) << "AP" << endl;
+    cout << fixed;
+    for (vector< pair<string, FeaturePyramid::Approximation> >::const_iterator method = methods.begin(); method != methods.end(); method++)
+    {
+        eval.setPyramidApproximation(method->second, exactLevels);
+        start();
+        eval.testModels(samples);
+        const unsigned int duration = stop();
+        cout << setw(10) << left << method->first << setw(12) << right << duration
+             << setw(14) << setprecision(1) << static_cast<double>(duration) / samples.size()
+             << setw(10) << setprecision(4) << eval.computeAveragePrecision() << endl;
+    }
+
+    // Cleanup
+    for (vector<Sample*>::iterator sample = samples.begin(); sample != samples.end(); sample++)
+        delete *sample;
+
+    return 0;
+}
@@ -0,0 +1,85 @@
+/**
+* @file
+* Converts model files between the text format and the binary format, which can be
+* mapped into memory and used in place (see Mixture::writeBinary()).
+*/
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include "DPMDetection.h"
+#include "Mixture.h"
+#include "exceptions.h"
+using namespace std;
+using namespace ARTOS;
+
+int main(int argc, char * argv[])
+{
+    if (argc < 3)
+    {
+        cout << "Converts a model file between the text format and the binary format." << endl << endl
+             << "Usage: " << argv[0] << " <input-model> <output-model> <format>? [<width> <height>]*" << endl << endl
+             << "ARGUMENTS" << endl << endl
+             << "    input-model            Name of the model file to read (text or binary)." << endl
+             << endl
+             << "    output-model           Name of the model file to write." << endl
+             << endl
+             << "    format                 Either 'binary' or 'text'. Default: binary" << endl
+             << endl
+             << "    width height           Sizes of the images the model will be applied to. The transformed" << endl
+             << "                           filters for those image sizes will be stored in the binary file too," << endl
+             << "                           so that they don't have to be computed when loading the model." << endl;
+        return 0;
+    }
+
+    const string format = (argc > 3) ? argv[3] : "binary";
+    if (format != "binary" && format != "text")
+    {
+        cerr << "Invalid format: " << format << endl;
+        return 1;
+    }
+    if (argc > 4 && (argc - 4) % 2 != 0)
+    {
+        cerr << "Image sizes must be given as pairs of width and height." << endl;
+        return 1;
+    }
+
+    // Read model
+    Mixture mixture;
+    try
+    {
+        if (!mixture.readFromFile(argv[1], false))
+        {
+            cerr << "Could not open " << argv[1] << endl;
+            return 2;
+        }
+    }
+    catch (const exception & e)
+    {
+        cerr << "Invalid model file: " << argv[1] << " (" << e.what() << ")" << endl;
+        return 2;
+    }
+
+    // Transform filters for the given image sizes
+    const Mixture * model = &mixture;
+    DPMDetection detector;
+    if (argc > 4)
+    {
+        detector.addModel("model", move(mixture), 0.0);
+        for (int i = 4; i + 1 < argc; i += 2)
+            if (detector.prepare(atoi(argv[i]), atoi(argv[i + 1])) != ARTOS_RES_OK)
+            {
+                cerr << "Could not prepare the model for images of size " << argv[i] << " x " << argv[i + 1] << endl;
+                return 3;
+            }
+        model = detector.getModel("model");
+    }
+
+    // Write model
+    if (!model->writeToFile(argv[2], format == "binary", argc > 4))
+    {
+        cerr << "Could not write " << argv[2] << endl;
+        return 4;
+    }
+    return 0;
+}
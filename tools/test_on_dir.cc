@@ -20,17 +20,10 @@
 #include "sysutils.h"
 #include "Scene.h"
 
-#ifdef _WIN32
-#include <windows.h>
-#else
-#include <dirent.h>
-#endif
-
 using namespace ARTOS;
 using namespace std;
 
 
-void listJPEGFiles(const char*, vector<string>&);
 bool displayProgress(unsigned int, unsigned int, void*);
 
 
@@ -71,7 +64,7 @@ int main(int argc, char * argv[])
     unsigned int numObjects = 0;
     {
         vector<string> files;
-        listJPEGFiles(argv[2], files);
+        scandir(argv[2], files, ftFile, "jpg");
         string imgName;
         double scale;
         ARTOS::Rectangle bbox;
@@ -147,38 +140,6 @@ int main(int argc, char * argv[])
 }
 
 
-void listJPEGFiles(const char * dir, vector<string> & files)
-{
-#ifdef _WIN32
-    WIN32_FIND_DATA findData;
-    HANDLE hFind;
-    hFind = FindFirstFile(join_path(2, dir, "*.jpg").c_str(), &findData);
-    if (hFind != INVALID_HANDLE_VALUE)
-    {
-        do
-        {
-            files.push_back(findData.cFileName);
-        }
-        while (FindNextFile(hFind, &findData));
-        FindClose(hFind);
-    }
-#else
-    DIR * dirp = opendir(dir);
-    if (dirp != NULL)
-    {
-        struct dirent * entry;
-        while ((entry = readdir(dirp)) != NULL)
-        {
-            string name(entry->d_name);
-            if (name.length() > 4 && name.substr(name.length() - 4) == ".jpg")
-                files.push_back(name);
-        }
-        closedir(dirp);
-    }
-#endif
-}
-
-
 bool displayProgress(unsigned int current, unsigned int total, void * data)
 {
     int * lastProgress = reinterpret_cast<int*>(data);